@@ -0,0 +1,1035 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/* Hand-written extensions to the EverCBOR API (see src/cbor/unverified.)
+
+   Unlike CBOR.h, nothing in this file is extracted from F*: these
+   functions are NOT formally verified. They only ever read `cbor`
+   objects obtained through the verified API (e.g. from `cbor_read`),
+   and they never modify them. */
+
+#ifndef __CBOR_Unverified_H
+#define __CBOR_Unverified_H
+
+#include <sys/uio.h>
+#include "CBOR.h"
+
+/* Random access into arrays.
+
+   `cbor_array_index` on a serialized array jumps over all elements
+   before the requested one, so accessing every element by index is
+   quadratic. A `cbor_indexed_array` records the offset of every
+   element, in a single pass over the array, the first time an element
+   is accessed; subsequent accesses are constant-time.
+
+   `offsets` is caller-provided storage of `offsets_length` entries,
+   which must outlive the `cbor_indexed_array`. The table needs
+   `cbor_array_length(a) + 1` entries; if `offsets_length` is smaller,
+   `cbor_indexed_array_index` falls back to `cbor_array_index`. No
+   storage is needed if `a` is not serialized. */
+
+typedef struct cbor_indexed_array_s
+{
+  cbor cbor_indexed_array_payload;
+  uint64_t cbor_indexed_array_length;
+  size_t *cbor_indexed_array_offsets;
+  size_t cbor_indexed_array_offsets_length;
+  uint8_t *cbor_indexed_array_base;
+}
+cbor_indexed_array;
+
+cbor_indexed_array cbor_indexed_array_init(cbor a, size_t *offsets, size_t offsets_length);
+
+uint64_t cbor_indexed_array_length(cbor_indexed_array *a);
+
+cbor cbor_indexed_array_index(cbor_indexed_array *a, size_t i);
+
+/* Hash-indexed map lookup.
+
+   `CBOR_Pulse_cbor_map_get` compares the key with every key of the
+   map. A `cbor_map_index` is an open-addressing hash table over the
+   entries of a map (serialized or not), keyed by a hash of the
+   deterministic encoding of each key, so that each lookup costs an
+   expected constant number of key comparisons. Lookups have the same
+   result as `CBOR_Pulse_cbor_map_get`, including on maps with duplicate
+   keys (the first entry wins.)
+
+   `slots` is caller-provided storage of `slots_length` entries, which
+   must outlive the index. `slots_length` must be a power of two greater
+   than the number of entries of the map;
+   `cbor_map_index_slots_length` returns a suitable size (twice the
+   number of entries, rounded up.) */
+
+typedef struct cbor_map_index_slot_s
+{
+  bool cbor_map_index_slot_is_used;
+  uint64_t cbor_map_index_slot_hash;
+  cbor_map_entry cbor_map_index_slot_entry;
+}
+cbor_map_index_slot;
+
+typedef struct cbor_map_index_s
+{
+  cbor_map_index_slot *cbor_map_index_slots;
+  size_t cbor_map_index_slots_length;
+}
+cbor_map_index;
+
+size_t cbor_map_index_slots_length(cbor map);
+
+bool
+cbor_map_index_init(
+  cbor map,
+  cbor_map_index_slot *slots,
+  size_t slots_length,
+  cbor_map_index *res
+);
+
+CBOR_Pulse_cbor_map_get_t cbor_map_index_get(cbor_map_index *idx, cbor key);
+
+/* Byte comparison.
+
+   `cbor_bytes_lex_compare` compares `a1` (of `n1` bytes) and `a2` (of
+   `n2` bytes) in bytewise lexicographic order, a shorter array being
+   smaller than any of its extensions, and returns -1, 0 or 1. It has
+   the specification of the verified `CBOR_Pulse_byte_array_compare`
+   (on arrays of the same length), against which it is tested, but it is
+   not verified: it compares 32 bytes (AVX2, chosen at run time) or 16
+   bytes (SSE2) at a time where available. The verified API does not
+   call it. */
+
+int16_t cbor_bytes_lex_compare(size_t n1, uint8_t *a1, size_t n2, uint8_t *a2);
+
+/* Binary-search lookup in deterministically encoded maps.
+
+   The keys of a map accepted by `cbor_read_deterministically_encoded`
+   are sorted by the bytewise lexicographic order of their encodings.
+   `cbor_canonical_map_init` records the offsets of all keys and values
+   in a single pass, after which each lookup is a binary search over the
+   encoded keys. `map` MUST be a serialized map read by
+   `cbor_read_deterministically_encoded` (or a sub-item of such an
+   object); lookups on any other map may return wrong results.
+
+   `offsets` is caller-provided storage of `offsets_length` entries,
+   which must outlive the `cbor_canonical_map`, and must have room for
+   `2 * cbor_map_length(map) + 1` entries. `cbor_canonical_map_init`
+   returns false if `map` is not a serialized map or if `offsets` is too
+   short. */
+
+typedef struct cbor_canonical_map_s
+{
+  uint8_t *cbor_canonical_map_base;
+  uint64_t cbor_canonical_map_length;
+  size_t *cbor_canonical_map_offsets;
+}
+cbor_canonical_map;
+
+bool
+cbor_canonical_map_init(
+  cbor map,
+  size_t *offsets,
+  size_t offsets_length,
+  cbor_canonical_map *res
+);
+
+CBOR_Pulse_cbor_map_get_t cbor_canonical_map_get(cbor_canonical_map *m, cbor key);
+
+/* Same, with a key given by its deterministic encoding */
+CBOR_Pulse_cbor_map_get_t
+cbor_canonical_map_get_encoded(cbor_canonical_map *m, uint8_t *key, size_t key_size);
+
+/* Map sorting with a scratch buffer.
+
+   `CBOR_Pulse_cbor_map_sort` merges in place, by block rotations, and
+   fully compares keys at each step. `cbor_map_sort_with_scratch` sorts
+   the same way (by the bytewise order of the key encodings) but merges
+   bottom-up between the two halves of `scratch`, in linear time per
+   pass, and compares cached 8-byte prefixes of the key encodings before
+   falling back to `CBOR_Pulse_cbor_compare`.
+
+   Like `CBOR_Pulse_cbor_map_sort`, it returns false if the map has
+   duplicate keys. In that case, `a` is left unchanged (whereas
+   `CBOR_Pulse_cbor_map_sort` leaves it partially sorted.)
+
+   `scratch` is caller-provided storage of `scratch_length` entries,
+   which must have room for `2 * len` entries; otherwise this function
+   falls back to `CBOR_Pulse_cbor_map_sort`. */
+
+typedef struct cbor_map_sort_entry_s
+{
+  uint64_t cbor_map_sort_entry_prefix;
+  uint8_t cbor_map_sort_entry_prefix_length;
+  bool cbor_map_sort_entry_prefix_is_complete;
+  cbor_map_entry cbor_map_sort_entry_entry;
+}
+cbor_map_sort_entry;
+
+bool
+cbor_map_sort_with_scratch(
+  cbor_map_entry *a,
+  size_t len,
+  cbor_map_sort_entry *scratch,
+  size_t scratch_length
+);
+
+/* Validate-and-index reader.
+
+   `cbor_read` only validates its input; then each step of an iterator,
+   or each `cbor_array_index`, jumps over the bytes of the preceding
+   elements again. `cbor_read_indexed` accepts exactly the same inputs
+   as `cbor_read` (and consumes the same number of bytes), but, in the
+   same single pass, it records the offsets of the children of every
+   array, map and tag into `index`, caller-provided storage of
+   `index_length` entries. Navigating the resulting
+   `cbor_indexed_item` is then constant-time.
+
+   `cbor_read_indexed` also fails if `index` is too short;
+   `cbor_read_indexed_index_length(sz)` entries are always enough for
+   an input of `sz` bytes. `index` and the input must outlive all
+   `cbor_indexed_item` values obtained from the result.
+
+   As with the verified API, `cbor_indexed_item_array_index`,
+   `cbor_indexed_item_map_key`, `cbor_indexed_item_map_value` and
+   `cbor_indexed_item_tagged_payload` require an item of the right major
+   type and an index in bounds (`cbor_indexed_item_length` returns the
+   number of elements of an array or of entries of a map.)
+   `cbor_indexed_item_get` returns the item as a (serialized) `cbor`
+   object, for use with the verified API. */
+
+typedef struct cbor_indexed_item_s
+{
+  uint8_t *cbor_indexed_item_base;
+  size_t *cbor_indexed_item_index;
+  size_t cbor_indexed_item_offset;
+  size_t cbor_indexed_item_size;
+  size_t cbor_indexed_item_table;
+}
+cbor_indexed_item;
+
+typedef struct cbor_read_indexed_t_s
+{
+  bool cbor_read_indexed_is_success;
+  cbor_indexed_item cbor_read_indexed_payload;
+  uint8_t *cbor_read_indexed_remainder;
+  size_t cbor_read_indexed_remainder_length;
+}
+cbor_read_indexed_t;
+
+size_t cbor_read_indexed_index_length(size_t sz);
+
+cbor_read_indexed_t cbor_read_indexed(uint8_t *a, size_t sz, size_t *index, size_t index_length);
+
+cbor cbor_indexed_item_get(cbor_indexed_item x);
+
+uint64_t cbor_indexed_item_length(cbor_indexed_item x);
+
+cbor_indexed_item cbor_indexed_item_array_index(cbor_indexed_item x, size_t i);
+
+cbor_indexed_item cbor_indexed_item_map_key(cbor_indexed_item x, size_t i);
+
+cbor_indexed_item cbor_indexed_item_map_value(cbor_indexed_item x, size_t i);
+
+cbor_indexed_item cbor_indexed_item_tagged_payload(cbor_indexed_item x);
+
+/* Incremental validation.
+
+   A `cbor_stream_validator` accepts the same inputs as `cbor_read`, but
+   given in successive chunks, without keeping or rescanning the bytes
+   it has already accepted: its state is the number of data items still
+   to be read, the number of bytes of a string payload still to be
+   skipped, and the bytes of a header split across chunks.
+
+   `cbor_stream_validator_feed` validates as much of `chunk` as
+   possible and returns:
+   - `CBOR_STREAM_VALIDATOR_COMPLETE` if the data item ends within
+     `chunk`, in which case `*pos` is set to the offset in `chunk` just
+     past its end, and `cbor_stream_validator_consumed` is its total
+     size;
+   - `CBOR_STREAM_VALIDATOR_NEED_MORE_DATA` if all of `chunk` was
+     accepted but the data item is not complete yet;
+   - `CBOR_STREAM_VALIDATOR_ERROR` if the input is invalid.
+   Once the data item is complete or an error is found, subsequent calls
+   return the same status and consume nothing. Data items whose
+   number of pending items does not fit in a `size_t` are rejected. */
+
+#define CBOR_STREAM_VALIDATOR_NEED_MORE_DATA 0
+#define CBOR_STREAM_VALIDATOR_COMPLETE 1
+#define CBOR_STREAM_VALIDATOR_ERROR 2
+
+typedef uint8_t cbor_stream_validator_status;
+
+typedef struct cbor_stream_validator_s
+{
+  cbor_stream_validator_status cbor_stream_validator_status;
+  size_t cbor_stream_validator_pending;
+  uint64_t cbor_stream_validator_skip;
+  uint64_t cbor_stream_validator_consumed;
+  uint8_t cbor_stream_validator_header[9U];
+  uint8_t cbor_stream_validator_header_length;
+}
+cbor_stream_validator;
+
+void cbor_stream_validator_init(cbor_stream_validator *v);
+
+cbor_stream_validator_status
+cbor_stream_validator_feed(cbor_stream_validator *v, uint8_t *chunk, size_t len, size_t *pos);
+
+uint64_t cbor_stream_validator_consumed(cbor_stream_validator *v);
+
+/* Batched reading of CBOR sequences (RFC 8742).
+
+   `cbor_read_sequence` reads up to `n` consecutive data items from `a`,
+   each accepted exactly when `cbor_read` would accept it, and stores
+   them (as serialized `cbor` objects) into `items`, and their offsets in
+   `a` into `offsets` (unless `offsets` is NULL.) It stops after `n`
+   items, at the end of the input, or at the first item that is not
+   valid. In the latter case, `cbor_read_sequence_is_invalid` tells
+   whether the item is invalid or just truncated (in which case it may
+   be completed with more data.) The remainder starts after the last
+   item read. */
+
+typedef struct cbor_read_sequence_t_s
+{
+  size_t cbor_read_sequence_count;
+  bool cbor_read_sequence_is_invalid;
+  uint8_t *cbor_read_sequence_remainder;
+  size_t cbor_read_sequence_remainder_length;
+}
+cbor_read_sequence_t;
+
+cbor_read_sequence_t
+cbor_read_sequence(uint8_t *a, size_t sz, cbor *items, size_t *offsets, size_t n);
+
+/* Memory-mapped files.
+
+   `cbor_file_open` maps the file at `path` read-only into memory,
+   instead of reading it into a buffer, so that files larger than
+   memory can be read: pages are loaded when first accessed, and may be
+   evicted again. It returns `CBOR_FILE_ERROR` (with `errno` set) if the
+   file cannot be opened or mapped. `cbor_file_read(f, offset)` reads
+   the data item at `offset` in the file as `cbor_read` does, hinting
+   the kernel to read ahead while validating it. The resulting
+   serialized `cbor` objects, and all objects obtained from them by the
+   iterators and accessors, point into the mapping: they must not be
+   used after `cbor_file_close`. The file must not be modified while it
+   is mapped. These functions use POSIX `mmap`. */
+
+#define CBOR_FILE_SUCCESS 0
+#define CBOR_FILE_ERROR 1
+
+typedef uint8_t cbor_file_status;
+
+typedef struct cbor_file_s
+{
+  uint8_t *cbor_file_base;
+  size_t cbor_file_size;
+}
+cbor_file;
+
+cbor_file_status cbor_file_open(const char *path, cbor_file *res);
+
+cbor_read_t cbor_file_read(cbor_file *f, size_t offset);
+
+void cbor_file_close(cbor_file *f);
+
+/* Path queries.
+
+   A path is an array of steps, each selecting a child of the current
+   data item: the element of an array at some index, the value of a map
+   for some key, or the payload of a tag with some tag number. Keys are
+   given by their encoding, as produced by `cbor_write` (which
+   `cbor_path_step_key_of_cbor` calls.)
+
+   `cbor_path_get` follows the `path_length` steps of `path` from `c`,
+   and sets `*res` to the data item reached, or returns false if some
+   step does not apply (a data item of another type, an index out of
+   bounds, a missing key or another tag number.) Within serialized data
+   items, which must come from `cbor_read` or a similar validator, it
+   follows the whole path in one forward scan, skipping each sibling
+   before the target by looking only at headers and string lengths,
+   rather than with `cbor_array_index` and `CBOR_Pulse_cbor_map_get`,
+   and the result is a serialized data item pointing into the input. */
+
+#define CBOR_PATH_STEP_INDEX 0
+#define CBOR_PATH_STEP_KEY 1
+#define CBOR_PATH_STEP_TAG 2
+
+typedef struct cbor_path_step_s
+{
+  uint8_t cbor_path_step_kind;
+  uint64_t cbor_path_step_argument;
+  uint8_t *cbor_path_step_key;
+  size_t cbor_path_step_key_size;
+}
+cbor_path_step;
+
+cbor_path_step cbor_path_step_index(uint64_t i);
+
+cbor_path_step cbor_path_step_tag(uint64_t tag);
+
+cbor_path_step cbor_path_step_key(uint8_t *key, size_t key_size);
+
+/* Writes the encoding of `key` into `out`, which must outlive the
+   step. Returns false if it does not fit in `sz` bytes. */
+bool cbor_path_step_key_of_cbor(cbor key, uint8_t *out, size_t sz, cbor_path_step *res);
+
+bool cbor_path_get(cbor c, cbor_path_step *path, size_t path_length, cbor *res);
+
+/* Traversals with an explicit stack.
+
+   `cbor_write`, `cbor_size_comp`, `cbor_l2r_write` and
+   `CBOR_Pulse_cbor_compare` recurse once per level of nesting, so that
+   deeply nested data may exhaust the C stack. The following functions
+   compute the same results with a loop, keeping one
+   `cbor_traversal_frame` per open array, map or tag in `stack`, which
+   the caller allocates. At most `stack_length` levels of nesting are
+   supported: deeper data items make them return
+   `CBOR_TRAVERSAL_MAX_DEPTH`.
+
+   - `cbor_size_with_stack` sets `*res` to the size of the encoding of
+     `c`, or returns `CBOR_TRAVERSAL_OUTPUT_TOO_SMALL` if it exceeds
+     `sz`.
+   - `cbor_write_with_stack` writes the encoding of `c` into `out` in
+     one pass, without computing its size first as `cbor_write` does,
+     and sets `*res` to its size. If it does not fit in `sz` bytes, it
+     returns `CBOR_TRAVERSAL_OUTPUT_TOO_SMALL`, sets `*res` to the size
+     needed (or `SIZE_MAX` if that does not fit in a `size_t`), and the
+     contents of `out` are unspecified.
+   - `cbor_encoded_size` sets `*res` to the size of the encoding of
+     `c`, or `SIZE_MAX` if that does not fit in a `size_t`. The size
+     only depends on `c`, so the caller may compute it once for a
+     subtree that is written several times, and use it to allocate
+     buffers of the exact size.
+   - `cbor_compare_with_stack` sets `*res` to the result of
+     `CBOR_Pulse_cbor_compare(c1, c2)`; since it traverses both data
+     items at once, each frame holds the state of both. */
+
+#define CBOR_TRAVERSAL_SUCCESS 0
+#define CBOR_TRAVERSAL_MAX_DEPTH 1
+#define CBOR_TRAVERSAL_OUTPUT_TOO_SMALL 2
+
+typedef uint8_t cbor_traversal_status;
+
+typedef struct cbor_traversal_frame_s
+{
+  uint8_t cbor_traversal_frame_type;
+  uint64_t cbor_traversal_frame_remaining;
+  cbor_array_iterator_t cbor_traversal_frame_array[2U];
+  cbor_map_iterator_t cbor_traversal_frame_map[2U];
+  cbor cbor_traversal_frame_next[2U];
+}
+cbor_traversal_frame;
+
+cbor_traversal_status
+cbor_size_with_stack(
+  cbor c,
+  size_t sz,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+);
+
+cbor_traversal_status
+cbor_write_with_stack(
+  cbor c,
+  uint8_t *out,
+  size_t sz,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+);
+
+cbor_traversal_status
+cbor_encoded_size(
+  cbor c,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+);
+
+cbor_traversal_status
+cbor_compare_with_stack(
+  cbor c1,
+  cbor c2,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  int16_t *res
+);
+
+/* Scatter-gather writing.
+
+   `cbor_write_iovec` describes the encoding of `c` as a list of
+   `iov_length` or fewer buffers, ready for `writev`, without copying
+   long payloads: headers (and strings and serialized items of at most
+   `CBOR_WRITE_IOVEC_COPY_THRESHOLD` bytes) are written into `scratch`,
+   whereas longer string payloads and serialized items are referenced
+   where they are. Adjacent buffers are merged. `*iov_count` is set to
+   the number of entries of `iov` used. The buffers must not be
+   modified until the output is written.
+
+   It returns `CBOR_TRAVERSAL_OUTPUT_TOO_SMALL` if `scratch` or `iov` is
+   too small, and uses `stack` as the functions above do. A `scratch`
+   of `9 + CBOR_WRITE_IOVEC_COPY_THRESHOLD` bytes per data item, or as
+   large as the encoding, is always enough. */
+
+#define CBOR_WRITE_IOVEC_COPY_THRESHOLD (64U)
+
+cbor_traversal_status
+cbor_write_iovec(
+  cbor c,
+  uint8_t *scratch,
+  size_t scratch_length,
+  struct iovec *iov,
+  size_t iov_length,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *iov_count
+);
+
+/* Right-to-left writing.
+
+   `cbor_r2l_write` writes the encoding of `c` at the end of the `sz`
+   bytes of `out`, back to front, so that the header of each array, map
+   or tag is written after its children, as with the right-to-left
+   output buffers of `LowParse.SteelST.R2LOutput`: the encoding is
+   written in one pass without computing its size first. It sets
+   `*res` to the offset in `out` where the encoding starts, and returns
+   `CBOR_TRAVERSAL_OUTPUT_TOO_SMALL` if it does not fit. Since it
+   writes nothing before that offset, the caller may then write a
+   prefix (e.g. the header of an enclosing COSE structure) into
+   `out[0.. *res]` in the same way. `stack` is used as by
+   `cbor_write_with_stack`. */
+
+cbor_traversal_status
+cbor_r2l_write(
+  cbor c,
+  uint8_t *out,
+  size_t sz,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+);
+
+/* Canonical map writing.
+
+   `cbor_write_canonical_map` writes the map of the `len` entries of
+   `a`, with its entries sorted by the bytewise order of the encodings
+   of their keys, as `CBOR_Pulse_cbor_map_sort` followed by `cbor_write`
+   would, but without comparing decoded keys: each key is encoded once
+   into `keys`, and entries are sorted by those bytes. `a` is left
+   unchanged. Values are written as they are, so that maps nested in
+   them are not sorted.
+
+   `keys` must have room for the encodings of all keys, and `entries`
+   for `len` entries; otherwise, as when `out` is too small, it returns
+   `CBOR_TRAVERSAL_OUTPUT_TOO_SMALL`. It returns
+   `CBOR_CANONICAL_MAP_DUPLICATE_KEY` if two keys have the same
+   encoding; in both cases, the contents of `out` are unspecified.
+   `stack` is used as by `cbor_write_with_stack`, and `*res`
+   is set to the size of the encoding. */
+
+#define CBOR_CANONICAL_MAP_DUPLICATE_KEY 3
+
+typedef struct cbor_canonical_map_entry_s
+{
+  uint64_t cbor_canonical_map_entry_prefix;
+  uint8_t *cbor_canonical_map_entry_key;
+  size_t cbor_canonical_map_entry_key_size;
+  cbor cbor_canonical_map_entry_value;
+}
+cbor_canonical_map_entry;
+
+cbor_traversal_status
+cbor_write_canonical_map(
+  cbor_map_entry *a,
+  size_t len,
+  uint8_t *out,
+  size_t sz,
+  uint8_t *keys,
+  size_t keys_length,
+  cbor_canonical_map_entry *entries,
+  size_t entries_length,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+);
+
+/* Growable output.
+
+   A `cbor_output` is a buffer of `cbor_output_length` bytes, of which
+   the first `cbor_output_position` are written. When
+   `cbor_output_write` runs out of space in it, it calls
+   `cbor_output_next(o, needed)`, where `needed` is the number of bytes
+   that it still has to write for the current data item: the callback
+   returns false to give up, or makes room for at least one more byte,
+   either by growing the buffer or by replacing it with a fresh one
+   and resetting the position, so that the output does not need to be
+   encoded again from scratch. `cbor_output_context` is left to the
+   callback. Two callbacks are provided:
+
+   - `cbor_output_next_realloc` grows the buffer with `realloc`, at
+     least doubling its size, so that the buffer must come from
+     `malloc` (or be NULL with a length of 0);
+   - `cbor_output_next_chunk` appends chunks to a chain starting with
+     the one allocated by `cbor_output_chunks_init`, all of the size
+     given there. All chunks but the last are full, and the last one
+     holds `cbor_output_position` bytes. `cbor_output_chunks_free`
+     frees the chain.
+
+   `cbor_output_write` appends the encoding of `c`, using `stack` as
+   `cbor_write_with_stack` does, and returns
+   `CBOR_TRAVERSAL_OUTPUT_TOO_SMALL` if the callback gives up. */
+
+typedef struct cbor_output_s cbor_output;
+
+typedef bool (*cbor_output_next_t)(cbor_output *o, size_t needed);
+
+struct cbor_output_s
+{
+  uint8_t *cbor_output_buffer;
+  size_t cbor_output_length;
+  size_t cbor_output_position;
+  cbor_output_next_t cbor_output_next;
+  void *cbor_output_context;
+};
+
+typedef struct cbor_output_chunk_s
+{
+  struct cbor_output_chunk_s *cbor_output_chunk_next;
+  uint8_t *cbor_output_chunk_data;
+}
+cbor_output_chunk;
+
+cbor_traversal_status
+cbor_output_write(cbor c, cbor_output *o, cbor_traversal_frame *stack, size_t stack_length);
+
+bool cbor_output_next_realloc(cbor_output *o, size_t needed);
+
+cbor_output_chunk *cbor_output_chunks_init(cbor_output *o, size_t chunk_size);
+
+bool cbor_output_next_chunk(cbor_output *o, size_t needed);
+
+void cbor_output_chunks_free(cbor_output_chunk *first);
+
+/* Compiled CDDL validation.
+
+   The validators of src/cddl/CDDL.Pulse.fst are closures over `cbor`
+   objects, built by the interpreter of CDDL.Interpreter.AST. A
+   `cddl_program` is the same AST compiled into a flat table of
+   instructions: each constructor below mirrors one constructor of
+   `typ`, `group` or `elem_typ`, appends one instruction to the
+   program (and, for `cddl_tmap`, the key table described below), and
+   returns its index, which later constructors take as arguments.
+   `cddl_validate` then interprets the table directly over the bytes
+   of a serialized data item, without creating `cbor` objects, and
+   accepts exactly the data items of `typ_sem` (see
+   CDDL.Spec.ArrayGroup and CDDL.Spec.MapGroupGen.Base for the
+   semantics of groups.)
+
+   The instructions, literals and definitions are caller-provided
+   storage given to `cddl_program_init`, which must outlive the
+   program. Constructors return `CDDL_NONE` if the program is full, if
+   an argument is `CDDL_NONE` (so that only the last result of a
+   sequence of constructors needs to be checked), if a group of arrays
+   is mixed with a group of maps, or if a map group is outside the
+   fragment that the verified implementation supports
+   (`ast0_wf_parse_map_group`): `GMapElem` with a literal key, or
+   `GZeroOrMore` (or `GOneOrMore`) of `GMapElem` without cut, combined
+   with `GConcat`, `GChoice` and `GZeroOrOne`.
+
+   `TDef` and `GDef` refer to definitions by number, below
+   `defs_length`: `cddl_program_define` sets the instruction of a
+   definition, possibly after it is used, as for recursive types.
+
+   Each type also records the set of initial bytes of the data items
+   that it may accept, and a `TChoice` only tries the alternatives that
+   may accept the initial byte of the data item. A chain of choices
+   `t1 / t2 / ... / tn` thus dispatches on that byte (i.e. on the major
+   type, and on the value of small literals and tags) instead of
+   attempting each alternative in turn. `cddl_program_define` updates
+   the sets of the types that depend on the definition.
+
+   Likewise, each `TMap` has a table of the literal keys of its group.
+   A map is matched in a single pass over its entries, which looks up
+   each key in the table, rather than with one scan of the map per
+   literal key; an entry whose key is neither in the table nor of an
+   initial byte accepted by the keys of some `GZeroOrMore` (or
+   `GOneOrMore`) rejects the map at once.
+
+   `c` must be a serialized data item, as returned by `cbor_read`;
+   other data items are first written into `scratch`. `scratch` holds
+   the offsets of the entries of the maps being matched (those on the
+   current nesting path); `cddl_validate_scratch_length(p, sz)` bytes
+   are always enough for a serialized data item of `sz` bytes. The
+   interpreter recurses once per level of nesting of instructions (and
+   thus of data items): beyond `CDDL_MAX_DEPTH` levels, e.g. with a
+   recursive definition that loops without consuming any data, it
+   returns `CDDL_VALIDATE_MAX_DEPTH`. */
+
+#define CDDL_NONE (0xFFFFFFFFU)
+
+#define CDDL_ELEM_BOOL 0
+#define CDDL_ELEM_BYTE_STRING 1
+#define CDDL_ELEM_TEXT_STRING 2
+#define CDDL_ELEM_UINT 3
+#define CDDL_ELEM_NINT 4
+#define CDDL_ELEM_ALWAYS_FALSE 5
+#define CDDL_ELEM_ANY 6
+
+#define CDDL_VALIDATE_VALID 0
+#define CDDL_VALIDATE_INVALID 1
+#define CDDL_VALIDATE_OUT_OF_SCRATCH 2
+#define CDDL_VALIDATE_MAX_DEPTH 3
+
+#define CDDL_MAX_DEPTH (1024U)
+
+typedef uint8_t cddl_validate_status;
+
+typedef struct cddl_insn_s
+{
+  uint8_t cddl_insn_op;
+  uint8_t cddl_insn_kind;
+  uint32_t cddl_insn_left;
+  uint32_t cddl_insn_right;
+  uint64_t cddl_insn_argument;
+  uint64_t cddl_insn_first_bytes[4U];
+}
+cddl_insn;
+
+typedef struct cddl_program_s
+{
+  cddl_insn *cddl_program_insns;
+  uint32_t cddl_program_insns_length;
+  uint32_t cddl_program_insns_capacity;
+  uint8_t *cddl_program_literals;
+  size_t cddl_program_literals_length;
+  size_t cddl_program_literals_capacity;
+  uint32_t *cddl_program_defs;
+  uint32_t cddl_program_defs_length;
+  uint32_t cddl_program_max_keys;
+}
+cddl_program;
+
+void
+cddl_program_init(
+  cddl_program *p,
+  cddl_insn *insns,
+  uint32_t insns_capacity,
+  uint8_t *literals,
+  size_t literals_capacity,
+  uint32_t *defs,
+  uint32_t defs_length
+);
+
+bool cddl_program_define(cddl_program *p, uint32_t def, uint32_t insn);
+
+uint32_t cddl_telem(cddl_program *p, uint8_t elem);
+
+uint32_t cddl_tliteral_simple(cddl_program *p, uint8_t v);
+
+uint32_t cddl_tliteral_int(cddl_program *p, uint8_t ty, uint64_t v);
+
+uint32_t cddl_tliteral_string(cddl_program *p, uint8_t ty, uint8_t *s, uint64_t len);
+
+uint32_t cddl_tdef(cddl_program *p, uint32_t def);
+
+uint32_t cddl_tarray(cddl_program *p, uint32_t g);
+
+uint32_t cddl_tmap(cddl_program *p, uint32_t g);
+
+uint32_t cddl_ttagged(cddl_program *p, uint64_t tag, uint32_t t);
+
+uint32_t cddl_tchoice(cddl_program *p, uint32_t t1, uint32_t t2);
+
+uint32_t cddl_gdef(cddl_program *p, uint32_t def);
+
+uint32_t cddl_garray_elem(cddl_program *p, uint32_t t);
+
+uint32_t cddl_gmap_elem(cddl_program *p, bool cut, uint32_t key, uint32_t value);
+
+uint32_t cddl_galways_false(cddl_program *p);
+
+uint32_t cddl_gnop(cddl_program *p);
+
+uint32_t cddl_gzero_or_one(cddl_program *p, uint32_t g);
+
+uint32_t cddl_gzero_or_more(cddl_program *p, uint32_t g);
+
+uint32_t cddl_gone_or_more(cddl_program *p, uint32_t g);
+
+uint32_t cddl_gconcat(cddl_program *p, uint32_t g1, uint32_t g2);
+
+uint32_t cddl_gchoice(cddl_program *p, uint32_t g1, uint32_t g2);
+
+size_t cddl_validate_scratch_length(cddl_program *p, size_t sz);
+
+cddl_validate_status
+cddl_validate(
+  cddl_program *p,
+  uint32_t t,
+  cbor c,
+  uint8_t *scratch,
+  size_t scratch_length
+);
+
+/* Typed decoding.
+
+   The target types of CDDL.Interpreter.Pulse (`impl_type_sem` of
+   `TTPair`, `TTUnion`, `TTOption`, `TTArray` and `TTTable`) become C
+   structs, filled by `cddl_decode` in the same pass that validates the
+   data item, instead of being navigated afterwards with
+   `cbor_map_get`. A program describes where each part of the data item
+   goes with the instructions below, which accept the same data items as
+   the type (or group) that they wrap, so that `cddl_validate` ignores
+   them:
+   - `cddl_tstore` writes the data item as a field of the current
+     record (initially `out`): a `bool` (true for `true`), a `uint64_t`
+     (the argument of its header: value of an unsigned integer,
+     argument of a negative one, string length, tag number or simple
+     value), a `cbor_int`, a `cbor_string` (for strings), or a `cbor`
+     (the serialized data item);
+   - `cddl_tcase` writes `value` as a `uint32_t`, e.g. to tell which
+     alternative of a choice matched (`TTUnion`), or whether an optional
+     entry was present (`TTOption`);
+   - `cddl_tstruct` makes the struct at `offset` of the current record
+     the current record (`TTPair`, for a definition used at several
+     places);
+   - `cddl_gstore_each`, on a `GZeroOrMore` or `GOneOrMore` of an array
+     group, or of a `GMapElem` without literal key (`TTArray` and
+     `TTTable`), matches each element (or entry) with a new record of
+     `size` bytes as the current record, allocated from `storage` and
+     zeroed, and writes their `cddl_records`.
+
+   Offsets are in bytes; fields need not be aligned. `cddl_decode`
+   zeroes the `out_size` bytes of `out` first, and fails with
+   `CDDL_VALIDATE_OUT_OF_STORAGE` if `storage` is too small: an array
+   of `n` elements takes at most `n + 1` records, a map of `n` entries
+   `n`. Strings and data items point into the serialized bytes of `c`
+   (or into `scratch` if `c` is not serialized). A type or group that
+   does not match in the end leaves the fields as they were: while the
+   failure of an alternative, optional or repeated group or map entry
+   may still be recovered from, each field that it writes outside of
+   its own records, after some part of it may already have failed, is
+   first saved at the end of `storage`, in a few words. */
+
+#define CDDL_VALIDATE_OUT_OF_STORAGE 4
+
+#define CDDL_FIELD_BOOL 0
+#define CDDL_FIELD_UINT64 1
+#define CDDL_FIELD_INT 2
+#define CDDL_FIELD_STRING 3
+#define CDDL_FIELD_ITEM 4
+
+typedef struct cddl_records_s
+{
+  uint8_t *cddl_records_payload;
+  size_t cddl_records_length;
+}
+cddl_records;
+
+uint32_t cddl_tstore(cddl_program *p, uint32_t t, uint8_t field, size_t offset);
+
+uint32_t cddl_tcase(cddl_program *p, uint32_t t, size_t offset, uint32_t value);
+
+uint32_t cddl_tstruct(cddl_program *p, uint32_t t, size_t offset);
+
+uint32_t cddl_gstore_each(cddl_program *p, uint32_t g, size_t offset, uint32_t size);
+
+cddl_validate_status
+cddl_decode(
+  cddl_program *p,
+  uint32_t t,
+  cbor c,
+  uint8_t *out,
+  size_t out_size,
+  uint8_t *storage,
+  size_t storage_length,
+  uint8_t *scratch,
+  size_t scratch_length
+);
+
+/* Typed encoding.
+
+   `impl_serialize` in src/cddl/CDDL.Pulse.fst writes a `cbor` tree,
+   which the caller first builds with `cbor_constr_*`. `cddl_encode`
+   instead writes the data item described by the struct `in` directly,
+   from left to right, with the same program and the same structs as
+   `cddl_decode`:
+   - literals are written as such, and tags with their payload;
+   - a `cddl_tstore` writes its field, whose initial byte must be
+     accepted by the type that it wraps (a `uint64_t` field needs a type
+     of a single major type: unsigned or negative integers, or simple
+     values);
+   - a `cddl_tcase` matches only if its field holds its value, so that
+     a choice writes the first alternative that the struct selects, and
+     a `GZeroOrOne` writes its group only if it matches;
+   - a `cddl_gstore_each` writes one element (or entry) per record;
+   - `GZeroOrMore` and `GOneOrMore` without records, and types without
+     stores other than literals, write as few data items as they
+     accept, i.e. none or fail.
+   Arrays and maps have as many elements and entries as their groups
+   write. The output is deterministically encoded, as
+   `cbor_read_deterministically_encoded` accepts it: the entries of
+   each map are sorted by their encoded keys, and `cddl_encode` fails
+   if two of them are equal (which `cddl_encoded_size` does not check.)
+   Fields of kind `CDDL_FIELD_ITEM` must be serialized data items, as
+   `cddl_decode` returns them, that are deterministically encoded.
+
+   `cddl_encoded_size` sets `*res` to the exact size of the encoding,
+   so that the output can be allocated at once, and `cddl_encode`
+   writes it into the `sz` bytes of `out` and sets `*res` to its size,
+   or returns `CDDL_VALIDATE_OUTPUT_TOO_SMALL`. Both return
+   `CDDL_VALIDATE_INVALID` if the struct describes no data item of the
+   type. No `cbor` objects are created, and each byte is written once,
+   except for the elements of arrays and maps of 24 elements (or
+   entries) or more, which are moved once their header is known, and
+   for map entries written out of key order. Those are sorted in place,
+   without scratch storage, by rotating each one before the entries
+   written so far whose keys are greater: entries written in key order
+   cost one key comparison each, but entries written in reverse key
+   order cost O(entries * bytes) time, so the fields of a
+   `cddl_gstore_each` of a large map should be given in key order. */
+
+#define CDDL_VALIDATE_OUTPUT_TOO_SMALL 5
+
+cddl_validate_status cddl_encoded_size(cddl_program *p, uint32_t t, uint8_t *in, size_t *res);
+
+cddl_validate_status
+cddl_encode(cddl_program *p, uint32_t t, uint8_t *in, uint8_t *out, size_t sz, size_t *res);
+
+/* Compact representation.
+
+   A `cbor` takes 32 bytes, and a `cbor_map_entry` 64. A `cbor_compact`
+   takes 16 bytes (on 64-bit platforms): its header packs the
+   `CBOR_Case_*` tag (3 bits), the major type (3 bits) and a 56-bit
+   argument (string, array or map length, tag number, or size of a
+   serialized data item), and its second word is either the value of
+   an integer or simple value, or a pointer to the string bytes, to the
+   serialized bytes, or to the children. The children of an array are
+   contiguous `cbor_compact` values; those of a map are its keys and
+   values, alternating, so a map entry takes 32 bytes; that of a tag is
+   its payload.
+
+   Tag numbers and lengths of 2^56 or more cannot be represented:
+   `cbor_compact_of_cbor` fails on them, and the constructors must not
+   be given them.
+
+   Constructors and destructors mirror those of CBOR.h, and accept
+   serialized values as well (from `cbor_compact_of_cbor`), whose
+   children are then serialized too. Serialized map entries are found
+   by iterating from the first one.
+
+   `cbor_compact_of_cbor` converts `c` and all its constructed
+   descendants, breadth first without recursion, into `storage`: every
+   array element, map key and map value (but not the elements of
+   serialized items) takes one entry. Since each takes at least one
+   byte of encoding, the size of the encoding of `c` is always enough.
+   It returns false if `storage` is too small.
+
+   `cbor_compact_write` converts back, to the encoding of `c`, with the
+   same result as `cbor_write`, and sets `*res` to its size. It loops
+   rather than recursing, with one `cbor_compact_frame` in `stack` per
+   array, map or tag whose children are not all written yet (the last
+   child takes the frame of its parent), and returns the
+   `CBOR_TRAVERSAL_*` statuses of `cbor_write_with_stack`; if the
+   encoding does not fit in `sz` bytes, `*res` is unchanged.
+
+   `cbor_of_compact` converts `c` back to a `cbor` tree, breadth first
+   as well: each array element and tag payload takes one entry of
+   `storage`, and each map entry one entry of `entries`; it returns
+   false if either is too small. Serialized items stay serialized. */
+
+#define CBOR_COMPACT_MAX_ARGUMENT ((1ULL << 56U) - 1ULL)
+
+typedef struct cbor_compact_s
+{
+  uint64_t cbor_compact_header;
+  union {
+    uint64_t cbor_compact_value;
+    uint8_t *cbor_compact_bytes;
+    struct cbor_compact_s *cbor_compact_children;
+  }
+  ;
+}
+cbor_compact;
+
+cbor_compact cbor_compact_constr_int64(uint8_t ty, uint64_t value);
+
+cbor_compact cbor_compact_constr_simple_value(uint8_t value);
+
+cbor_compact cbor_compact_constr_string(uint8_t typ, uint8_t *a, uint64_t len);
+
+cbor_compact cbor_compact_constr_array(cbor_compact *a, uint64_t len);
+
+cbor_compact cbor_compact_constr_map(cbor_compact *keys_and_values, uint64_t len);
+
+cbor_compact cbor_compact_constr_tagged(uint64_t tag, cbor_compact *a);
+
+uint8_t cbor_compact_get_major_type(cbor_compact c);
+
+cbor_int cbor_compact_destr_int64(cbor_compact c);
+
+uint8_t cbor_compact_destr_simple_value(cbor_compact c);
+
+cbor_string cbor_compact_destr_string(cbor_compact c);
+
+uint64_t cbor_compact_array_length(cbor_compact c);
+
+cbor_compact cbor_compact_array_index(cbor_compact c, size_t i);
+
+uint64_t cbor_compact_map_length(cbor_compact c);
+
+cbor_compact cbor_compact_map_key(cbor_compact c, size_t i);
+
+cbor_compact cbor_compact_map_value(cbor_compact c, size_t i);
+
+uint64_t cbor_compact_tagged_tag(cbor_compact c);
+
+cbor_compact cbor_compact_tagged_payload(cbor_compact c);
+
+bool
+cbor_compact_of_cbor(cbor c, cbor_compact *storage, size_t storage_length, cbor_compact *res);
+
+typedef struct cbor_compact_frame_s
+{
+  cbor_compact *cbor_compact_frame_next;
+  size_t cbor_compact_frame_remaining;
+}
+cbor_compact_frame;
+
+cbor_traversal_status
+cbor_compact_write(
+  cbor_compact c,
+  uint8_t *out,
+  size_t sz,
+  cbor_compact_frame *stack,
+  size_t stack_length,
+  size_t *res
+);
+
+bool
+cbor_of_compact(
+  cbor_compact c,
+  cbor *storage,
+  size_t storage_length,
+  cbor_map_entry *entries,
+  size_t entries_length,
+  cbor *res
+);
+
+
+#define __CBOR_Unverified_H_DEFINED
+#endif
@@ -1,6 +1,9 @@
 #include <stdlib.h>
 #include <malloc.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 #include "CBORRaw.h"
 
 struct cbor;
@@ -56,6 +59,56 @@ struct cbor_pair {
   struct cbor cbor_pair_value;
 };
 
+/* A bump allocator over a caller-provided region. All the nodes that
+   the loaders allocate for one document come from the same region, so
+   that they can be freed at once by resetting the arena (or freeing the
+   region), without walking the tree. */
+struct cbor_arena {
+  uint8_t *cbor_arena_base;
+  size_t cbor_arena_size;
+  size_t cbor_arena_used;
+};
+
+void cbor_arena_init (struct cbor_arena *arena, uint8_t *base, size_t size) {
+  arena->cbor_arena_base = base;
+  arena->cbor_arena_size = size;
+  arena->cbor_arena_used = 0;
+}
+
+/* Frees everything allocated from `arena`, in O(1). The `struct cbor`
+   values that point into it must not be used afterwards. */
+void cbor_arena_reset (struct cbor_arena *arena) {
+  arena->cbor_arena_used = 0;
+}
+
+/* Size of a region that is always enough to fully load a document of
+   `size` bytes: each data item takes at least one byte, and needs at
+   most one `struct cbor` node (map entries take two nodes but two
+   items). Returns 0 on overflow. */
+size_t cbor_arena_size_for_full_load (size_t size) {
+  if (size > (SIZE_MAX - _Alignof(struct cbor)) / sizeof(struct cbor))
+    return 0;
+  return size * sizeof(struct cbor) + _Alignof(struct cbor);
+}
+
+/* Returns NULL if `arena` has not enough space left, or if
+   `count * size` overflows. With a NULL `arena`, allocates from the
+   heap instead. */
+static void *cbor_arena_alloc (struct cbor_arena *arena, uint64_t count, size_t size) {
+  if (count > SIZE_MAX / size)
+    return NULL;
+  if (arena == NULL)
+    return calloc(count, size);
+  size_t n = count * size;
+  uintptr_t base = (uintptr_t) arena->cbor_arena_base;
+  size_t align = _Alignof(struct cbor);
+  size_t start = arena->cbor_arena_used + ((align - (base + arena->cbor_arena_used) % align) % align);
+  if (start > arena->cbor_arena_size || n > arena->cbor_arena_size - start)
+    return NULL;
+  arena->cbor_arena_used = start + n;
+  return arena->cbor_arena_base + start;
+}
+
 uint8_t cbor_get_type (struct cbor *elt) {
   uint8_t ty = elt->cbor_type;
   if (ty == CBOR_TYPE_SERIALIZED)
@@ -98,9 +151,12 @@ void preload_cbor (uint8_t **src, struct cbor *dst) {
   *src += src_size;
 }
 
-void load_cbor (struct cbor* elt) {
+/* Loads the top level of `elt`, allocating its children from `arena`,
+   or from the heap if `arena` is NULL. Returns false if an allocation
+   failed, in which case `elt` is left unchanged. */
+bool load_cbor_arena (struct cbor* elt, struct cbor_arena *arena) {
   if (elt->cbor_type != CBOR_TYPE_SERIALIZED)
-    return;
+    return true;
   uint8_t *payload = elt->cbor_payload.cbor_case_serialized.cbor_serialized_payload;
   uint8_t typ = CBOR_SteelST_Raw_read_major_type(payload);
   switch (typ) {
@@ -108,34 +164,34 @@ void load_cbor (struct cbor* elt) {
     {
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_uint64 = CBOR_SteelST_Raw_read_int64(payload);
-      return;
+      return true;
     }
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_NEG_INT64:
     {
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_neg_int64 = CBOR_SteelST_Raw_read_int64(payload);
-      return;
+      return true;
     }
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_BYTE_STRING:
     {
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_byte_string.cbor_string_byte_length = CBOR_SteelST_Raw_read_argument_as_uint64(payload);
       elt->cbor_payload.cbor_case_byte_string.cbor_string_payload = CBOR_SteelST_Raw_focus_string(payload);
-      return;
+      return true;
     }
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_TEXT_STRING:
     {
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_text_string.cbor_string_byte_length = CBOR_SteelST_Raw_read_argument_as_uint64(payload);
       elt->cbor_payload.cbor_case_text_string.cbor_string_payload = CBOR_SteelST_Raw_focus_string(payload);
-      return;
+      return true;
     }
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_ARRAY:
     {
       uint64_t count = CBOR_SteelST_Raw_read_argument_as_uint64(payload);
-      struct cbor *array = calloc(count, sizeof(struct cbor));
-      if (array == NULL)
-        return;
+      struct cbor *array = cbor_arena_alloc(arena, count, sizeof(struct cbor));
+      if (array == NULL && count > 0)
+        return false;
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_array.cbor_array_count = count;
       elt->cbor_payload.cbor_case_array.cbor_array_payload = array;
@@ -144,14 +200,14 @@ void load_cbor (struct cbor* elt) {
         preload_cbor(&payload, array);
         ++array;
       }
-      return;
+      return true;
     }
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_MAP:
     {
       uint64_t count = CBOR_SteelST_Raw_read_argument_as_uint64(payload);
-      struct cbor_pair *map = calloc(count, sizeof(struct cbor_pair));
-      if (map == NULL)
-        return;
+      struct cbor_pair *map = cbor_arena_alloc(arena, count, sizeof(struct cbor_pair));
+      if (map == NULL && count > 0)
+        return false;
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_map.cbor_map_entry_count = count;
       elt->cbor_payload.cbor_case_map.cbor_map_payload = map;
@@ -161,59 +217,142 @@ void load_cbor (struct cbor* elt) {
         preload_cbor(&payload, &(map->cbor_pair_value));
         ++map;
       }
-      return;
+      return true;
     }
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_TAGGED:
     {
-      struct cbor *elt = malloc(sizeof(struct cbor));
-      if (elt == NULL)
-        return;
+      struct cbor *child = cbor_arena_alloc(arena, 1, sizeof(struct cbor));
+      if (child == NULL)
+        return false;
       uint64_t tag = CBOR_SteelST_Raw_read_argument_as_uint64(payload);
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_tagged.cbor_tagged_tag = tag;
-      elt->cbor_payload.cbor_case_tagged.cbor_tagged_payload = elt;
+      elt->cbor_payload.cbor_case_tagged.cbor_tagged_payload = child;
       payload += CBOR_SteelST_Raw_jump_header(payload);
-      preload_cbor(&payload, elt);
-      return;
+      preload_cbor(&payload, child);
+      return true;
     }
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_SIMPLE_VALUE:
     {
       elt->cbor_type = typ;
       elt->cbor_payload.cbor_case_simple_value = CBOR_SteelST_Raw_read_simple_value(payload);
-      return;
+      return true;
     }
   }
+  return true;
 }
 
-/* Warning: this function may exhaust the stack */
-void full_load_cbor (struct cbor* elt) {
-  load_cbor(elt);
+void load_cbor (struct cbor* elt) {
+  load_cbor_arena(elt, NULL);
+}
+
+/* One frame per array, map or tag whose children are being loaded: the
+   next child to load, and the number of children left. The keys and
+   values of a map are loaded as one array of `struct cbor`. */
+struct cbor_load_frame {
+  struct cbor *cbor_load_frame_next;
+  uint64_t cbor_load_frame_remaining;
+};
+
+_Static_assert(sizeof(struct cbor_pair) == 2 * sizeof(struct cbor), "map entries must be contiguous keys and values");
+
+#define CBOR_LOAD_SUCCESS 0
+#define CBOR_LOAD_OUT_OF_MEMORY 1
+#define CBOR_LOAD_MAX_DEPTH 2
+
+/* Frames that `full_load_cbor_arena` keeps on the C stack, before
+   moving its stack to the heap */
+#define CBOR_FULL_LOAD_STACK_LENGTH 64
+
+static void children_of (struct cbor *elt, struct cbor_load_frame *frame) {
   switch (elt->cbor_type) {
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_ARRAY:
-    {
-      uint64_t count = elt->cbor_payload.cbor_case_array.cbor_array_count;
-      struct cbor* child = elt->cbor_payload.cbor_case_array.cbor_array_payload;
-      for (uint64_t i = 0; i < count; ++i) {
-        full_load_cbor(child);
-        ++child;
-      }
-      return;
-    }
+    frame->cbor_load_frame_next = elt->cbor_payload.cbor_case_array.cbor_array_payload;
+    frame->cbor_load_frame_remaining = elt->cbor_payload.cbor_case_array.cbor_array_count;
+    return;
   case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_MAP:
-    {
-      uint64_t count = elt->cbor_payload.cbor_case_map.cbor_map_entry_count;
-      struct cbor_pair* entry = elt->cbor_payload.cbor_case_map.cbor_map_payload;
-      for (uint64_t i = 0; i < count; ++i) {
-        full_load_cbor(&(entry->cbor_pair_key));
-        full_load_cbor(&(entry->cbor_pair_value));
-        ++entry;
+    frame->cbor_load_frame_next = &(elt->cbor_payload.cbor_case_map.cbor_map_payload->cbor_pair_key);
+    frame->cbor_load_frame_remaining = 2 * elt->cbor_payload.cbor_case_map.cbor_map_entry_count;
+    return;
+  case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_TAGGED:
+    frame->cbor_load_frame_next = elt->cbor_payload.cbor_case_tagged.cbor_tagged_payload;
+    frame->cbor_load_frame_remaining = 1;
+    return;
+  default:
+    frame->cbor_load_frame_remaining = 0;
+    return;
+  }
+}
+
+/* Loads `elt` and all its descendants, depth first, without recursion.
+   When `stack` is full, if `grow` is true, the frames are moved to a
+   heap-allocated stack twice as large, freed before returning. */
+static int full_load_cbor_loop (struct cbor* elt, struct cbor_arena *arena, struct cbor_load_frame *stack, size_t stack_length, bool grow) {
+  struct cbor_load_frame *heap = NULL;
+  size_t top = 0;
+  int res;
+  while (1) {
+    if (!load_cbor_arena(elt, arena)) {
+      res = CBOR_LOAD_OUT_OF_MEMORY;
+      break;
+    }
+    struct cbor_load_frame frame;
+    children_of(elt, &frame);
+    if (frame.cbor_load_frame_remaining > 0) {
+      if (top == stack_length) {
+        if (!grow || stack_length == 0 || stack_length > SIZE_MAX / 2 / sizeof(struct cbor_load_frame)) {
+          res = CBOR_LOAD_MAX_DEPTH;
+          break;
+        }
+        struct cbor_load_frame *larger = realloc(heap, 2 * stack_length * sizeof(struct cbor_load_frame));
+        if (larger == NULL) {
+          res = CBOR_LOAD_OUT_OF_MEMORY;
+          break;
+        }
+        if (heap == NULL)
+          memcpy(larger, stack, top * sizeof(struct cbor_load_frame));
+        heap = larger;
+        stack = larger;
+        stack_length *= 2;
       }
-      return;
+      stack[top] = frame;
+      ++top;
     }
-  case CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_TAGGED:
-    {
-      full_load_cbor(elt->cbor_payload.cbor_case_tagged.cbor_tagged_payload);
-      return;
+    while (top > 0 && stack[top - 1].cbor_load_frame_remaining == 0)
+      --top;
+    if (top == 0) {
+      res = CBOR_LOAD_SUCCESS;
+      break;
     }
+    elt = stack[top - 1].cbor_load_frame_next;
+    ++stack[top - 1].cbor_load_frame_next;
+    --stack[top - 1].cbor_load_frame_remaining;
   }
+  free(heap);
+  return res;
+}
+
+/* `stack` holds one frame per level of nesting, so data items nested
+   more than `stack_length` levels deep make it return
+   `CBOR_LOAD_MAX_DEPTH`. Returns `CBOR_LOAD_OUT_OF_MEMORY` if an
+   allocation failed. In both cases, the items that could not be loaded
+   are left serialized. */
+int full_load_cbor_with_stack (struct cbor* elt, struct cbor_arena *arena, struct cbor_load_frame *stack, size_t stack_length) {
+  return full_load_cbor_loop(elt, arena, stack, stack_length, false);
+}
+
+/* Loads data items of any depth: beyond `CBOR_FULL_LOAD_STACK_LENGTH`
+   levels of nesting, the stack grows on the heap. Returns false if an
+   allocation failed (from `arena`, or for the stack), in which case the
+   items that could not be loaded are left serialized. With an arena of
+   `cbor_arena_size_for_full_load(size)` bytes, where `size` is the size
+   of the document, allocations from `arena` never fail. */
+bool full_load_cbor_arena (struct cbor* elt, struct cbor_arena *arena) {
+  struct cbor_load_frame stack[CBOR_FULL_LOAD_STACK_LENGTH];
+  return full_load_cbor_loop(elt, arena, stack, CBOR_FULL_LOAD_STACK_LENGTH, true) == CBOR_LOAD_SUCCESS;
+}
+
+/* Same, from the heap */
+bool full_load_cbor (struct cbor* elt) {
+  return full_load_cbor_arena(elt, NULL);
 }
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <string.h>
+#include "cbor_unverified.c"
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    return 1; \
+  }
+
+/* [1, {"a": h'00'}, 24(-2), [], true] */
+static uint8_t doc[] = {
+  0x85, 0x01, 0xa1, 0x61, 'a', 0x41, 0x00, 0xd8, 0x18, 0x21, 0x80, 0xf5
+};
+
+/* Checks that `c` is `doc`, fully loaded */
+static int check_doc(struct cbor *c)
+{
+  CHECK(c->cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_ARRAY);
+  CHECK(c->cbor_payload.cbor_case_array.cbor_array_count == 5);
+  struct cbor *a = c->cbor_payload.cbor_case_array.cbor_array_payload;
+  CHECK(a[0].cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_UINT64 && a[0].cbor_payload.cbor_case_uint64 == 1);
+  CHECK(a[1].cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_MAP);
+  CHECK(a[1].cbor_payload.cbor_case_map.cbor_map_entry_count == 1);
+  struct cbor_pair *m = a[1].cbor_payload.cbor_case_map.cbor_map_payload;
+  CHECK(m->cbor_pair_key.cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_TEXT_STRING);
+  CHECK(m->cbor_pair_key.cbor_payload.cbor_case_text_string.cbor_string_byte_length == 1);
+  CHECK(m->cbor_pair_key.cbor_payload.cbor_case_text_string.cbor_string_payload[0] == 'a');
+  CHECK(m->cbor_pair_value.cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_BYTE_STRING);
+  CHECK(m->cbor_pair_value.cbor_payload.cbor_case_byte_string.cbor_string_byte_length == 1);
+  CHECK(a[2].cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_TAGGED);
+  CHECK(a[2].cbor_payload.cbor_case_tagged.cbor_tagged_tag == 24);
+  struct cbor *t = a[2].cbor_payload.cbor_case_tagged.cbor_tagged_payload;
+  CHECK(t->cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_NEG_INT64 && t->cbor_payload.cbor_case_neg_int64 == 1);
+  CHECK(a[3].cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_ARRAY);
+  CHECK(a[3].cbor_payload.cbor_case_array.cbor_array_count == 0);
+  CHECK(a[4].cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_SIMPLE_VALUE && a[4].cbor_payload.cbor_case_simple_value == 21);
+  return 0;
+}
+
+static int test_arena(void)
+{
+  printf("Testing: loading into an arena\n");
+  static uint8_t region[1024];
+  size_t size = cbor_arena_size_for_full_load(sizeof(doc));
+  CHECK(size > 0 && size <= sizeof(region));
+  struct cbor_arena arena;
+  cbor_arena_init(&arena, region, size);
+  struct cbor c;
+  preload_cbor_with_size(doc, sizeof(doc), &c);
+  CHECK(full_load_cbor_arena(&c, &arena));
+  if (check_doc(&c))
+    return 1;
+  /* 5 elements, 1 map entry, 1 tag payload */
+  CHECK(arena.cbor_arena_used <= size);
+  CHECK(arena.cbor_arena_used >= 8 * sizeof(struct cbor));
+  cbor_arena_reset(&arena);
+  CHECK(arena.cbor_arena_used == 0);
+  preload_cbor_with_size(doc, sizeof(doc), &c);
+  CHECK(full_load_cbor_arena(&c, &arena));
+  if (check_doc(&c))
+    return 1;
+  CHECK(cbor_arena_size_for_full_load(SIZE_MAX) == 0);
+  return 0;
+}
+
+static int test_arena_exhaustion(void)
+{
+  printf("Testing: arena exhaustion\n");
+  static uint8_t region[1024];
+  struct cbor_arena arena;
+  /* room for 4 of the 5 elements: the array stays serialized */
+  cbor_arena_init(&arena, region, 4 * sizeof(struct cbor) + _Alignof(struct cbor));
+  struct cbor c;
+  preload_cbor_with_size(doc, sizeof(doc), &c);
+  CHECK(!load_cbor_arena(&c, &arena));
+  CHECK(c.cbor_type == CBOR_TYPE_SERIALIZED);
+  CHECK(c.cbor_payload.cbor_case_serialized.cbor_serialized_payload == doc);
+  CHECK(c.cbor_payload.cbor_case_serialized.cbor_serialized_byte_size == sizeof(doc));
+  CHECK(arena.cbor_arena_used == 0);
+  CHECK(!full_load_cbor_arena(&c, &arena));
+  CHECK(c.cbor_type == CBOR_TYPE_SERIALIZED);
+  /* room for the elements, but not for the map entry: the top level is
+     loaded, and the map is left serialized */
+  cbor_arena_init(&arena, region, 6 * sizeof(struct cbor) + _Alignof(struct cbor));
+  CHECK(!full_load_cbor_arena(&c, &arena));
+  CHECK(c.cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_ARRAY);
+  struct cbor *a = c.cbor_payload.cbor_case_array.cbor_array_payload;
+  CHECK(a[0].cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_UINT64);
+  CHECK(a[1].cbor_type == CBOR_TYPE_SERIALIZED);
+  CHECK(a[1].cbor_payload.cbor_case_serialized.cbor_serialized_payload == doc + 2);
+  CHECK(arena.cbor_arena_used <= arena.cbor_arena_size);
+  /* with another arena, loading resumes from there */
+  static uint8_t more[1024];
+  cbor_arena_init(&arena, more, sizeof(more));
+  CHECK(full_load_cbor_arena(&c, &arena));
+  return check_doc(&c);
+}
+
+static int test_heap(void)
+{
+  printf("Testing: loading from the heap\n");
+  struct cbor c;
+  preload_cbor_with_size(doc, sizeof(doc), &c);
+  CHECK(full_load_cbor(&c));
+  if (check_doc(&c))
+    return 1;
+  struct cbor *a = c.cbor_payload.cbor_case_array.cbor_array_payload;
+  free(a[1].cbor_payload.cbor_case_map.cbor_map_payload);
+  free(a[2].cbor_payload.cbor_case_tagged.cbor_tagged_payload);
+  free(a[3].cbor_payload.cbor_case_array.cbor_array_payload);
+  free(a);
+  return 0;
+}
+
+#define DEPTH 5000
+
+static int test_depth(void)
+{
+  printf("Testing: deeply nested data items\n");
+  /* [[[...[1, 2]...], 2], 2] */
+  static uint8_t deep[2 * DEPTH + 1];
+  static uint8_t region[(DEPTH + 1) * 2 * sizeof(struct cbor)];
+  static struct cbor_load_frame stack[16];
+  size_t n = 0;
+  for (size_t i = 0; i < DEPTH; i++)
+    deep[n++] = 0x82;
+  deep[n++] = 0x01;
+  for (size_t i = 0; i < DEPTH; i++)
+    deep[n++] = 0x02;
+  struct cbor c;
+  struct cbor_arena arena;
+  cbor_arena_init(&arena, region, sizeof(region));
+  preload_cbor_with_size(deep, n, &c);
+  CHECK(full_load_cbor_with_stack(&c, &arena, stack, 16) == CBOR_LOAD_MAX_DEPTH);
+  cbor_arena_init(&arena, region, sizeof(region));
+  preload_cbor_with_size(deep, n, &c);
+  CHECK(full_load_cbor_arena(&c, &arena));
+  struct cbor *x = &c;
+  size_t depth = 0;
+  while (x->cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_ARRAY)
+  {
+    CHECK(x->cbor_payload.cbor_case_array.cbor_array_payload[1].cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_UINT64);
+    x = x->cbor_payload.cbor_case_array.cbor_array_payload;
+    depth++;
+  }
+  CHECK(depth == DEPTH);
+  CHECK(x->cbor_type == CBOR_SPEC_CONSTANTS_CBOR_MAJOR_TYPE_UINT64 && x->cbor_payload.cbor_case_uint64 == 1);
+  return 0;
+}
+
+int main(void)
+{
+  if (test_arena())
+    return 1;
+  if (test_arena_exhaustion())
+    return 1;
+  if (test_heap())
+    return 1;
+  if (test_depth())
+    return 1;
+  printf("All tests succeeded!\n");
+  return 0;
+}
@@ -0,0 +1,889 @@
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "CBOR.h"
+#include "CBOR_Unverified.h"
+#include "cbor_unverified_internal.h"
+
+#define INPUT_SIZE (1U << 22)
+
+#define ROUNDS 100U
+
+static uint8_t input[INPUT_SIZE];
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* A map of arrays of small and large integers, short strings and
+   simple values, so that all header sizes are exercised */
+static size_t write_input(void)
+{
+  static cbor elts[16];
+  static cbor_map_entry entries[4096];
+  static uint8_t str[] = "header decoding";
+  for (size_t i = 0; i < 16; i++)
+  {
+    switch (i % 4)
+    {
+      case 0:
+        elts[i] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, (uint64_t)i * 0x1234567ULL);
+        break;
+      case 1:
+        elts[i] = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, i * 37);
+        break;
+      case 2:
+        elts[i] = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, str, i % 15);
+        break;
+      default:
+        elts[i] = cbor_constr_simple_value(i < 8 ? 20 : 200);
+        break;
+    }
+  }
+  for (size_t i = 0; i < 4096; i++)
+    entries[i] =
+      cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i * 1000),
+        cbor_constr_array(elts, 16));
+  size_t len = 0;
+  while (INPUT_SIZE - len > (size_t)1U << 20)
+  {
+    size_t sz = cbor_write(cbor_constr_map(entries, 4096), input + len, INPUT_SIZE - len);
+    if (sz == 0)
+      break;
+    len += sz;
+  }
+  return len;
+}
+
+static int bench_header_decoding(void)
+{
+  size_t len = write_input();
+  size_t items = 0;
+  for (size_t off = 0; off < len; items++)
+  {
+    cbor_read_t r = cbor_read(input + off, len - off);
+    if (!r.cbor_read_is_success)
+    {
+      printf("invalid input\n");
+      return 1;
+    }
+    off = len - r.cbor_read_remainder_length;
+  }
+  printf("Input: %zu bytes, %zu data items\n", len, items);
+  static const char *names[2] = { "cbor_raw_validate", "cbor_read" };
+  for (size_t v = 0; v < 2; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      size_t off = 0;
+      while (off < len)
+      {
+        size_t sz;
+        if (v == 0)
+        {
+          uint32_t err = CBOR_RAW_VALID;
+          sz = cbor_raw_validate(input + off, len - off, &err);
+        }
+        else
+          sz = len - off - cbor_read(input + off, len - off).cbor_read_remainder_length;
+        if (sz == 0)
+        {
+          printf("%s: validation failed\n", names[v]);
+          return 1;
+        }
+        off += sz;
+      }
+      double t = now() - t0;
+      if (round == 0 || t < best)
+        best = t;
+    }
+    printf("%-20s %8.3f ms %8.1f MB/s\n", names[v], best * 1e3, (double)len / best / 1e6);
+  }
+  return 0;
+}
+
+#define TREE_MAPS (1U << 17)
+
+#define TREE_ENTRIES 4U
+
+/* Memory use and traversal time of an array of small maps from
+   integers to integers, as `cbor` and as `cbor_compact` */
+static int bench_compact(void)
+{
+  static cbor maps[TREE_MAPS];
+  static cbor_map_entry entries[TREE_MAPS * TREE_ENTRIES];
+  static cbor_compact storage[TREE_MAPS * (1U + 2U * TREE_ENTRIES)];
+  for (size_t i = 0; i < TREE_MAPS * TREE_ENTRIES; i++)
+    entries[i] =
+      cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i % TREE_ENTRIES),
+        cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i));
+  for (size_t i = 0; i < TREE_MAPS; i++)
+    maps[i] = cbor_constr_map(entries + i * TREE_ENTRIES, TREE_ENTRIES);
+  cbor c = cbor_constr_array(maps, TREE_MAPS);
+  cbor_compact cc;
+  if (!cbor_compact_of_cbor(c, storage, sizeof(storage) / sizeof(storage[0]), &cc))
+  {
+    printf("conversion failed\n");
+    return 1;
+  }
+  printf("Tree: %u maps of %u entries\n", TREE_MAPS, TREE_ENTRIES);
+  printf("%-20s %8zu KB\n", "cbor", (sizeof(maps) + sizeof(entries)) / 1024);
+  printf("%-20s %8zu KB\n", "cbor_compact", sizeof(storage) / 1024);
+  static const char *names[2] = { "cbor traversal", "compact traversal" };
+  uint64_t sums[2] = { 0, 0 };
+  for (size_t v = 0; v < 2; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      uint64_t sum = 0;
+      /* through the fields, as the API functions would after
+         inlining */
+      if (v == 0)
+      {
+        cbor_array a = c.case_CBOR_Case_Array;
+        for (size_t i = 0; i < a.cbor_array_length; i++)
+        {
+          cbor_map m = a.cbor_array_payload[i].case_CBOR_Case_Map;
+          for (size_t j = 0; j < m.cbor_map_length; j++)
+            sum += m.cbor_map_payload[j].cbor_map_entry_value.case_CBOR_Case_Int64.cbor_int_value;
+        }
+      }
+      else
+      {
+        size_t n = cbor_compact_array_length(cc);
+        for (size_t i = 0; i < n; i++)
+        {
+          cbor_compact m = cc.cbor_compact_children[i];
+          size_t k = cbor_compact_map_length(m);
+          cbor_compact *kv = m.cbor_compact_children;
+          for (size_t j = 0; j < k; j++)
+            sum += kv[2 * j + 1].cbor_compact_value;
+        }
+      }
+      double t = now() - t0;
+      if (round == 0 || t < best)
+        best = t;
+      sums[v] = sum;
+    }
+    printf("%-20s %8.3f ms\n", names[v], best * 1e3);
+  }
+  if (sums[0] != sums[1])
+  {
+    printf("traversals disagree\n");
+    return 1;
+  }
+  return 0;
+}
+
+#define WRITE_ARRAYS 4096U
+
+#define WRITE_ELEMENTS 64U
+
+/* Time to encode a map of arrays of integers and short strings: with
+   `cbor_write`, which computes the size before writing, and in a
+   single pass with `cbor_write_with_stack` and `cbor_r2l_write` */
+static int bench_write(void)
+{
+  static cbor elts[WRITE_ELEMENTS];
+  static cbor_map_entry entries[WRITE_ARRAYS];
+  static cbor_traversal_frame stack[4];
+  static uint8_t str[] = "single pass";
+  for (size_t i = 0; i < WRITE_ELEMENTS; i++)
+    elts[i] =
+      i % 2 == 0
+      ? cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, (uint64_t)i * 0x12345ULL)
+      : cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, str, i % 12);
+  for (size_t i = 0; i < WRITE_ARRAYS; i++)
+    entries[i] =
+      cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i),
+        cbor_constr_array(elts, WRITE_ELEMENTS));
+  cbor c = cbor_constr_map(entries, WRITE_ARRAYS);
+  size_t len = 0;
+  if (cbor_encoded_size(c, stack, 4, &len) != CBOR_TRAVERSAL_SUCCESS || len > INPUT_SIZE)
+  {
+    printf("size failed\n");
+    return 1;
+  }
+  printf("Output: %zu bytes\n", len);
+  static const char *names[3] = { "cbor_write", "single pass", "right to left" };
+  for (size_t v = 0; v < 3; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      size_t sz = 0;
+      if (v == 0)
+        sz = cbor_write(c, input, INPUT_SIZE);
+      else if (v == 1)
+      {
+        if (cbor_write_with_stack(c, input, INPUT_SIZE, stack, 4, &sz) != CBOR_TRAVERSAL_SUCCESS)
+          sz = 0;
+      }
+      else
+      {
+        size_t start;
+        if (cbor_r2l_write(c, input, INPUT_SIZE, stack, 4, &start) == CBOR_TRAVERSAL_SUCCESS)
+          sz = INPUT_SIZE - start;
+      }
+      double t = now() - t0;
+      if (sz != len)
+      {
+        printf("%s: write failed\n", names[v]);
+        return 1;
+      }
+      if (round == 0 || t < best)
+        best = t;
+    }
+    printf("%-20s %8.3f ms %8.1f MB/s\n", names[v], best * 1e3, (double)len / best / 1e6);
+  }
+  return 0;
+}
+
+#define CANONICAL_ENTRIES 4096U
+
+/* Time to write a deterministically encoded map with text string and
+   integer keys, given in random order: sorting with
+   `CBOR_Pulse_cbor_map_sort` then writing, and with
+   `cbor_write_canonical_map` */
+static int bench_canonical_map(void)
+{
+  static cbor_map_entry shuffled[CANONICAL_ENTRIES];
+  static cbor_map_entry sorted[CANONICAL_ENTRIES];
+  static cbor_canonical_map_entry entries[CANONICAL_ENTRIES];
+  static uint8_t strs[CANONICAL_ENTRIES][16];
+  static uint8_t keys[CANONICAL_ENTRIES * 32U];
+  static uint8_t out[CANONICAL_ENTRIES * 64U];
+  static cbor_traversal_frame stack[4];
+  uint32_t seed = 1;
+  for (size_t i = 0; i < CANONICAL_ENTRIES; i++)
+  {
+    snprintf((char *)strs[i], sizeof(strs[i]), "field-%zu", i);
+    cbor k =
+      i % 2 == 0
+      ? cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, strs[i], strlen((char *)strs[i]))
+      : cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, (uint64_t)i * 977ULL);
+    shuffled[i] = cbor_mk_map_entry(k, cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i));
+  }
+  for (size_t i = CANONICAL_ENTRIES - 1; i > 0; i--)
+  {
+    seed = seed * 1103515245U + 12345U;
+    size_t j = (seed >> 8) % (i + 1);
+    cbor_map_entry tmp = shuffled[i];
+    shuffled[i] = shuffled[j];
+    shuffled[j] = tmp;
+  }
+  printf("Map: %u entries\n", CANONICAL_ENTRIES);
+  static const char *names[2] = { "sort, then write", "canonical writer" };
+  size_t lens[2] = { 0, 0 };
+  for (size_t v = 0; v < 2; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      size_t sz = 0;
+      if (v == 0)
+      {
+        memcpy(sorted, shuffled, sizeof(sorted));
+        if (CBOR_Pulse_cbor_map_sort(sorted, CANONICAL_ENTRIES))
+          sz = cbor_write(cbor_constr_map(sorted, CANONICAL_ENTRIES), out, sizeof(out));
+      }
+      else if
+      (
+        cbor_write_canonical_map(shuffled, CANONICAL_ENTRIES, out, sizeof(out), keys,
+          sizeof(keys), entries, CANONICAL_ENTRIES, stack, 4, &sz)
+        != CBOR_TRAVERSAL_SUCCESS
+      )
+        sz = 0;
+      double t = now() - t0;
+      if (sz == 0)
+      {
+        printf("%s: write failed\n", names[v]);
+        return 1;
+      }
+      lens[v] = sz;
+      if (round == 0 || t < best)
+        best = t;
+    }
+    printf("%-20s %8.3f ms\n", names[v], best * 1e3);
+  }
+  if (lens[0] != lens[1])
+  {
+    printf("writers disagree\n");
+    return 1;
+  }
+  return 0;
+}
+
+#define PATH_ROWS 4000U
+
+/* Time to reach field 3 of the value of the last key of a serialized
+   map with string keys, whose values are arrays of arrays: with
+   `CBOR_Pulse_cbor_map_get` and `cbor_array_index`, and with
+   `cbor_path_get` */
+static int bench_path(void)
+{
+  static cbor inner[4];
+  static cbor fields[5];
+  static cbor_map_entry entries[PATH_ROWS];
+  static uint8_t strs[PATH_ROWS][24];
+  static uint8_t keybuf[32];
+  for (size_t i = 0; i < 4; i++)
+    inner[i] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i * 1000);
+  for (size_t i = 0; i < 5; i++)
+    fields[i] = cbor_constr_array(inner, 4);
+  for (size_t i = 0; i < PATH_ROWS; i++)
+  {
+    snprintf((char *)strs[i], sizeof(strs[i]), "attribute-%zu", i);
+    entries[i] =
+      cbor_mk_map_entry(cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, strs[i], strlen((char *)strs[i])),
+        cbor_constr_array(fields, 5));
+  }
+  cbor key = entries[PATH_ROWS - 1].cbor_map_entry_key;
+  size_t len = cbor_write(cbor_constr_map(entries, PATH_ROWS), input, INPUT_SIZE);
+  cbor_read_t r = cbor_read(input, len);
+  if (len == 0 || !r.cbor_read_is_success)
+  {
+    printf("invalid input\n");
+    return 1;
+  }
+  cbor_path_step path[2];
+  cbor_path_step_key_of_cbor(key, keybuf, sizeof(keybuf), &path[0]);
+  path[1] = cbor_path_step_index(3);
+  printf("Document: %zu bytes\n", len);
+  static const char *names[2] = { "verified accessors", "path query" };
+  cbor res[2];
+  for (size_t v = 0; v < 2; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      if (v == 0)
+      {
+        cbor c = CBOR_Pulse_cbor_map_get(key, r.cbor_read_payload)._0;
+        res[v] = cbor_array_index(c, 3);
+      }
+      else if (!cbor_path_get(r.cbor_read_payload, path, 2, &res[v]))
+      {
+        printf("path query failed\n");
+        return 1;
+      }
+      double t = now() - t0;
+      if (round == 0 || t < best)
+        best = t;
+    }
+    printf("%-20s %8.3f ms\n", names[v], best * 1e3);
+  }
+  if (!CBOR_Pulse_cbor_is_equal(res[0], res[1]))
+  {
+    printf("queries disagree\n");
+    return 1;
+  }
+  return 0;
+}
+
+#define CDDL_MESSAGES 20000U
+
+/* COSE_Sign1 (see test_cddl), checked with the verified accessors, as
+   the closures of CDDL.Pulse do: the header map is
+   { ? 1 => int, * (uint / tstr) => any } */
+static bool handle_is_int(cbor c)
+{
+  uint8_t ty = cbor_get_major_type(c);
+  return ty == CBOR_MAJOR_TYPE_UINT64 || ty == CBOR_MAJOR_TYPE_NEG_INT64;
+}
+
+static bool handle_header_map(cbor c)
+{
+  if (cbor_get_major_type(c) != CBOR_MAJOR_TYPE_MAP)
+    return false;
+  cbor one = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1);
+  CBOR_Pulse_cbor_map_get_t alg = CBOR_Pulse_cbor_map_get(one, c);
+  bool has_alg = alg.tag == CBOR_Pulse_Found && handle_is_int(alg._0);
+  cbor_map_iterator_t it = cbor_map_iterator_init(c);
+  while (!cbor_map_iterator_is_done(it))
+  {
+    cbor key = cbor_map_entry_key(cbor_map_iterator_next(&it));
+    uint8_t ty = cbor_get_major_type(key);
+    if (!(has_alg && CBOR_Pulse_cbor_is_equal(key, one)) && ty != CBOR_MAJOR_TYPE_UINT64 && ty != CBOR_MAJOR_TYPE_TEXT_STRING)
+      return false;
+  }
+  return true;
+}
+
+static bool handle_sign1(cbor c)
+{
+  if (cbor_get_major_type(c) != CBOR_MAJOR_TYPE_TAGGED)
+    return false;
+  cbor_tagged tg = cbor_destr_tagged(c);
+  if (tg.cbor_tagged_tag != 18 || cbor_get_major_type(tg.cbor_tagged_payload) != CBOR_MAJOR_TYPE_ARRAY)
+    return false;
+  cbor a = tg.cbor_tagged_payload;
+  if (cbor_array_length(a) != 4)
+    return false;
+  cbor_array_iterator_t it = cbor_array_iterator_init(a);
+  cbor prot = cbor_array_iterator_next(&it);
+  cbor unprot = cbor_array_iterator_next(&it);
+  cbor payload = cbor_array_iterator_next(&it);
+  cbor sig = cbor_array_iterator_next(&it);
+  uint8_t ty = cbor_get_major_type(payload);
+  return
+    cbor_get_major_type(prot) == CBOR_MAJOR_TYPE_BYTE_STRING
+    && handle_header_map(unprot)
+    && (ty == CBOR_MAJOR_TYPE_BYTE_STRING
+      || (ty == CBOR_MAJOR_TYPE_SIMPLE_VALUE && cbor_destr_simple_value(payload) == 22))
+    && cbor_get_major_type(sig) == CBOR_MAJOR_TYPE_BYTE_STRING;
+}
+
+static bool handle_sign1_array(cbor c)
+{
+  if (cbor_get_major_type(c) != CBOR_MAJOR_TYPE_ARRAY)
+    return false;
+  cbor_array_iterator_t it = cbor_array_iterator_init(c);
+  while (!cbor_array_iterator_is_done(it))
+    if (!handle_sign1(cbor_array_iterator_next(&it)))
+      return false;
+  return true;
+}
+
+/* Writes an array of `CDDL_MESSAGES` COSE_Sign1 messages into `input`,
+   and returns its size */
+static size_t write_sign1_messages(void)
+{
+  static uint8_t payload[64];
+  static uint8_t kid[] = "key-identifier";
+  static cbor msg[CDDL_MESSAGES];
+  static cbor fields[4];
+  static cbor_map_entry headers[4];
+  memset(payload, 0x5a, sizeof(payload));
+  headers[0] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1), cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, 6));
+  headers[1] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 4), cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, kid, 14));
+  headers[2] = cbor_mk_map_entry(cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, kid, 3), cbor_constr_simple_value(21));
+  headers[3] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 33), cbor_constr_array(fields, 0));
+  fields[0] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, payload, 4);
+  fields[1] = cbor_constr_map(headers, 4);
+  fields[2] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, payload, 32);
+  fields[3] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, payload, 64);
+  cbor arr = cbor_constr_array(fields, 4);
+  for (size_t i = 0; i < CDDL_MESSAGES; i++)
+    msg[i] = cbor_constr_tagged(18, &arr);
+  return cbor_write(cbor_constr_array(msg, CDDL_MESSAGES), input, INPUT_SIZE);
+}
+
+/* Time to validate an array of COSE_Sign1 messages against their
+   schema, with the verified accessors and with a compiled program */
+static int bench_cddl(void)
+{
+  static uint8_t scratch[4096];
+  static cddl_insn insns[64];
+  static uint8_t literals[16];
+  size_t len = write_sign1_messages();
+  cbor_read_t r = cbor_read(input, len);
+  if (len == 0 || !r.cbor_read_is_success)
+  {
+    printf("invalid input\n");
+    return 1;
+  }
+  cddl_program p;
+  cddl_program_init(&p, insns, 64, literals, sizeof(literals), NULL, 0);
+  uint32_t tint = cddl_tchoice(&p, cddl_telem(&p, CDDL_ELEM_UINT), cddl_telem(&p, CDDL_ELEM_NINT));
+  uint32_t label = cddl_tchoice(&p, cddl_telem(&p, CDDL_ELEM_UINT), cddl_telem(&p, CDDL_ELEM_TEXT_STRING));
+  uint32_t alg = cddl_gmap_elem(&p, false, cddl_tliteral_int(&p, CBOR_MAJOR_TYPE_UINT64, 1), tint);
+  uint32_t rest = cddl_gzero_or_more(&p, cddl_gmap_elem(&p, false, label, cddl_telem(&p, CDDL_ELEM_ANY)));
+  uint32_t header_map = cddl_tmap(&p, cddl_gconcat(&p, cddl_gzero_or_one(&p, alg), rest));
+  uint32_t bstr = cddl_telem(&p, CDDL_ELEM_BYTE_STRING);
+  uint32_t nil_payload = cddl_tchoice(&p, bstr, cddl_tliteral_simple(&p, 22));
+  uint32_t g =
+    cddl_gconcat(&p, cddl_garray_elem(&p, bstr),
+      cddl_gconcat(&p, cddl_garray_elem(&p, header_map),
+        cddl_gconcat(&p, cddl_garray_elem(&p, nil_payload), cddl_garray_elem(&p, bstr))));
+  uint32_t sign1 = cddl_ttagged(&p, 18, cddl_tarray(&p, g));
+  uint32_t t = cddl_tarray(&p, cddl_gzero_or_more(&p, cddl_garray_elem(&p, sign1)));
+  if (t == CDDL_NONE)
+  {
+    printf("compilation failed\n");
+    return 1;
+  }
+  printf("Messages: %zu bytes\n", len);
+  static const char *names[2] = { "verified accessors", "compiled CDDL" };
+  for (size_t v = 0; v < 2; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      bool ok =
+        v == 0
+          ? handle_sign1_array(r.cbor_read_payload)
+          : cddl_validate(&p, t, r.cbor_read_payload, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID;
+      double dt = now() - t0;
+      if (!ok)
+      {
+        printf("%s: validation failed\n", names[v]);
+        return 1;
+      }
+      if (round == 0 || dt < best)
+        best = dt;
+    }
+    printf("%-20s %8.3f ms\n", names[v], best * 1e3);
+  }
+  return 0;
+}
+
+#define CHOICE_ALTERNATIVES 16U
+
+/* Time to validate an array of messages against a union of
+   `CHOICE_ALTERNATIVES` message kinds, #6.k([uint, bstr]), when all
+   messages are of the last kind */
+static int bench_cddl_choice(void)
+{
+  static uint8_t payload[16];
+  static cbor msg[CDDL_MESSAGES];
+  static cbor fields[2];
+  static uint8_t scratch[4096];
+  static cddl_insn insns[128];
+  fields[0] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1234);
+  fields[1] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, payload, sizeof(payload));
+  cbor arr = cbor_constr_array(fields, 2);
+  for (size_t i = 0; i < CDDL_MESSAGES; i++)
+    msg[i] = cbor_constr_tagged(CHOICE_ALTERNATIVES, &arr);
+  size_t len = cbor_write(cbor_constr_array(msg, CDDL_MESSAGES), input, INPUT_SIZE);
+  cbor_read_t r = cbor_read(input, len);
+  if (len == 0 || !r.cbor_read_is_success)
+  {
+    printf("invalid input\n");
+    return 1;
+  }
+  cddl_program p;
+  cddl_program_init(&p, insns, 128, NULL, 0, NULL, 0);
+  uint32_t body =
+    cddl_tarray(&p,
+      cddl_gconcat(&p, cddl_garray_elem(&p, cddl_telem(&p, CDDL_ELEM_UINT)),
+        cddl_garray_elem(&p, cddl_telem(&p, CDDL_ELEM_BYTE_STRING))));
+  uint32_t u = cddl_ttagged(&p, CHOICE_ALTERNATIVES, body);
+  for (uint64_t k = CHOICE_ALTERNATIVES - 1; k > 0; k--)
+    u = cddl_tchoice(&p, cddl_ttagged(&p, k, body), u);
+  uint32_t t = cddl_tarray(&p, cddl_gzero_or_more(&p, cddl_garray_elem(&p, u)));
+  if (t == CDDL_NONE)
+  {
+    printf("compilation failed\n");
+    return 1;
+  }
+  printf("Messages: %zu bytes, %u kinds\n", len, CHOICE_ALTERNATIVES);
+  double best = 0.0;
+  for (size_t round = 0; round < ROUNDS; round++)
+  {
+    double t0 = now();
+    bool ok = cddl_validate(&p, t, r.cbor_read_payload, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID;
+    double dt = now() - t0;
+    if (!ok)
+    {
+      printf("validation failed\n");
+      return 1;
+    }
+    if (round == 0 || dt < best)
+      best = dt;
+  }
+  printf("%-20s %8.3f ms\n", "compiled CDDL", best * 1e3);
+  return 0;
+}
+
+#define RECORD_KEYS 24U
+
+/* Time to validate an array of records, maps with `RECORD_KEYS`
+   entries in no particular order, against
+   { ? 1 => uint, ..., ? RECORD_KEYS => uint } */
+static int bench_cddl_map(void)
+{
+  static cbor msg[CDDL_MESSAGES];
+  static cbor_map_entry entries[RECORD_KEYS];
+  static uint8_t scratch[4096];
+  static cddl_insn insns[128];
+  static uint8_t literals[64];
+  for (size_t k = 0; k < RECORD_KEYS; k++)
+  {
+    /* 7 is coprime with RECORD_KEYS */
+    uint64_t key = (k * 7U) % RECORD_KEYS + 1;
+    entries[k] =
+      cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, key), cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, k * 1000));
+  }
+  for (size_t i = 0; i < CDDL_MESSAGES; i++)
+    msg[i] = cbor_constr_map(entries, RECORD_KEYS);
+  size_t len = cbor_write(cbor_constr_array(msg, CDDL_MESSAGES), input, INPUT_SIZE);
+  cbor_read_t r = cbor_read(input, len);
+  if (len == 0 || !r.cbor_read_is_success)
+  {
+    printf("invalid input\n");
+    return 1;
+  }
+  cddl_program p;
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), NULL, 0);
+  uint32_t uint = cddl_telem(&p, CDDL_ELEM_UINT);
+  uint32_t g = cddl_gnop(&p);
+  for (uint64_t k = RECORD_KEYS; k > 0; k--)
+    g = cddl_gconcat(&p, cddl_gzero_or_one(&p, cddl_gmap_elem(&p, false, cddl_tliteral_int(&p, CBOR_MAJOR_TYPE_UINT64, k), uint)), g);
+  uint32_t t = cddl_tarray(&p, cddl_gzero_or_more(&p, cddl_garray_elem(&p, cddl_tmap(&p, g))));
+  if (t == CDDL_NONE)
+  {
+    printf("compilation failed\n");
+    return 1;
+  }
+  printf("Records: %zu bytes, %u keys\n", len, RECORD_KEYS);
+  double best = 0.0;
+  for (size_t round = 0; round < ROUNDS; round++)
+  {
+    double t0 = now();
+    bool ok = cddl_validate(&p, t, r.cbor_read_payload, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID;
+    double dt = now() - t0;
+    if (!ok)
+    {
+      printf("validation failed\n");
+      return 1;
+    }
+    if (round == 0 || dt < best)
+      best = dt;
+  }
+  printf("%-20s %8.3f ms\n", "compiled CDDL", best * 1e3);
+  return 0;
+}
+
+/* COSE_Sign1 fields, as decoded by `cddl_decode` */
+typedef struct decoded_sign1_s
+{
+  cbor_string protected;
+  uint32_t has_alg;
+  cbor_int alg;
+  uint32_t payload_case;
+  cbor_string payload;
+  cbor_string signature;
+}
+decoded_sign1;
+
+/* The same fields, with the verified accessors once `c` is valid */
+static void handle_decode_sign1(cbor c, decoded_sign1 *d)
+{
+  cbor_array_iterator_t it = cbor_array_iterator_init(cbor_destr_tagged(c).cbor_tagged_payload);
+  d->protected = cbor_destr_string(cbor_array_iterator_next(&it));
+  CBOR_Pulse_cbor_map_get_t alg =
+    CBOR_Pulse_cbor_map_get(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1), cbor_array_iterator_next(&it));
+  d->has_alg = alg.tag == CBOR_Pulse_Found;
+  if (d->has_alg)
+    d->alg = cbor_destr_int64(alg._0);
+  cbor payload = cbor_array_iterator_next(&it);
+  d->payload_case = cbor_get_major_type(payload) == CBOR_MAJOR_TYPE_BYTE_STRING ? 1 : 2;
+  if (d->payload_case == 1)
+    d->payload = cbor_destr_string(payload);
+  d->signature = cbor_destr_string(cbor_array_iterator_next(&it));
+}
+
+/* [* COSE_Sign1], decoded into records of `decoded_sign1` */
+static uint32_t compile_decoded_sign1s(cddl_program *p)
+{
+  uint32_t tint = cddl_tchoice(p, cddl_telem(p, CDDL_ELEM_UINT), cddl_telem(p, CDDL_ELEM_NINT));
+  uint32_t label = cddl_tchoice(p, cddl_telem(p, CDDL_ELEM_UINT), cddl_telem(p, CDDL_ELEM_TEXT_STRING));
+  uint32_t alg =
+    cddl_gmap_elem(p, false, cddl_tliteral_int(p, CBOR_MAJOR_TYPE_UINT64, 1),
+      cddl_tcase(p, cddl_tstore(p, tint, CDDL_FIELD_INT, offsetof(decoded_sign1, alg)), offsetof(decoded_sign1, has_alg), 1));
+  uint32_t rest = cddl_gzero_or_more(p, cddl_gmap_elem(p, false, label, cddl_telem(p, CDDL_ELEM_ANY)));
+  uint32_t header_map = cddl_tmap(p, cddl_gconcat(p, cddl_gzero_or_one(p, alg), rest));
+  uint32_t bstr = cddl_telem(p, CDDL_ELEM_BYTE_STRING);
+  uint32_t payload =
+    cddl_tchoice(p,
+      cddl_tcase(p, cddl_tstore(p, bstr, CDDL_FIELD_STRING, offsetof(decoded_sign1, payload)), offsetof(decoded_sign1, payload_case), 1),
+      cddl_tcase(p, cddl_tliteral_simple(p, 22), offsetof(decoded_sign1, payload_case), 2));
+  uint32_t g =
+    cddl_gconcat(p, cddl_garray_elem(p, cddl_tstore(p, bstr, CDDL_FIELD_STRING, offsetof(decoded_sign1, protected))),
+      cddl_gconcat(p, cddl_garray_elem(p, header_map),
+        cddl_gconcat(p, cddl_garray_elem(p, payload),
+          cddl_garray_elem(p, cddl_tstore(p, bstr, CDDL_FIELD_STRING, offsetof(decoded_sign1, signature))))));
+  uint32_t sign1 = cddl_ttagged(p, 18, cddl_tarray(p, g));
+  return
+    cddl_tarray(p, cddl_gstore_each(p, cddl_gzero_or_more(p, cddl_garray_elem(p, sign1)), 0, sizeof(decoded_sign1)));
+}
+
+/* Time to validate the messages of `bench_cddl` and read their fields
+   into structs, with the verified accessors and with `cddl_decode` */
+static int bench_cddl_decode(void)
+{
+  static decoded_sign1 decoded[CDDL_MESSAGES];
+  /* `CDDL_MESSAGES + 1` records, plus alignment */
+  static uint8_t storage[(CDDL_MESSAGES + 2U) * sizeof(decoded_sign1)];
+  static uint8_t scratch[4096];
+  static cddl_insn insns[64];
+  static uint8_t literals[16];
+  size_t len = write_sign1_messages();
+  cbor_read_t r = cbor_read(input, len);
+  if (len == 0 || !r.cbor_read_is_success)
+  {
+    printf("invalid input\n");
+    return 1;
+  }
+  cddl_program p;
+  cddl_program_init(&p, insns, 64, literals, sizeof(literals), NULL, 0);
+  uint32_t t = compile_decoded_sign1s(&p);
+  if (t == CDDL_NONE)
+  {
+    printf("compilation failed\n");
+    return 1;
+  }
+  static const char *names[2] = { "verified accessors", "cddl_decode" };
+  for (size_t v = 0; v < 2; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      decoded_sign1 *d = decoded;
+      bool ok;
+      if (v == 0)
+      {
+        ok = handle_sign1_array(r.cbor_read_payload);
+        cbor_array_iterator_t it = cbor_array_iterator_init(r.cbor_read_payload);
+        for (size_t i = 0; ok && i < CDDL_MESSAGES; i++)
+          handle_decode_sign1(cbor_array_iterator_next(&it), decoded + i);
+      }
+      else
+      {
+        cddl_records res;
+        ok =
+          cddl_decode(&p, t, r.cbor_read_payload, (uint8_t *)&res, sizeof(res), storage, sizeof(storage), scratch, sizeof(scratch))
+            == CDDL_VALIDATE_VALID
+          && res.cddl_records_length == CDDL_MESSAGES;
+        d = (decoded_sign1 *)res.cddl_records_payload;
+      }
+      double dt = now() - t0;
+      if (!ok || d[CDDL_MESSAGES - 1].signature.cbor_string_length != 64)
+      {
+        printf("%s: decoding failed\n", names[v]);
+        return 1;
+      }
+      if (round == 0 || dt < best)
+        best = dt;
+    }
+    printf("%-20s %8.3f ms\n", names[v], best * 1e3);
+  }
+  return 0;
+}
+
+/* Time to write `CDDL_MESSAGES` COSE_Sign1 messages given as structs:
+   by building `cbor` objects for `cbor_write`, with `cddl_encode` into
+   a buffer large enough, and with `cddl_encoded_size` first */
+static int bench_cddl_encode(void)
+{
+  static uint8_t payload[64];
+  static decoded_sign1 decoded[CDDL_MESSAGES];
+  static cbor msg[CDDL_MESSAGES];
+  static cbor fields[CDDL_MESSAGES][4];
+  static cbor arrays[CDDL_MESSAGES];
+  static cbor_map_entry headers[CDDL_MESSAGES];
+  static cddl_insn insns[64];
+  static uint8_t literals[16];
+  memset(payload, 0x5a, sizeof(payload));
+  for (size_t i = 0; i < CDDL_MESSAGES; i++)
+  {
+    decoded_sign1 *d = decoded + i;
+    d->protected = (cbor_string){ .cbor_string_type = CBOR_MAJOR_TYPE_BYTE_STRING, .cbor_string_length = 4, .cbor_string_payload = payload };
+    d->has_alg = 1;
+    d->alg = (cbor_int){ .cbor_int_type = CBOR_MAJOR_TYPE_NEG_INT64, .cbor_int_value = i % 64 };
+    d->payload_case = 1;
+    d->payload = (cbor_string){ .cbor_string_type = CBOR_MAJOR_TYPE_BYTE_STRING, .cbor_string_length = 32, .cbor_string_payload = payload };
+    d->signature = (cbor_string){ .cbor_string_type = CBOR_MAJOR_TYPE_BYTE_STRING, .cbor_string_length = 64, .cbor_string_payload = payload };
+  }
+  cddl_program p;
+  cddl_program_init(&p, insns, 64, literals, sizeof(literals), NULL, 0);
+  uint32_t t = compile_decoded_sign1s(&p);
+  if (t == CDDL_NONE)
+  {
+    printf("compilation failed\n");
+    return 1;
+  }
+  cddl_records records = { .cddl_records_payload = (uint8_t *)decoded, .cddl_records_length = CDDL_MESSAGES };
+  static const char *names[3] = { "cbor_write of trees", "cddl_encode", "exact size + encode" };
+  size_t lens[3];
+  for (size_t v = 0; v < 3; v++)
+  {
+    double best = 0.0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+      double t0 = now();
+      size_t len = 0;
+      if (v == 0)
+      {
+        for (size_t i = 0; i < CDDL_MESSAGES; i++)
+        {
+          decoded_sign1 *d = decoded + i;
+          headers[i] =
+            cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1), cbor_constr_int64(d->alg.cbor_int_type, d->alg.cbor_int_value));
+          fields[i][0] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, d->protected.cbor_string_payload, d->protected.cbor_string_length);
+          fields[i][1] = cbor_constr_map(headers + i, 1);
+          fields[i][2] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, d->payload.cbor_string_payload, d->payload.cbor_string_length);
+          fields[i][3] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, d->signature.cbor_string_payload, d->signature.cbor_string_length);
+          arrays[i] = cbor_constr_array(fields[i], 4);
+          msg[i] = cbor_constr_tagged(18, arrays + i);
+        }
+        len = cbor_write(cbor_constr_array(msg, CDDL_MESSAGES), input, INPUT_SIZE);
+      }
+      else
+      {
+        size_t sz = INPUT_SIZE;
+        if
+        (
+          (v == 2 && cddl_encoded_size(&p, t, (uint8_t *)&records, &sz) != CDDL_VALIDATE_VALID)
+          || cddl_encode(&p, t, (uint8_t *)&records, input, sz, &len) != CDDL_VALIDATE_VALID
+        )
+          len = 0;
+      }
+      double dt = now() - t0;
+      if (len == 0)
+      {
+        printf("%s: encoding failed\n", names[v]);
+        return 1;
+      }
+      lens[v] = len;
+      if (round == 0 || dt < best)
+        best = dt;
+    }
+    printf("%-20s %8.3f ms\n", names[v], best * 1e3);
+  }
+  if (lens[0] != lens[1] || lens[0] != lens[2])
+  {
+    printf("different encodings\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(void)
+{
+  if (bench_header_decoding())
+    return 1;
+  if (bench_compact())
+    return 1;
+  if (bench_write())
+    return 1;
+  if (bench_canonical_map())
+    return 1;
+  if (bench_path())
+    return 1;
+  if (bench_cddl())
+    return 1;
+  if (bench_cddl_choice())
+    return 1;
+  if (bench_cddl_map())
+    return 1;
+  if (bench_cddl_decode())
+    return 1;
+  if (bench_cddl_encode())
+    return 1;
+  return 0;
+}
@@ -0,0 +1,100 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/* Bytewise lexicographic comparison, with the specification of the
+   verified loop `CBOR_Pulse_byte_array_compare`, against which it is
+   tested. */
+
+#include "cbor_unverified_internal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CBOR_BYTES_COMPARE_X86
+#endif
+
+/* Index of the first byte where `a1` and `a2` differ, or `n` if the
+   first `n` bytes are the same, starting from `i`, which is either `n`
+   or a byte where they do not differ. */
+static size_t first_difference_from(uint8_t *a1, uint8_t *a2, size_t n, size_t i)
+{
+#if defined(CBOR_BYTES_COMPARE_X86) && defined(__SSE2__)
+  for (; i + (size_t)16U <= n; i += (size_t)16U)
+  {
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(a1 + i));
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(a2 + i));
+    uint32_t diff = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x1, x2)) & 0xFFFFU;
+    if (diff != 0U)
+      return i + (size_t)__builtin_ctz(diff);
+  }
+#endif
+  /* Portable fallback, and tail of the vector loops: skip equal 64-bit
+     words, then find the differing byte. */
+  for (; i + (size_t)8U <= n; i += (size_t)8U)
+  {
+    uint64_t x1;
+    uint64_t x2;
+    memcpy(&x1, a1 + i, sizeof(x1));
+    memcpy(&x2, a2 + i, sizeof(x2));
+    if (x1 != x2)
+      break;
+  }
+  for (; i < n; i++)
+    if (a1[i] != a2[i])
+      return i;
+  return n;
+}
+
+#ifdef CBOR_BYTES_COMPARE_X86
+/* Compiled for AVX2 whatever the flags of the build, and only called
+   if the processor supports it */
+__attribute__((target("avx2")))
+static size_t first_difference_avx2(uint8_t *a1, uint8_t *a2, size_t n)
+{
+  size_t i = (size_t)0U;
+  for (; i + (size_t)32U <= n; i += (size_t)32U)
+  {
+    __m256i x1 = _mm256_loadu_si256((const __m256i *)(a1 + i));
+    __m256i x2 = _mm256_loadu_si256((const __m256i *)(a2 + i));
+    uint32_t diff = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x1, x2));
+    if (diff != 0U)
+      return i + (size_t)__builtin_ctz(diff);
+  }
+  return first_difference_from(a1, a2, n, i);
+}
+#endif
+
+static size_t first_difference(uint8_t *a1, uint8_t *a2, size_t n)
+{
+#ifdef CBOR_BYTES_COMPARE_X86
+  if (n >= (size_t)32U && __builtin_cpu_supports("avx2"))
+    return first_difference_avx2(a1, a2, n);
+#endif
+  return first_difference_from(a1, a2, n, (size_t)0U);
+}
+
+int16_t cbor_bytes_lex_compare(size_t n1, uint8_t *a1, size_t n2, uint8_t *a2)
+{
+  size_t n = n1 < n2 ? n1 : n2;
+  size_t i = first_difference(a1, a2, n);
+  if (i < n)
+    return a1[i] < a2[i] ? (int16_t)-1 : (int16_t)1;
+  else if (n1 < n2)
+    return (int16_t)-1;
+  else if (n2 < n1)
+    return (int16_t)1;
+  else
+    return (int16_t)0;
+}
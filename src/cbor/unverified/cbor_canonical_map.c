@@ -0,0 +1,132 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+bool
+cbor_canonical_map_init(
+  cbor map,
+  size_t *offsets,
+  size_t offsets_length,
+  cbor_canonical_map *res
+)
+{
+  if (map.tag != CBOR_Case_Serialized || cbor_get_major_type(map) != CBOR_MAJOR_TYPE_MAP)
+    return false;
+  uint64_t len = cbor_map_length(map);
+  if ((uint64_t)offsets_length <= len + len)
+    return false;
+  cbor_map_iterator_t it = cbor_map_iterator_init(map);
+  uint8_t *base = it.cbor_map_iterator_payload.case_CBOR_Map_Iterator_Payload_Serialized;
+  size_t n = (size_t)0U;
+  size_t off = (size_t)0U;
+  while (!cbor_map_iterator_is_done(it))
+  {
+    cbor_map_entry x = cbor_map_iterator_next(&it);
+    offsets[n] = off;
+    off += x.cbor_map_entry_key.case_CBOR_Case_Serialized.cbor_serialized_size;
+    offsets[n + (size_t)1U] = off;
+    off += x.cbor_map_entry_value.case_CBOR_Case_Serialized.cbor_serialized_size;
+    n += (size_t)2U;
+  }
+  offsets[n] = off;
+  res->cbor_canonical_map_base = base;
+  res->cbor_canonical_map_length = len;
+  res->cbor_canonical_map_offsets = offsets;
+  return true;
+}
+
+static cbor cbor_canonical_map_slice(cbor_canonical_map *m, size_t j)
+{
+  size_t *offsets = m->cbor_canonical_map_offsets;
+  return
+    (
+      (cbor){
+        .tag = CBOR_Case_Serialized,
+        {
+          .case_CBOR_Case_Serialized = {
+            .cbor_serialized_size = offsets[j + (size_t)1U] - offsets[j],
+            .cbor_serialized_payload = m->cbor_canonical_map_base + offsets[j]
+          }
+        }
+      }
+    );
+}
+
+CBOR_Pulse_cbor_map_get_t
+cbor_canonical_map_get_encoded(cbor_canonical_map *m, uint8_t *key, size_t key_size)
+{
+  size_t *offsets = m->cbor_canonical_map_offsets;
+  size_t lo = (size_t)0U;
+  size_t hi = (size_t)m->cbor_canonical_map_length;
+  while (lo < hi)
+  {
+    size_t mi = lo + (hi - lo) / (size_t)2U;
+    size_t j = mi + mi;
+    int16_t c =
+      cbor_bytes_lex_compare(key_size,
+        key,
+        offsets[j + (size_t)1U] - offsets[j],
+        m->cbor_canonical_map_base + offsets[j]);
+    if (c == (int16_t)0)
+      return
+        (
+          (CBOR_Pulse_cbor_map_get_t){
+            .tag = CBOR_Pulse_Found,
+            ._0 = cbor_canonical_map_slice(m, j + (size_t)1U)
+          }
+        );
+    else if (c < (int16_t)0)
+      hi = mi;
+    else
+      lo = mi + (size_t)1U;
+  }
+  return ((CBOR_Pulse_cbor_map_get_t){ .tag = CBOR_Pulse_NotFound });
+}
+
+/* For keys that are not serialized, the verified `CBOR_Pulse_cbor_compare`
+   coincides with the bytewise order of the encodings (this is
+   `CBOR.Spec.cbor_compare_correct`), so there is no need to serialize
+   the key first. */
+CBOR_Pulse_cbor_map_get_t cbor_canonical_map_get(cbor_canonical_map *m, cbor key)
+{
+  if (key.tag == CBOR_Case_Serialized)
+    return
+      cbor_canonical_map_get_encoded(m,
+        key.case_CBOR_Case_Serialized.cbor_serialized_payload,
+        key.case_CBOR_Case_Serialized.cbor_serialized_size);
+  size_t lo = (size_t)0U;
+  size_t hi = (size_t)m->cbor_canonical_map_length;
+  while (lo < hi)
+  {
+    size_t mi = lo + (hi - lo) / (size_t)2U;
+    size_t j = mi + mi;
+    int16_t c = CBOR_Pulse_cbor_compare(key, cbor_canonical_map_slice(m, j));
+    if (c == (int16_t)0)
+      return
+        (
+          (CBOR_Pulse_cbor_map_get_t){
+            .tag = CBOR_Pulse_Found,
+            ._0 = cbor_canonical_map_slice(m, j + (size_t)1U)
+          }
+        );
+    else if (c < (int16_t)0)
+      hi = mi;
+    else
+      lo = mi + (size_t)1U;
+  }
+  return ((CBOR_Pulse_cbor_map_get_t){ .tag = CBOR_Pulse_NotFound });
+}
@@ -0,0 +1,104 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdlib.h>
+#include "cbor_unverified_internal.h"
+
+/* Bytewise lexicographic order of the encodings, first on their cached
+   8-byte big-endian prefixes (padded with zeros), then on the whole
+   encodings if the prefixes are equal. */
+static int canonical_entry_compare(const void *p1, const void *p2)
+{
+  const cbor_canonical_map_entry *e1 = p1;
+  const cbor_canonical_map_entry *e2 = p2;
+  if (e1->cbor_canonical_map_entry_prefix != e2->cbor_canonical_map_entry_prefix)
+    return e1->cbor_canonical_map_entry_prefix < e2->cbor_canonical_map_entry_prefix ? -1 : 1;
+  size_t n1 = e1->cbor_canonical_map_entry_key_size;
+  size_t n2 = e2->cbor_canonical_map_entry_key_size;
+  int c = memcmp(e1->cbor_canonical_map_entry_key, e2->cbor_canonical_map_entry_key, n1 < n2 ? n1 : n2);
+  if (c != 0)
+    return c;
+  return n1 == n2 ? 0 : n1 < n2 ? -1 : 1;
+}
+
+static uint64_t canonical_prefix(uint8_t *key, size_t key_size)
+{
+  uint64_t prefix = 0ULL;
+  for (size_t i = (size_t)0U; i < (size_t)8U; i++)
+    prefix = prefix << 8U | (i < key_size ? (uint64_t)key[i] : 0ULL);
+  return prefix;
+}
+
+cbor_traversal_status
+cbor_write_canonical_map(
+  cbor_map_entry *a,
+  size_t len,
+  uint8_t *out,
+  size_t sz,
+  uint8_t *keys,
+  size_t keys_length,
+  cbor_canonical_map_entry *entries,
+  size_t entries_length,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+)
+{
+  if (entries_length < len)
+    return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+  /* encode the keys once */
+  size_t kpos = (size_t)0U;
+  for (size_t i = (size_t)0U; i < len; i++)
+  {
+    size_t n;
+    cbor_traversal_status st =
+      cbor_write_with_stack(a[i].cbor_map_entry_key, keys + kpos, keys_length - kpos, stack,
+        stack_length, &n);
+    if (st != CBOR_TRAVERSAL_SUCCESS)
+      return st;
+    entries[i].cbor_canonical_map_entry_prefix = canonical_prefix(keys + kpos, n);
+    entries[i].cbor_canonical_map_entry_key = keys + kpos;
+    entries[i].cbor_canonical_map_entry_key_size = n;
+    entries[i].cbor_canonical_map_entry_value = a[i].cbor_map_entry_value;
+    kpos += n;
+  }
+  if (len > (size_t)1U)
+    qsort(entries, len, sizeof(cbor_canonical_map_entry), canonical_entry_compare);
+  /* write the map */
+  size_t pos = cbor_raw_header_size((uint64_t)len);
+  if (pos > sz)
+    return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+  cbor_raw_header_write(CBOR_MAJOR_TYPE_MAP, (uint64_t)len, out);
+  for (size_t i = (size_t)0U; i < len; i++)
+  {
+    cbor_canonical_map_entry *e = &entries[i];
+    if (i > (size_t)0U && canonical_entry_compare(&entries[i - (size_t)1U], e) == 0)
+      return CBOR_CANONICAL_MAP_DUPLICATE_KEY;
+    size_t n = e->cbor_canonical_map_entry_key_size;
+    if (n > sz - pos)
+      return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+    memcpy(out + pos, e->cbor_canonical_map_entry_key, n);
+    pos += n;
+    cbor_traversal_status st =
+      cbor_write_with_stack(e->cbor_canonical_map_entry_value, out + pos, sz - pos, stack,
+        stack_length, &n);
+    if (st != CBOR_TRAVERSAL_SUCCESS)
+      return st;
+    pos += n;
+  }
+  *res = pos;
+  return CBOR_TRAVERSAL_SUCCESS;
+}
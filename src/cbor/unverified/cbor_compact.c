@@ -0,0 +1,567 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+#define COMPACT_TYPE_SHIFT (3U)
+
+#define COMPACT_ARGUMENT_SHIFT (8U)
+
+static cbor_compact compact_mk(uint8_t tag, uint8_t ty, uint64_t argument, uint64_t value)
+{
+  cbor_compact c;
+  c.cbor_compact_header =
+    argument << COMPACT_ARGUMENT_SHIFT | (uint64_t)ty << COMPACT_TYPE_SHIFT | (uint64_t)tag;
+  c.cbor_compact_value = value;
+  return c;
+}
+
+static uint8_t compact_tag(cbor_compact c)
+{
+  return (uint8_t)(c.cbor_compact_header & 7ULL);
+}
+
+static uint8_t compact_type(cbor_compact c)
+{
+  return (uint8_t)(c.cbor_compact_header >> COMPACT_TYPE_SHIFT & 7ULL);
+}
+
+static uint64_t compact_argument(cbor_compact c)
+{
+  return c.cbor_compact_header >> COMPACT_ARGUMENT_SHIFT;
+}
+
+static cbor compact_to_serialized(cbor_compact c)
+{
+  return
+    (
+      (cbor){
+        .tag = CBOR_Case_Serialized,
+        {
+          .case_CBOR_Case_Serialized = {
+            .cbor_serialized_size = (size_t)compact_argument(c),
+            .cbor_serialized_payload = c.cbor_compact_bytes
+          }
+        }
+      }
+    );
+}
+
+/* Converts `c`, except for the children of arrays, maps and tags: for
+   those, the value is a pointer to the children of `c`, to be
+   converted by `compact_convert_children`. */
+static bool compact_of_cbor_shallow(cbor c, cbor_compact *res)
+{
+  switch (c.tag)
+  {
+    case CBOR_Case_Int64:
+    {
+      *res =
+        compact_mk(CBOR_Case_Int64,
+          c.case_CBOR_Case_Int64.cbor_int_type,
+          0ULL,
+          c.case_CBOR_Case_Int64.cbor_int_value);
+      return true;
+    }
+    case CBOR_Case_Simple_value:
+    {
+      *res = cbor_compact_constr_simple_value(c.case_CBOR_Case_Simple_value);
+      return true;
+    }
+    case CBOR_Case_String:
+    {
+      cbor_string s = c.case_CBOR_Case_String;
+      if (s.cbor_string_length > CBOR_COMPACT_MAX_ARGUMENT)
+        return false;
+      *res = cbor_compact_constr_string(s.cbor_string_type, s.cbor_string_payload, s.cbor_string_length);
+      return true;
+    }
+    case CBOR_Case_Tagged:
+    {
+      cbor_tagged0 t = c.case_CBOR_Case_Tagged;
+      if (t.cbor_tagged0_tag > CBOR_COMPACT_MAX_ARGUMENT)
+        return false;
+      *res =
+        compact_mk(CBOR_Case_Tagged,
+          CBOR_MAJOR_TYPE_TAGGED,
+          t.cbor_tagged0_tag,
+          (uint64_t)(uintptr_t)t.cbor_tagged0_payload);
+      return true;
+    }
+    case CBOR_Case_Array:
+    {
+      cbor_array a = c.case_CBOR_Case_Array;
+      if (a.cbor_array_length > CBOR_COMPACT_MAX_ARGUMENT)
+        return false;
+      *res =
+        compact_mk(CBOR_Case_Array,
+          CBOR_MAJOR_TYPE_ARRAY,
+          a.cbor_array_length,
+          (uint64_t)(uintptr_t)a.cbor_array_payload);
+      return true;
+    }
+    case CBOR_Case_Map:
+    {
+      cbor_map m = c.case_CBOR_Case_Map;
+      if (m.cbor_map_length > CBOR_COMPACT_MAX_ARGUMENT)
+        return false;
+      *res =
+        compact_mk(CBOR_Case_Map,
+          CBOR_MAJOR_TYPE_MAP,
+          m.cbor_map_length,
+          (uint64_t)(uintptr_t)m.cbor_map_payload);
+      return true;
+    }
+    default:
+    {
+      cbor_serialized s = c.case_CBOR_Case_Serialized;
+      if ((uint64_t)s.cbor_serialized_size > CBOR_COMPACT_MAX_ARGUMENT)
+        return false;
+      *res = compact_mk(CBOR_Case_Serialized, 0U, (uint64_t)s.cbor_serialized_size, 0ULL);
+      res->cbor_compact_bytes = s.cbor_serialized_payload;
+      return true;
+    }
+  }
+}
+
+/* Allocates the children of `c` (left by `compact_of_cbor_shallow`)
+   from `storage`, and converts them. */
+static bool
+compact_convert_children(
+  cbor_compact *c,
+  cbor_compact *storage,
+  size_t storage_length,
+  size_t *used
+)
+{
+  uint8_t tag = compact_tag(*c);
+  uint64_t n;
+  if (tag == CBOR_Case_Array)
+    n = compact_argument(*c);
+  else if (tag == CBOR_Case_Map)
+    n = compact_argument(*c) * 2ULL;
+  else if (tag == CBOR_Case_Tagged)
+    n = 1ULL;
+  else
+    return true;
+  if (n > (uint64_t)(storage_length - *used))
+    return false;
+  cbor_compact *dst = storage + *used;
+  void *src = (void *)(uintptr_t)c->cbor_compact_value;
+  for (size_t i = (size_t)0U; i < (size_t)n; i++)
+  {
+    cbor x;
+    if (tag == CBOR_Case_Map)
+    {
+      cbor_map_entry e = ((cbor_map_entry *)src)[i / (size_t)2U];
+      x = i % (size_t)2U == (size_t)0U ? e.cbor_map_entry_key : e.cbor_map_entry_value;
+    }
+    else
+      x = ((cbor *)src)[i];
+    if (!compact_of_cbor_shallow(x, &dst[i]))
+      return false;
+  }
+  c->cbor_compact_children = dst;
+  *used += (size_t)n;
+  return true;
+}
+
+bool
+cbor_compact_of_cbor(cbor c, cbor_compact *storage, size_t storage_length, cbor_compact *res)
+{
+  size_t used = (size_t)0U;
+  if
+  (
+    !compact_of_cbor_shallow(c, res)
+    || !compact_convert_children(res, storage, storage_length, &used)
+  )
+    return false;
+  /* `storage` is also the queue of the breadth-first traversal */
+  for (size_t i = (size_t)0U; i < used; i++)
+    if (!compact_convert_children(&storage[i], storage, storage_length, &used))
+      return false;
+  return true;
+}
+
+cbor_compact cbor_compact_constr_int64(uint8_t ty, uint64_t value)
+{
+  return compact_mk(CBOR_Case_Int64, ty, 0ULL, value);
+}
+
+cbor_compact cbor_compact_constr_simple_value(uint8_t value)
+{
+  return compact_mk(CBOR_Case_Simple_value, CBOR_MAJOR_TYPE_SIMPLE_VALUE, 0ULL, (uint64_t)value);
+}
+
+cbor_compact cbor_compact_constr_string(uint8_t typ, uint8_t *a, uint64_t len)
+{
+  cbor_compact c = compact_mk(CBOR_Case_String, typ, len, 0ULL);
+  c.cbor_compact_bytes = a;
+  return c;
+}
+
+cbor_compact cbor_compact_constr_array(cbor_compact *a, uint64_t len)
+{
+  cbor_compact c = compact_mk(CBOR_Case_Array, CBOR_MAJOR_TYPE_ARRAY, len, 0ULL);
+  c.cbor_compact_children = a;
+  return c;
+}
+
+cbor_compact cbor_compact_constr_map(cbor_compact *keys_and_values, uint64_t len)
+{
+  cbor_compact c = compact_mk(CBOR_Case_Map, CBOR_MAJOR_TYPE_MAP, len, 0ULL);
+  c.cbor_compact_children = keys_and_values;
+  return c;
+}
+
+cbor_compact cbor_compact_constr_tagged(uint64_t tag, cbor_compact *a)
+{
+  cbor_compact c = compact_mk(CBOR_Case_Tagged, CBOR_MAJOR_TYPE_TAGGED, tag, 0ULL);
+  c.cbor_compact_children = a;
+  return c;
+}
+
+/* Children of serialized items are serialized */
+static cbor_compact compact_of_serialized(cbor c)
+{
+  cbor_compact res;
+  compact_of_cbor_shallow(c, &res);
+  return res;
+}
+
+uint8_t cbor_compact_get_major_type(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return cbor_get_major_type(compact_to_serialized(c));
+  else
+    return compact_type(c);
+}
+
+cbor_int cbor_compact_destr_int64(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return cbor_destr_int64(compact_to_serialized(c));
+  else
+    return ((cbor_int){ .cbor_int_type = compact_type(c), .cbor_int_value = c.cbor_compact_value });
+}
+
+uint8_t cbor_compact_destr_simple_value(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return cbor_destr_simple_value(compact_to_serialized(c));
+  else
+    return (uint8_t)c.cbor_compact_value;
+}
+
+cbor_string cbor_compact_destr_string(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return cbor_destr_string(compact_to_serialized(c));
+  else
+    return
+      (
+        (cbor_string){
+          .cbor_string_type = compact_type(c),
+          .cbor_string_length = compact_argument(c),
+          .cbor_string_payload = c.cbor_compact_bytes
+        }
+      );
+}
+
+uint64_t cbor_compact_array_length(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return cbor_array_length(compact_to_serialized(c));
+  else
+    return compact_argument(c);
+}
+
+cbor_compact cbor_compact_array_index(cbor_compact c, size_t i)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return compact_of_serialized(cbor_array_index(compact_to_serialized(c), i));
+  else
+    return c.cbor_compact_children[i];
+}
+
+uint64_t cbor_compact_map_length(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return cbor_map_length(compact_to_serialized(c));
+  else
+    return compact_argument(c);
+}
+
+static cbor_map_entry serialized_map_entry(cbor_compact c, size_t i)
+{
+  cbor_map_iterator_t it = cbor_map_iterator_init(compact_to_serialized(c));
+  cbor_map_entry e = cbor_map_iterator_next(&it);
+  for (size_t j = (size_t)0U; j < i; j++)
+    e = cbor_map_iterator_next(&it);
+  return e;
+}
+
+cbor_compact cbor_compact_map_key(cbor_compact c, size_t i)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return compact_of_serialized(cbor_map_entry_key(serialized_map_entry(c, i)));
+  else
+    return c.cbor_compact_children[i + i];
+}
+
+cbor_compact cbor_compact_map_value(cbor_compact c, size_t i)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return compact_of_serialized(cbor_map_entry_value(serialized_map_entry(c, i)));
+  else
+    return c.cbor_compact_children[i + i + (size_t)1U];
+}
+
+uint64_t cbor_compact_tagged_tag(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return cbor_destr_tagged(compact_to_serialized(c)).cbor_tagged_tag;
+  else
+    return compact_argument(c);
+}
+
+cbor_compact cbor_compact_tagged_payload(cbor_compact c)
+{
+  if (compact_tag(c) == CBOR_Case_Serialized)
+    return compact_of_serialized(cbor_destr_tagged(compact_to_serialized(c)).cbor_tagged_payload);
+  else
+    return c.cbor_compact_children[0U];
+}
+
+/* Writes the header of `c` (or all of it, if it has no children), and
+   sets `f` to its children */
+static bool compact_write_node(cbor_compact c, uint8_t *out, size_t sz, size_t *pos, cbor_compact_frame *f)
+{
+  uint8_t tag = compact_tag(c);
+  size_t n;
+  if (tag == CBOR_Case_Serialized)
+  {
+    n = (size_t)compact_argument(c);
+    if (n > sz - *pos)
+      return false;
+    if (n > (size_t)0U)
+      memcpy(out + *pos, c.cbor_compact_bytes, n);
+    *pos += n;
+    return true;
+  }
+  uint64_t x;
+  if (tag == CBOR_Case_Int64 || tag == CBOR_Case_Simple_value)
+    x = c.cbor_compact_value;
+  else
+    x = compact_argument(c);
+  if (cbor_raw_header_size(x) > sz - *pos)
+    return false;
+  *pos += cbor_raw_header_write(compact_type(c), x, out + *pos);
+  switch (tag)
+  {
+    case CBOR_Case_String:
+    {
+      n = (size_t)x;
+      if (n > sz - *pos)
+        return false;
+      if (n > (size_t)0U)
+        memcpy(out + *pos, c.cbor_compact_bytes, n);
+      *pos += n;
+      return true;
+    }
+    case CBOR_Case_Array:
+      n = (size_t)x;
+      break;
+    case CBOR_Case_Map:
+      n = (size_t)x * (size_t)2U;
+      break;
+    case CBOR_Case_Tagged:
+      n = (size_t)1U;
+      break;
+    default:
+      return true;
+  }
+  f->cbor_compact_frame_next = c.cbor_compact_children;
+  f->cbor_compact_frame_remaining = n;
+  return true;
+}
+
+cbor_traversal_status
+cbor_compact_write(
+  cbor_compact c,
+  uint8_t *out,
+  size_t sz,
+  cbor_compact_frame *stack,
+  size_t stack_length,
+  size_t *res
+)
+{
+  size_t pos = (size_t)0U;
+  size_t depth = (size_t)0U;
+  while (true)
+  {
+    cbor_compact_frame f = { .cbor_compact_frame_next = NULL, .cbor_compact_frame_remaining = (size_t)0U };
+    if (!compact_write_node(c, out, sz, &pos, &f))
+      return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+    if (f.cbor_compact_frame_remaining > (size_t)0U)
+    {
+      if (depth == stack_length)
+        return CBOR_TRAVERSAL_MAX_DEPTH;
+      stack[depth] = f;
+      depth++;
+    }
+    if (depth == (size_t)0U)
+      break;
+    /* the frame of the last child is dropped before writing it */
+    cbor_compact_frame *top = &stack[depth - (size_t)1U];
+    c = *top->cbor_compact_frame_next;
+    top->cbor_compact_frame_next++;
+    top->cbor_compact_frame_remaining--;
+    if (top->cbor_compact_frame_remaining == (size_t)0U)
+      depth--;
+  }
+  *res = pos;
+  return CBOR_TRAVERSAL_SUCCESS;
+}
+
+/* Converts `c`, except for the children of arrays, maps and tags: for
+   those, the payload is a pointer to the children of `c`, to be
+   converted by `cbor_of_compact_children`. */
+static cbor cbor_of_compact_shallow(cbor_compact c)
+{
+  switch (compact_tag(c))
+  {
+    case CBOR_Case_Int64:
+      return cbor_constr_int64(compact_type(c), c.cbor_compact_value);
+    case CBOR_Case_Simple_value:
+      return cbor_constr_simple_value((uint8_t)c.cbor_compact_value);
+    case CBOR_Case_String:
+      return cbor_constr_string(compact_type(c), c.cbor_compact_bytes, compact_argument(c));
+    case CBOR_Case_Tagged:
+      return cbor_constr_tagged(compact_argument(c), (cbor *)(void *)c.cbor_compact_children);
+    case CBOR_Case_Array:
+      return cbor_constr_array((cbor *)(void *)c.cbor_compact_children, compact_argument(c));
+    case CBOR_Case_Map:
+      return cbor_constr_map((cbor_map_entry *)(void *)c.cbor_compact_children, compact_argument(c));
+    default:
+      return compact_to_serialized(c);
+  }
+}
+
+/* Allocates the children of `c` (left by `cbor_of_compact_shallow`)
+   from `storage`, or from `entries` for map entries, and converts
+   them. */
+static bool
+cbor_of_compact_children(
+  cbor *c,
+  cbor *storage,
+  size_t storage_length,
+  size_t *used,
+  cbor_map_entry *entries,
+  size_t entries_length,
+  size_t *entries_used
+)
+{
+  cbor_compact *src;
+  uint64_t n;
+  switch (c->tag)
+  {
+    case CBOR_Case_Tagged:
+    {
+      src = (cbor_compact *)(void *)c->case_CBOR_Case_Tagged.cbor_tagged0_payload;
+      if (*used == storage_length)
+        return false;
+      cbor *dst = storage + *used;
+      *dst = cbor_of_compact_shallow(*src);
+      c->case_CBOR_Case_Tagged.cbor_tagged0_payload = dst;
+      *used += (size_t)1U;
+      return true;
+    }
+    case CBOR_Case_Array:
+    {
+      src = (cbor_compact *)(void *)c->case_CBOR_Case_Array.cbor_array_payload;
+      n = c->case_CBOR_Case_Array.cbor_array_length;
+      if (n > (uint64_t)(storage_length - *used))
+        return false;
+      cbor *dst = storage + *used;
+      for (size_t i = (size_t)0U; i < (size_t)n; i++)
+        dst[i] = cbor_of_compact_shallow(src[i]);
+      c->case_CBOR_Case_Array.cbor_array_payload = dst;
+      *used += (size_t)n;
+      return true;
+    }
+    case CBOR_Case_Map:
+    {
+      src = (cbor_compact *)(void *)c->case_CBOR_Case_Map.cbor_map_payload;
+      n = c->case_CBOR_Case_Map.cbor_map_length;
+      if (n > (uint64_t)(entries_length - *entries_used))
+        return false;
+      cbor_map_entry *dst = entries + *entries_used;
+      for (size_t i = (size_t)0U; i < (size_t)n; i++)
+        dst[i] =
+          cbor_mk_map_entry(cbor_of_compact_shallow(src[i + i]),
+            cbor_of_compact_shallow(src[i + i + (size_t)1U]));
+      c->case_CBOR_Case_Map.cbor_map_payload = dst;
+      *entries_used += (size_t)n;
+      return true;
+    }
+    default:
+      return true;
+  }
+}
+
+bool
+cbor_of_compact(
+  cbor_compact c,
+  cbor *storage,
+  size_t storage_length,
+  cbor_map_entry *entries,
+  size_t entries_length,
+  cbor *res
+)
+{
+  size_t used = (size_t)0U;
+  size_t entries_used = (size_t)0U;
+  *res = cbor_of_compact_shallow(c);
+  if (!cbor_of_compact_children(res, storage, storage_length, &used, entries, entries_length, &entries_used))
+    return false;
+  /* `storage` and `entries` are also the queues of the breadth-first
+     traversal */
+  size_t i = (size_t)0U;
+  size_t j = (size_t)0U;
+  while (i < used || j < entries_used)
+  {
+    bool ok;
+    if (i < used)
+    {
+      ok = cbor_of_compact_children(&storage[i], storage, storage_length, &used, entries, entries_length, &entries_used);
+      i++;
+    }
+    else
+    {
+      cbor_map_entry *e = &entries[j];
+      ok =
+        cbor_of_compact_children(&e->cbor_map_entry_key, storage, storage_length, &used, entries,
+          entries_length, &entries_used)
+        && cbor_of_compact_children(&e->cbor_map_entry_value, storage, storage_length, &used, entries,
+          entries_length, &entries_used);
+      j++;
+    }
+    if (!ok)
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,82 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cbor_unverified_internal.h"
+
+cbor_file_status cbor_file_open(const char *path, cbor_file *res)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return CBOR_FILE_ERROR;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size > (uint64_t)SIZE_MAX)
+  {
+    close(fd);
+    return CBOR_FILE_ERROR;
+  }
+  size_t size = (size_t)st.st_size;
+  uint8_t *base = NULL;
+  /* mmap rejects empty mappings */
+  if (size > (size_t)0U)
+  {
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+    {
+      close(fd);
+      return CBOR_FILE_ERROR;
+    }
+    base = p;
+  }
+  /* the mapping remains valid after the file is closed */
+  close(fd);
+  res->cbor_file_base = base;
+  res->cbor_file_size = size;
+  return CBOR_FILE_SUCCESS;
+}
+
+/* The range of pages containing `[off, off + len)` */
+static void file_advise(cbor_file *f, size_t off, size_t len, int advice)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t start = off - off % page;
+  if (len > (size_t)0U)
+    madvise(f->cbor_file_base + start, off + len - start, advice);
+}
+
+cbor_read_t cbor_file_read(cbor_file *f, size_t offset)
+{
+  if (offset > f->cbor_file_size)
+    offset = f->cbor_file_size;
+  size_t len = f->cbor_file_size - offset;
+  /* validation reads the item from start to end */
+  file_advise(f, offset, len, MADV_SEQUENTIAL);
+  cbor_read_t r = cbor_read(f->cbor_file_base + offset, len);
+  /* navigation jumps around */
+  file_advise(f, offset, len, MADV_NORMAL);
+  return r;
+}
+
+void cbor_file_close(cbor_file *f)
+{
+  if (f->cbor_file_size > (size_t)0U)
+    munmap(f->cbor_file_base, f->cbor_file_size);
+  f->cbor_file_base = NULL;
+  f->cbor_file_size = (size_t)0U;
+}
@@ -0,0 +1,93 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+#define FNV_OFFSET_BASIS (14695981039346656037ULL)
+
+#define FNV_PRIME (1099511628211ULL)
+
+static uint64_t hash_bytes(uint64_t h, uint8_t *a, size_t len)
+{
+  for (size_t i = (size_t)0U; i < len; i++)
+  {
+    h ^= (uint64_t)a[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+static uint64_t hash_header(uint64_t h, uint8_t ty, uint64_t x)
+{
+  uint8_t hd[CBOR_RAW_MAX_HEADER_SIZE];
+  size_t sz = cbor_raw_header_write(ty, x, hd);
+  return hash_bytes(h, hd, sz);
+}
+
+static uint64_t hash_aux(uint64_t h, cbor c)
+{
+  switch (c.tag)
+  {
+    case CBOR_Case_Int64:
+      return
+        hash_header(h,
+          c.case_CBOR_Case_Int64.cbor_int_type,
+          c.case_CBOR_Case_Int64.cbor_int_value);
+    case CBOR_Case_String:
+    {
+      cbor_string s = c.case_CBOR_Case_String;
+      h = hash_header(h, s.cbor_string_type, s.cbor_string_length);
+      return hash_bytes(h, s.cbor_string_payload, (size_t)s.cbor_string_length);
+    }
+    case CBOR_Case_Simple_value:
+      return hash_header(h, CBOR_MAJOR_TYPE_SIMPLE_VALUE, c.case_CBOR_Case_Simple_value);
+    case CBOR_Case_Tagged:
+    {
+      cbor_tagged0 t = c.case_CBOR_Case_Tagged;
+      h = hash_header(h, CBOR_MAJOR_TYPE_TAGGED, t.cbor_tagged0_tag);
+      return hash_aux(h, *t.cbor_tagged0_payload);
+    }
+    case CBOR_Case_Array:
+    {
+      cbor_array a = c.case_CBOR_Case_Array;
+      h = hash_header(h, CBOR_MAJOR_TYPE_ARRAY, a.cbor_array_length);
+      for (uint64_t i = 0ULL; i < a.cbor_array_length; i++)
+        h = hash_aux(h, a.cbor_array_payload[i]);
+      return h;
+    }
+    case CBOR_Case_Map:
+    {
+      cbor_map m = c.case_CBOR_Case_Map;
+      h = hash_header(h, CBOR_MAJOR_TYPE_MAP, m.cbor_map_length);
+      for (uint64_t i = 0ULL; i < m.cbor_map_length; i++)
+      {
+        h = hash_aux(h, m.cbor_map_payload[i].cbor_map_entry_key);
+        h = hash_aux(h, m.cbor_map_payload[i].cbor_map_entry_value);
+      }
+      return h;
+    }
+    default:
+      return
+        hash_bytes(h,
+          c.case_CBOR_Case_Serialized.cbor_serialized_payload,
+          c.case_CBOR_Case_Serialized.cbor_serialized_size);
+  }
+}
+
+uint64_t cbor_hash(cbor c)
+{
+  return hash_aux(FNV_OFFSET_BASIS, c);
+}
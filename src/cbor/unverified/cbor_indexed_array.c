@@ -0,0 +1,83 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "CBOR_Unverified.h"
+
+cbor_indexed_array cbor_indexed_array_init(cbor a, size_t *offsets, size_t offsets_length)
+{
+  return
+    (
+      (cbor_indexed_array){
+        .cbor_indexed_array_payload = a,
+        .cbor_indexed_array_length = cbor_array_length(a),
+        .cbor_indexed_array_offsets = offsets,
+        .cbor_indexed_array_offsets_length = offsets_length,
+        .cbor_indexed_array_base = NULL
+      }
+    );
+}
+
+uint64_t cbor_indexed_array_length(cbor_indexed_array *a)
+{
+  return a->cbor_indexed_array_length;
+}
+
+/* One pass of the (verified) array iterator: each step jumps over
+   exactly one element, so this is linear in the size of the array. */
+static void cbor_indexed_array_build(cbor_indexed_array *a)
+{
+  cbor_array_iterator_t it = cbor_array_iterator_init(a->cbor_indexed_array_payload);
+  uint8_t *base = it.cbor_array_iterator_payload.case_CBOR_Array_Iterator_Payload_Serialized;
+  size_t *offsets = a->cbor_indexed_array_offsets;
+  size_t n = (size_t)0U;
+  size_t off = (size_t)0U;
+  while (!cbor_array_iterator_is_done(it))
+  {
+    cbor x = cbor_array_iterator_next(&it);
+    offsets[n] = off;
+    off += x.case_CBOR_Case_Serialized.cbor_serialized_size;
+    n++;
+  }
+  offsets[n] = off;
+  a->cbor_indexed_array_base = base;
+}
+
+cbor cbor_indexed_array_index(cbor_indexed_array *a, size_t i)
+{
+  cbor c = a->cbor_indexed_array_payload;
+  if (c.tag != CBOR_Case_Serialized)
+    return cbor_array_index(c, i);
+  if (a->cbor_indexed_array_base == NULL)
+  {
+    if (a->cbor_indexed_array_offsets == NULL
+      || a->cbor_indexed_array_offsets_length <= a->cbor_indexed_array_length)
+      return cbor_array_index(c, i);
+    cbor_indexed_array_build(a);
+  }
+  size_t *offsets = a->cbor_indexed_array_offsets;
+  return
+    (
+      (cbor){
+        .tag = CBOR_Case_Serialized,
+        {
+          .case_CBOR_Case_Serialized = {
+            .cbor_serialized_size = offsets[i + (size_t)1U] - offsets[i],
+            .cbor_serialized_payload = a->cbor_indexed_array_base + offsets[i]
+          }
+        }
+      }
+    );
+}
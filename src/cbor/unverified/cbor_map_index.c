@@ -0,0 +1,97 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+size_t cbor_map_index_slots_length(cbor map)
+{
+  size_t len = (size_t)cbor_map_length(map);
+  size_t res = (size_t)2U;
+  while (res < len + len)
+    res = res + res;
+  return res;
+}
+
+bool
+cbor_map_index_init(
+  cbor map,
+  cbor_map_index_slot *slots,
+  size_t slots_length,
+  cbor_map_index *res
+)
+{
+  uint64_t len = cbor_map_length(map);
+  if (slots_length == (size_t)0U
+    || (slots_length & (slots_length - (size_t)1U)) != (size_t)0U
+    || (uint64_t)slots_length <= len)
+    return false;
+  size_t mask = slots_length - (size_t)1U;
+  for (size_t i = (size_t)0U; i < slots_length; i++)
+    slots[i].cbor_map_index_slot_is_used = false;
+  cbor_map_iterator_t it = cbor_map_iterator_init(map);
+  while (!cbor_map_iterator_is_done(it))
+  {
+    cbor_map_entry x = cbor_map_iterator_next(&it);
+    uint64_t h = cbor_hash(x.cbor_map_entry_key);
+    size_t j = (size_t)h & mask;
+    bool is_duplicate = false;
+    while (slots[j].cbor_map_index_slot_is_used && !is_duplicate)
+    {
+      /* keep the first occurrence of a duplicate key, as
+         CBOR_Pulse_cbor_map_get does */
+      is_duplicate =
+        slots[j].cbor_map_index_slot_hash == h
+        && CBOR_Pulse_cbor_is_equal(slots[j].cbor_map_index_slot_entry.cbor_map_entry_key,
+          x.cbor_map_entry_key);
+      if (!is_duplicate)
+        j = (j + (size_t)1U) & mask;
+    }
+    if (!is_duplicate)
+    {
+      slots[j].cbor_map_index_slot_is_used = true;
+      slots[j].cbor_map_index_slot_hash = h;
+      slots[j].cbor_map_index_slot_entry = x;
+    }
+  }
+  res->cbor_map_index_slots = slots;
+  res->cbor_map_index_slots_length = slots_length;
+  return true;
+}
+
+CBOR_Pulse_cbor_map_get_t cbor_map_index_get(cbor_map_index *idx, cbor key)
+{
+  cbor_map_index_slot *slots = idx->cbor_map_index_slots;
+  size_t mask = idx->cbor_map_index_slots_length - (size_t)1U;
+  uint64_t h = cbor_hash(key);
+  size_t j = (size_t)h & mask;
+  while (slots[j].cbor_map_index_slot_is_used)
+  {
+    if
+    (
+      slots[j].cbor_map_index_slot_hash == h
+      && CBOR_Pulse_cbor_is_equal(key, slots[j].cbor_map_index_slot_entry.cbor_map_entry_key)
+    )
+      return
+        (
+          (CBOR_Pulse_cbor_map_get_t){
+            .tag = CBOR_Pulse_Found,
+            ._0 = slots[j].cbor_map_index_slot_entry.cbor_map_entry_value
+          }
+        );
+    j = (j + (size_t)1U) & mask;
+  }
+  return ((CBOR_Pulse_cbor_map_get_t){ .tag = CBOR_Pulse_NotFound });
+}
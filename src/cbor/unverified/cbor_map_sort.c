@@ -0,0 +1,204 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+#define PREFIX_MAX_LENGTH (8U)
+
+/* Records the first (up to) 8 bytes of the encoding of the key of `x`,
+   as a big-endian integer padded with zeros, and whether they are the
+   whole encoding. For arrays, maps and tags, only the header is
+   recorded. */
+static cbor_map_sort_entry sort_entry_init(cbor_map_entry x)
+{
+  uint8_t buf[PREFIX_MAX_LENGTH + CBOR_RAW_MAX_HEADER_SIZE];
+  size_t known;
+  bool is_complete;
+  cbor k = x.cbor_map_entry_key;
+  switch (k.tag)
+  {
+    case CBOR_Case_Int64:
+    {
+      known =
+        cbor_raw_header_write(k.case_CBOR_Case_Int64.cbor_int_type,
+          k.case_CBOR_Case_Int64.cbor_int_value,
+          buf);
+      is_complete = true;
+      break;
+    }
+    case CBOR_Case_Simple_value:
+    {
+      known = cbor_raw_header_write(CBOR_MAJOR_TYPE_SIMPLE_VALUE, k.case_CBOR_Case_Simple_value, buf);
+      is_complete = true;
+      break;
+    }
+    case CBOR_Case_String:
+    {
+      cbor_string s = k.case_CBOR_Case_String;
+      known = cbor_raw_header_write(s.cbor_string_type, s.cbor_string_length, buf);
+      size_t n = (size_t)PREFIX_MAX_LENGTH;
+      if ((uint64_t)n > s.cbor_string_length)
+        n = (size_t)s.cbor_string_length;
+      memcpy(buf + known, s.cbor_string_payload, n);
+      known += n;
+      is_complete = (uint64_t)n == s.cbor_string_length;
+      break;
+    }
+    case CBOR_Case_Serialized:
+    {
+      cbor_serialized s = k.case_CBOR_Case_Serialized;
+      known = (size_t)PREFIX_MAX_LENGTH;
+      if (known > s.cbor_serialized_size)
+        known = s.cbor_serialized_size;
+      memcpy(buf, s.cbor_serialized_payload, known);
+      is_complete = known == s.cbor_serialized_size;
+      break;
+    }
+    case CBOR_Case_Tagged:
+    {
+      known = cbor_raw_header_write(CBOR_MAJOR_TYPE_TAGGED, k.case_CBOR_Case_Tagged.cbor_tagged0_tag, buf);
+      is_complete = false;
+      break;
+    }
+    case CBOR_Case_Array:
+    {
+      known = cbor_raw_header_write(CBOR_MAJOR_TYPE_ARRAY, k.case_CBOR_Case_Array.cbor_array_length, buf);
+      is_complete = false;
+      break;
+    }
+    default:
+    {
+      known = cbor_raw_header_write(CBOR_MAJOR_TYPE_MAP, k.case_CBOR_Case_Map.cbor_map_length, buf);
+      is_complete = false;
+      break;
+    }
+  }
+  if (known > (size_t)PREFIX_MAX_LENGTH)
+  {
+    known = (size_t)PREFIX_MAX_LENGTH;
+    is_complete = false;
+  }
+  uint64_t prefix = 0ULL;
+  for (size_t i = (size_t)0U; i < (size_t)PREFIX_MAX_LENGTH; i++)
+    prefix = prefix << 8U | (i < known ? (uint64_t)buf[i] : 0ULL);
+  return
+    (
+      (cbor_map_sort_entry){
+        .cbor_map_sort_entry_prefix = prefix,
+        .cbor_map_sort_entry_prefix_length = (uint8_t)known,
+        .cbor_map_sort_entry_prefix_is_complete = is_complete,
+        .cbor_map_sort_entry_entry = x
+      }
+    );
+}
+
+/* Same sign as `CBOR_Pulse_cbor_compare` on the keys. The prefixes
+   decide whenever they differ on their common length, or when one of
+   them is a whole encoding. */
+static int16_t sort_entry_compare(cbor_map_sort_entry *e1, cbor_map_sort_entry *e2)
+{
+  size_t k1 = (size_t)e1->cbor_map_sort_entry_prefix_length;
+  size_t k2 = (size_t)e2->cbor_map_sort_entry_prefix_length;
+  size_t k = k1 < k2 ? k1 : k2;
+  if (k > (size_t)0U)
+  {
+    uint64_t mask = ~0ULL << (8U * ((size_t)PREFIX_MAX_LENGTH - k));
+    uint64_t x1 = e1->cbor_map_sort_entry_prefix & mask;
+    uint64_t x2 = e2->cbor_map_sort_entry_prefix & mask;
+    if (x1 != x2)
+      return x1 < x2 ? (int16_t)-1 : (int16_t)1;
+  }
+  bool c1 = e1->cbor_map_sort_entry_prefix_is_complete;
+  bool c2 = e2->cbor_map_sort_entry_prefix_is_complete;
+  if (c1 && c2 && k1 == k2)
+    return (int16_t)0;
+  else if (c1 && k1 <= k2)
+    return (int16_t)-1;
+  else if (c2 && k2 <= k1)
+    return (int16_t)1;
+  else
+    return
+      CBOR_Pulse_cbor_compare(e1->cbor_map_sort_entry_entry.cbor_map_entry_key,
+        e2->cbor_map_sort_entry_entry.cbor_map_entry_key);
+}
+
+/* Merges the sorted runs `src[lo, mi)` and `src[mi, hi)` into
+   `dst[lo, hi)`. Returns false if they have a key in common. */
+static bool
+sort_merge(cbor_map_sort_entry *src, cbor_map_sort_entry *dst, size_t lo, size_t mi, size_t hi)
+{
+  size_t i1 = lo;
+  size_t i2 = mi;
+  size_t j = lo;
+  if (mi > lo && mi < hi)
+  {
+    int16_t c = sort_entry_compare(&src[mi - (size_t)1U], &src[mi]);
+    if (c == (int16_t)0)
+      return false;
+    else if (c < (int16_t)0)
+    {
+      /* already in order */
+      memcpy(dst + lo, src + lo, (hi - lo) * sizeof(cbor_map_sort_entry));
+      return true;
+    }
+  }
+  while (i1 < mi && i2 < hi)
+  {
+    int16_t c = sort_entry_compare(&src[i1], &src[i2]);
+    if (c == (int16_t)0)
+      return false;
+    else if (c < (int16_t)0)
+      dst[j++] = src[i1++];
+    else
+      dst[j++] = src[i2++];
+  }
+  memcpy(dst + j, src + i1, (mi - i1) * sizeof(cbor_map_sort_entry));
+  j += mi - i1;
+  memcpy(dst + j, src + i2, (hi - i2) * sizeof(cbor_map_sort_entry));
+  return true;
+}
+
+bool
+cbor_map_sort_with_scratch(
+  cbor_map_entry *a,
+  size_t len,
+  cbor_map_sort_entry *scratch,
+  size_t scratch_length
+)
+{
+  if (scratch == NULL || scratch_length / (size_t)2U < len)
+    return CBOR_Pulse_cbor_map_sort(a, len);
+  cbor_map_sort_entry *src = scratch;
+  cbor_map_sort_entry *dst = scratch + len;
+  for (size_t i = (size_t)0U; i < len; i++)
+    src[i] = sort_entry_init(a[i]);
+  for (size_t width = (size_t)1U; width < len; width += width)
+  {
+    for (size_t lo = (size_t)0U; lo < len; lo += width + width)
+    {
+      size_t mi = len - lo > width ? lo + width : len;
+      size_t hi = len - mi > width ? mi + width : len;
+      if (!sort_merge(src, dst, lo, mi, hi))
+        return false;
+    }
+    cbor_map_sort_entry *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  for (size_t i = (size_t)0U; i < len; i++)
+    a[i] = src[i].cbor_map_sort_entry_entry;
+  return true;
+}
@@ -0,0 +1,91 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdlib.h>
+#include "cbor_unverified_internal.h"
+
+#define OUTPUT_MIN_LENGTH ((size_t)64U)
+
+bool cbor_output_next_realloc(cbor_output *o, size_t needed)
+{
+  size_t len = o->cbor_output_length;
+  size_t grow = len < OUTPUT_MIN_LENGTH ? OUTPUT_MIN_LENGTH : len;
+  if (grow < needed)
+    grow = needed;
+  if (grow > SIZE_MAX - len)
+    grow = SIZE_MAX - len;
+  if (grow == (size_t)0U)
+    return false;
+  uint8_t *buf = realloc(o->cbor_output_buffer, len + grow);
+  if (buf == NULL)
+    return false;
+  o->cbor_output_buffer = buf;
+  o->cbor_output_length = len + grow;
+  return true;
+}
+
+/* The data of a chunk follows its descriptor, in the same allocation. */
+static cbor_output_chunk *output_chunk_alloc(size_t chunk_size)
+{
+  if (chunk_size == (size_t)0U || chunk_size > SIZE_MAX - sizeof(cbor_output_chunk))
+    return NULL;
+  cbor_output_chunk *chunk = malloc(sizeof(cbor_output_chunk) + chunk_size);
+  if (chunk == NULL)
+    return NULL;
+  chunk->cbor_output_chunk_next = NULL;
+  chunk->cbor_output_chunk_data = (uint8_t *)(chunk + 1U);
+  return chunk;
+}
+
+cbor_output_chunk *cbor_output_chunks_init(cbor_output *o, size_t chunk_size)
+{
+  cbor_output_chunk *chunk = output_chunk_alloc(chunk_size);
+  if (chunk == NULL)
+    return NULL;
+  o->cbor_output_buffer = chunk->cbor_output_chunk_data;
+  o->cbor_output_length = chunk_size;
+  o->cbor_output_position = (size_t)0U;
+  o->cbor_output_next = cbor_output_next_chunk;
+  o->cbor_output_context = chunk;
+  return chunk;
+}
+
+bool cbor_output_next_chunk(cbor_output *o, size_t needed)
+{
+  /* all chunks keep the size given to cbor_output_chunks_init, so that
+     readers of the chain can find the end of each one; one more byte
+     of room is all that cbor_output_write asks for */
+  (void)needed;
+  cbor_output_chunk *last = o->cbor_output_context;
+  cbor_output_chunk *chunk = output_chunk_alloc(o->cbor_output_length);
+  if (chunk == NULL)
+    return false;
+  last->cbor_output_chunk_next = chunk;
+  o->cbor_output_buffer = chunk->cbor_output_chunk_data;
+  o->cbor_output_position = (size_t)0U;
+  o->cbor_output_context = chunk;
+  return true;
+}
+
+void cbor_output_chunks_free(cbor_output_chunk *first)
+{
+  while (first != NULL)
+  {
+    cbor_output_chunk *next = first->cbor_output_chunk_next;
+    free(first);
+    first = next;
+  }
+}
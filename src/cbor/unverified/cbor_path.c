@@ -0,0 +1,191 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+cbor_path_step cbor_path_step_index(uint64_t i)
+{
+  return
+    (
+      (cbor_path_step){
+        .cbor_path_step_kind = CBOR_PATH_STEP_INDEX,
+        .cbor_path_step_argument = i,
+        .cbor_path_step_key = NULL,
+        .cbor_path_step_key_size = (size_t)0U
+      }
+    );
+}
+
+cbor_path_step cbor_path_step_tag(uint64_t tag)
+{
+  return
+    (
+      (cbor_path_step){
+        .cbor_path_step_kind = CBOR_PATH_STEP_TAG,
+        .cbor_path_step_argument = tag,
+        .cbor_path_step_key = NULL,
+        .cbor_path_step_key_size = (size_t)0U
+      }
+    );
+}
+
+cbor_path_step cbor_path_step_key(uint8_t *key, size_t key_size)
+{
+  return
+    (
+      (cbor_path_step){
+        .cbor_path_step_kind = CBOR_PATH_STEP_KEY,
+        .cbor_path_step_argument = 0ULL,
+        .cbor_path_step_key = key,
+        .cbor_path_step_key_size = key_size
+      }
+    );
+}
+
+bool cbor_path_step_key_of_cbor(cbor key, uint8_t *out, size_t sz, cbor_path_step *res)
+{
+  size_t len = cbor_write(key, out, sz);
+  if (len == (size_t)0U)
+    return false;
+  *res = cbor_path_step_key(out, len);
+  return true;
+}
+
+/* One step within a serialized data item `a` of `len` bytes. Since the
+   data item is valid, its encoding is the deterministic one, so that
+   keys can be compared by their encodings. On success, `*off` is the
+   offset of the child in `a`. */
+static bool path_step_raw(uint8_t *a, size_t len, cbor_path_step *step, size_t *off)
+{
+  cbor_raw_header h;
+  if (cbor_raw_header_read(a, len, &h) != CBOR_RAW_VALID)
+    return false;
+  uint64_t x = h.cbor_raw_header_argument;
+  size_t pos = h.cbor_raw_header_size;
+  switch (step->cbor_path_step_kind)
+  {
+    case CBOR_PATH_STEP_INDEX:
+    {
+      if (h.cbor_raw_header_kind != CBOR_RAW_KIND_ARRAY || step->cbor_path_step_argument >= x)
+        return false;
+      for (uint64_t i = 0ULL; i < step->cbor_path_step_argument; i++)
+        pos += cbor_raw_skip(a + pos);
+      *off = pos;
+      return true;
+    }
+    case CBOR_PATH_STEP_KEY:
+    {
+      if (h.cbor_raw_header_kind != CBOR_RAW_KIND_MAP)
+        return false;
+      size_t key_size = step->cbor_path_step_key_size;
+      for (uint64_t i = 0ULL; i < x; i++)
+      {
+        size_t n = cbor_raw_skip(a + pos);
+        bool found = n == key_size && memcmp(a + pos, step->cbor_path_step_key, key_size) == 0;
+        pos += n;
+        if (found)
+        {
+          *off = pos;
+          return true;
+        }
+        pos += cbor_raw_skip(a + pos);
+      }
+      return false;
+    }
+    default:
+    {
+      if (h.cbor_raw_header_kind != CBOR_RAW_KIND_TAGGED || x != step->cbor_path_step_argument)
+        return false;
+      *off = pos;
+      return true;
+    }
+  }
+}
+
+/* One step within a data item that is not serialized, with the verified
+   API */
+static bool path_step(cbor c, cbor_path_step *step, cbor *res)
+{
+  uint8_t ty = cbor_get_major_type(c);
+  switch (step->cbor_path_step_kind)
+  {
+    case CBOR_PATH_STEP_INDEX:
+    {
+      if (ty != CBOR_MAJOR_TYPE_ARRAY || step->cbor_path_step_argument >= cbor_array_length(c))
+        return false;
+      *res = cbor_array_index(c, (size_t)step->cbor_path_step_argument);
+      return true;
+    }
+    case CBOR_PATH_STEP_KEY:
+    {
+      if (ty != CBOR_MAJOR_TYPE_MAP)
+        return false;
+      cbor_read_t k = cbor_read(step->cbor_path_step_key, step->cbor_path_step_key_size);
+      if (!k.cbor_read_is_success || k.cbor_read_remainder_length != (size_t)0U)
+        return false;
+      CBOR_Pulse_cbor_map_get_t r = CBOR_Pulse_cbor_map_get(k.cbor_read_payload, c);
+      if (r.tag != CBOR_Pulse_Found)
+        return false;
+      *res = r._0;
+      return true;
+    }
+    default:
+    {
+      if (ty != CBOR_MAJOR_TYPE_TAGGED)
+        return false;
+      cbor_tagged t = cbor_destr_tagged(c);
+      if (t.cbor_tagged_tag != step->cbor_path_step_argument)
+        return false;
+      *res = t.cbor_tagged_payload;
+      return true;
+    }
+  }
+}
+
+bool cbor_path_get(cbor c, cbor_path_step *path, size_t path_length, cbor *res)
+{
+  size_t i = (size_t)0U;
+  while (i < path_length && c.tag != CBOR_Case_Serialized)
+  {
+    if (!path_step(c, &path[i], &c))
+      return false;
+    i++;
+  }
+  if (i < path_length)
+  {
+    /* a single forward scan from here on */
+    uint8_t *a = c.case_CBOR_Case_Serialized.cbor_serialized_payload;
+    size_t len = c.case_CBOR_Case_Serialized.cbor_serialized_size;
+    for (; i < path_length; i++)
+    {
+      size_t off;
+      if (!path_step_raw(a, len, &path[i], &off))
+        return false;
+      a += off;
+      len -= off;
+    }
+    size_t n = cbor_raw_skip(a);
+    c =
+      (
+        (cbor){
+          .tag = CBOR_Case_Serialized,
+          { .case_CBOR_Case_Serialized = { .cbor_serialized_size = n, .cbor_serialized_payload = a } }
+        }
+      );
+  }
+  *res = c;
+  return true;
+}
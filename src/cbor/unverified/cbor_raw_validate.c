@@ -0,0 +1,73 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+/* An item that claims more children than there are bytes left cannot
+   be complete, but it is only reported as such if all the bytes left
+   are valid headers (or the beginning of one): otherwise it is invalid,
+   whatever data may follow. So the number of pending items is only
+   capped (at one more than the bytes left, which keeps it from
+   overflowing), and headers are read until the data runs out. */
+size_t cbor_raw_validate(uint8_t *a, size_t len, uint32_t *perr)
+{
+  size_t consumed = (size_t)0U;
+  size_t n = (size_t)1U;
+  uint32_t err;
+  while (n > (size_t)0U)
+  {
+    size_t rem = len - consumed;
+    cbor_raw_header h;
+    err = cbor_raw_header_read(a + consumed, rem, &h);
+    if (err != CBOR_RAW_VALID)
+      goto fail;
+    uint64_t x = h.cbor_raw_header_argument;
+    rem -= h.cbor_raw_header_size;
+    consumed += h.cbor_raw_header_size;
+    n--;
+    switch (h.cbor_raw_header_kind)
+    {
+      case CBOR_RAW_KIND_STRING:
+        if (x > (uint64_t)rem)
+        {
+          err = CBOR_RAW_NOT_ENOUGH_DATA;
+          goto fail;
+        }
+        consumed += (size_t)x;
+        break;
+      case CBOR_RAW_KIND_ARRAY:
+      case CBOR_RAW_KIND_MAP:
+      case CBOR_RAW_KIND_TAGGED:
+      {
+        uint64_t k = h.cbor_raw_header_kind == CBOR_RAW_KIND_TAGGED ? 1ULL : x;
+        size_t cap = rem + (size_t)1U;
+        if (h.cbor_raw_header_kind == CBOR_RAW_KIND_MAP && k <= (uint64_t)cap)
+          k += k;
+        if (n >= cap || k >= (uint64_t)(cap - n))
+          n = cap;
+        else
+          n += (size_t)k;
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return consumed;
+fail:
+  *perr = err;
+  return (size_t)0U;
+}
@@ -0,0 +1,201 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+/* Layout of the index.
+
+   Each array, map or tag with `k` children has a table of `2 * k + 2`
+   entries at some position `t` of the index:
+   - `index[t]` is `k`;
+   - `index[t + 1 + 2 * j]` is the offset of the `j`-th child in the
+     input, and `index[t + 2 + 2 * j]` is the position of its own table
+     plus one, or 0 if it is neither an array, a map nor a tag;
+   - `index[t + 1 + 2 * k]` is the offset of the end of the item.
+
+   Tables are allocated from the beginning of the index, in the order of
+   the headers. While an item is not complete, the last entry of its
+   table is the number of children seen so far, and the position of
+   its table is pushed on a stack at the end of the index, so that the
+   validator needs no other storage.
+
+   Every item takes at least one byte, so an input of `sz` bytes has at
+   most `sz` items: at most `2 * sz` entries for children, plus 2 table
+   entries and 1 stack entry per array, map or tag. */
+
+size_t cbor_read_indexed_index_length(size_t sz)
+{
+  return (size_t)5U * sz;
+}
+
+static cbor_read_indexed_t cbor_read_indexed_error(uint8_t *a, size_t sz)
+{
+  return
+    (
+      (cbor_read_indexed_t){
+        .cbor_read_indexed_is_success = false,
+        .cbor_read_indexed_payload = { .cbor_indexed_item_base = NULL },
+        .cbor_read_indexed_remainder = a,
+        .cbor_read_indexed_remainder_length = sz
+      }
+    );
+}
+
+cbor_read_indexed_t cbor_read_indexed(uint8_t *a, size_t sz, size_t *index, size_t index_length)
+{
+  size_t consumed = (size_t)0U;
+  size_t top = (size_t)0U;
+  size_t bottom = index_length;
+  size_t root = (size_t)0U;
+  do
+  {
+    cbor_raw_header h;
+    size_t leaf;
+    size_t k;
+    size_t len = sz - consumed;
+    if
+    (
+      cbor_raw_header_read(a + consumed, len, &h) != CBOR_RAW_VALID
+      || cbor_raw_leaf_size(&h, len, &leaf) != CBOR_RAW_VALID
+      || cbor_raw_child_count(&h, len - leaf, &k) != CBOR_RAW_VALID
+    )
+      return cbor_read_indexed_error(a, sz);
+    uint8_t kind = h.cbor_raw_header_kind;
+    bool is_container =
+      kind == CBOR_RAW_KIND_ARRAY || kind == CBOR_RAW_KIND_MAP || kind == CBOR_RAW_KIND_TAGGED;
+    size_t table = (size_t)0U;
+    if (is_container)
+    {
+      size_t n = k + k + (size_t)2U;
+      if (bottom - top < n)
+        return cbor_read_indexed_error(a, sz);
+      table = top + (size_t)1U;
+      index[top] = k;
+      index[top + n - (size_t)1U] = (size_t)0U;
+      top += n;
+    }
+    /* record this item in its parent */
+    if (bottom < index_length)
+    {
+      size_t t = index[bottom];
+      size_t last = t + (size_t)1U + index[t] + index[t];
+      size_t j = index[last];
+      index[t + (size_t)1U + j + j] = consumed;
+      index[t + (size_t)2U + j + j] = table;
+      index[last] = j + (size_t)1U;
+    }
+    else
+      root = table;
+    consumed += leaf;
+    if (k > (size_t)0U)
+    {
+      if (bottom == top)
+        return cbor_read_indexed_error(a, sz);
+      bottom--;
+      index[bottom] = table - (size_t)1U;
+    }
+    else if (is_container)
+      index[top - (size_t)1U] = consumed;
+    /* close all complete items */
+    while (bottom < index_length)
+    {
+      size_t t = index[bottom];
+      size_t last = t + (size_t)1U + index[t] + index[t];
+      if (index[last] < index[t])
+        break;
+      index[last] = consumed;
+      bottom++;
+    }
+  }
+  while (bottom < index_length);
+  return
+    (
+      (cbor_read_indexed_t){
+        .cbor_read_indexed_is_success = true,
+        .cbor_read_indexed_payload = {
+          .cbor_indexed_item_base = a,
+          .cbor_indexed_item_index = index,
+          .cbor_indexed_item_offset = (size_t)0U,
+          .cbor_indexed_item_size = consumed,
+          .cbor_indexed_item_table = root
+        },
+        .cbor_read_indexed_remainder = a + consumed,
+        .cbor_read_indexed_remainder_length = sz - consumed
+      }
+    );
+}
+
+cbor cbor_indexed_item_get(cbor_indexed_item x)
+{
+  return
+    (
+      (cbor){
+        .tag = CBOR_Case_Serialized,
+        {
+          .case_CBOR_Case_Serialized = {
+            .cbor_serialized_size = x.cbor_indexed_item_size,
+            .cbor_serialized_payload = x.cbor_indexed_item_base + x.cbor_indexed_item_offset
+          }
+        }
+      }
+    );
+}
+
+uint64_t cbor_indexed_item_length(cbor_indexed_item x)
+{
+  if (x.cbor_indexed_item_table == (size_t)0U)
+    return 0ULL;
+  size_t k = x.cbor_indexed_item_index[x.cbor_indexed_item_table - (size_t)1U];
+  if (x.cbor_indexed_item_base[x.cbor_indexed_item_offset] >> 5U == CBOR_MAJOR_TYPE_MAP)
+    return (uint64_t)(k / (size_t)2U);
+  else
+    return (uint64_t)k;
+}
+
+static cbor_indexed_item cbor_indexed_item_child(cbor_indexed_item x, size_t j)
+{
+  size_t *e = x.cbor_indexed_item_index + x.cbor_indexed_item_table + j + j;
+  return
+    (
+      (cbor_indexed_item){
+        .cbor_indexed_item_base = x.cbor_indexed_item_base,
+        .cbor_indexed_item_index = x.cbor_indexed_item_index,
+        .cbor_indexed_item_offset = e[0U],
+        .cbor_indexed_item_size = e[2U] - e[0U],
+        .cbor_indexed_item_table = e[1U]
+      }
+    );
+}
+
+cbor_indexed_item cbor_indexed_item_array_index(cbor_indexed_item x, size_t i)
+{
+  return cbor_indexed_item_child(x, i);
+}
+
+cbor_indexed_item cbor_indexed_item_map_key(cbor_indexed_item x, size_t i)
+{
+  return cbor_indexed_item_child(x, i + i);
+}
+
+cbor_indexed_item cbor_indexed_item_map_value(cbor_indexed_item x, size_t i)
+{
+  return cbor_indexed_item_child(x, i + i + (size_t)1U);
+}
+
+cbor_indexed_item cbor_indexed_item_tagged_payload(cbor_indexed_item x)
+{
+  return cbor_indexed_item_child(x, (size_t)0U);
+}
@@ -0,0 +1,56 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+cbor_read_sequence_t
+cbor_read_sequence(uint8_t *a, size_t sz, cbor *items, size_t *offsets, size_t n)
+{
+  size_t count = (size_t)0U;
+  size_t off = (size_t)0U;
+  uint32_t err = CBOR_RAW_VALID;
+  while (count < n && off < sz)
+  {
+    size_t len = cbor_raw_validate(a + off, sz - off, &err);
+    if (err != CBOR_RAW_VALID)
+      break;
+    items[count] =
+      (
+        (cbor){
+          .tag = CBOR_Case_Serialized,
+          {
+            .case_CBOR_Case_Serialized = {
+              .cbor_serialized_size = len,
+              .cbor_serialized_payload = a + off
+            }
+          }
+        }
+      );
+    if (offsets != NULL)
+      offsets[count] = off;
+    count++;
+    off += len;
+  }
+  return
+    (
+      (cbor_read_sequence_t){
+        .cbor_read_sequence_count = count,
+        .cbor_read_sequence_is_invalid = err == CBOR_RAW_INVALID,
+        .cbor_read_sequence_remainder = a + off,
+        .cbor_read_sequence_remainder_length = sz - off
+      }
+    );
+}
@@ -0,0 +1,138 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+/* Same worklist as `validate_raw_data_item_`: `pending` counts the data
+   items still to be read, and each header replaces one of them with
+   its children. The length checks of the verified validator that
+   depend on the size of the whole input are replaced with waiting for
+   more data. */
+
+void cbor_stream_validator_init(cbor_stream_validator *v)
+{
+  v->cbor_stream_validator_status = CBOR_STREAM_VALIDATOR_NEED_MORE_DATA;
+  v->cbor_stream_validator_pending = (size_t)1U;
+  v->cbor_stream_validator_skip = 0ULL;
+  v->cbor_stream_validator_consumed = 0ULL;
+  v->cbor_stream_validator_header_length = 0U;
+}
+
+uint64_t cbor_stream_validator_consumed(cbor_stream_validator *v)
+{
+  return v->cbor_stream_validator_consumed;
+}
+
+static bool process_header(cbor_stream_validator *v, cbor_raw_header *h)
+{
+  size_t pending = v->cbor_stream_validator_pending - (size_t)1U;
+  uint64_t x = h->cbor_raw_header_argument;
+  switch (h->cbor_raw_header_kind)
+  {
+    case CBOR_RAW_KIND_STRING:
+      v->cbor_stream_validator_skip = x;
+      x = 0ULL;
+      break;
+    case CBOR_RAW_KIND_ARRAY:
+      break;
+    case CBOR_RAW_KIND_MAP:
+      if (x > (uint64_t)(SIZE_MAX / (size_t)2U))
+        return false;
+      x += x;
+      break;
+    case CBOR_RAW_KIND_TAGGED:
+      x = 1ULL;
+      break;
+    default:
+      x = 0ULL;
+      break;
+  }
+  if (x > (uint64_t)(SIZE_MAX - pending))
+    return false;
+  v->cbor_stream_validator_pending = pending + (size_t)x;
+  return true;
+}
+
+cbor_stream_validator_status
+cbor_stream_validator_feed(cbor_stream_validator *v, uint8_t *chunk, size_t len, size_t *pos)
+{
+  size_t i = (size_t)0U;
+  uint8_t *hd = v->cbor_stream_validator_header;
+  while
+  (
+    v->cbor_stream_validator_status == CBOR_STREAM_VALIDATOR_NEED_MORE_DATA
+    && (v->cbor_stream_validator_pending > (size_t)0U || v->cbor_stream_validator_skip > 0ULL)
+    && i < len
+  )
+  {
+    size_t avail = len - i;
+    if (v->cbor_stream_validator_skip > 0ULL)
+    {
+      /* string payload */
+      size_t n = avail;
+      if ((uint64_t)n > v->cbor_stream_validator_skip)
+        n = (size_t)v->cbor_stream_validator_skip;
+      v->cbor_stream_validator_skip -= (uint64_t)n;
+      i += n;
+      continue;
+    }
+    cbor_raw_header h;
+    uint32_t res;
+    size_t hl = (size_t)v->cbor_stream_validator_header_length;
+    if (hl == (size_t)0U)
+    {
+      /* the usual case: the whole header is in this chunk */
+      res = cbor_raw_header_read(chunk + i, avail, &h);
+      if (res == CBOR_RAW_NOT_ENOUGH_DATA)
+      {
+        memcpy(hd, chunk + i, avail);
+        v->cbor_stream_validator_header_length = (uint8_t)avail;
+        i = len;
+        continue;
+      }
+      if (res == CBOR_RAW_VALID)
+        i += h.cbor_raw_header_size;
+    }
+    else
+    {
+      /* complete a header split across chunks */
+      size_t n =
+        (size_t)1U + (size_t)cbor_raw_initial_byte_decode(hd[0U]).cbor_raw_initial_byte_argument_size - hl;
+      if (n > avail)
+        n = avail;
+      memcpy(hd + hl, chunk + i, n);
+      i += n;
+      hl += n;
+      v->cbor_stream_validator_header_length = (uint8_t)hl;
+      res = cbor_raw_header_read(hd, hl, &h);
+      if (res == CBOR_RAW_NOT_ENOUGH_DATA)
+        continue;
+      v->cbor_stream_validator_header_length = 0U;
+    }
+    if (res != CBOR_RAW_VALID || !process_header(v, &h))
+      v->cbor_stream_validator_status = CBOR_STREAM_VALIDATOR_ERROR;
+  }
+  v->cbor_stream_validator_consumed += (uint64_t)i;
+  if
+  (
+    v->cbor_stream_validator_status == CBOR_STREAM_VALIDATOR_NEED_MORE_DATA
+    && v->cbor_stream_validator_pending == (size_t)0U
+    && v->cbor_stream_validator_skip == 0ULL
+  )
+    v->cbor_stream_validator_status = CBOR_STREAM_VALIDATOR_COMPLETE;
+  *pos = i;
+  return v->cbor_stream_validator_status;
+}
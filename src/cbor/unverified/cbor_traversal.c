@@ -0,0 +1,605 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+/* A frame counts the children of its array, map or tag that are still
+   to be visited, keys and values of maps counted separately. Children
+   are read with the iterators of the verified implementation, so that
+   serialized and constructed items are traversed the same way. `side`
+   selects which of the two data items being compared the child is
+   taken from; size and write only use side 0. */
+
+static void frame_init(cbor_traversal_frame *f, size_t side, cbor c, uint8_t ty)
+{
+  f->cbor_traversal_frame_type = ty;
+  switch (ty)
+  {
+    case CBOR_MAJOR_TYPE_ARRAY:
+      f->cbor_traversal_frame_remaining = cbor_array_length(c);
+      f->cbor_traversal_frame_array[side] = cbor_array_iterator_init(c);
+      break;
+    case CBOR_MAJOR_TYPE_MAP:
+      f->cbor_traversal_frame_remaining = cbor_map_length(c) * 2ULL;
+      f->cbor_traversal_frame_map[side] = cbor_map_iterator_init(c);
+      break;
+    default:
+      f->cbor_traversal_frame_remaining = 1ULL;
+      f->cbor_traversal_frame_next[side] = cbor_destr_tagged(c).cbor_tagged_payload;
+      break;
+  }
+}
+
+/* Must be called on both sides before `frame_done`, since the map case
+   depends on the parity of the remaining count. */
+static cbor frame_child(cbor_traversal_frame *f, size_t side)
+{
+  switch (f->cbor_traversal_frame_type)
+  {
+    case CBOR_MAJOR_TYPE_ARRAY:
+      return cbor_array_iterator_next(&f->cbor_traversal_frame_array[side]);
+    case CBOR_MAJOR_TYPE_MAP:
+      if (f->cbor_traversal_frame_remaining % 2ULL == 0ULL)
+      {
+        cbor_map_entry e = cbor_map_iterator_next(&f->cbor_traversal_frame_map[side]);
+        f->cbor_traversal_frame_next[side] = cbor_map_entry_value(e);
+        return cbor_map_entry_key(e);
+      }
+      else
+        return f->cbor_traversal_frame_next[side];
+    default:
+      return f->cbor_traversal_frame_next[side];
+  }
+}
+
+static void frame_done(cbor_traversal_frame *f)
+{
+  f->cbor_traversal_frame_remaining--;
+}
+
+/* Returns the next child of the innermost frame that has any left,
+   popping the others, or false if the traversal is complete. */
+static bool next_child(cbor_traversal_frame *stack, size_t *top, cbor *c)
+{
+  while (*top > (size_t)0U)
+  {
+    cbor_traversal_frame *f = &stack[*top - (size_t)1U];
+    if (f->cbor_traversal_frame_remaining > 0ULL)
+    {
+      *c = frame_child(f, (size_t)0U);
+      frame_done(f);
+      return true;
+    }
+    (*top)--;
+  }
+  return false;
+}
+
+/* Header and (for strings and serialized items) payload of `c`, and
+   its major type if it is a constructed array, map or tag whose
+   children are still to be visited. Serialized items are leaves. */
+typedef struct leaf_s
+{
+  uint8_t leaf_type;
+  uint64_t leaf_argument;
+  uint8_t *leaf_payload;
+  size_t leaf_payload_length;
+  bool leaf_has_children;
+}
+leaf;
+
+static leaf leaf_of(cbor c)
+{
+  leaf l;
+  l.leaf_payload = NULL;
+  l.leaf_payload_length = (size_t)0U;
+  l.leaf_has_children = false;
+  switch (c.tag)
+  {
+    case CBOR_Case_Int64:
+    {
+      l.leaf_type = c.case_CBOR_Case_Int64.cbor_int_type;
+      l.leaf_argument = c.case_CBOR_Case_Int64.cbor_int_value;
+      break;
+    }
+    case CBOR_Case_Simple_value:
+    {
+      l.leaf_type = CBOR_MAJOR_TYPE_SIMPLE_VALUE;
+      l.leaf_argument = (uint64_t)c.case_CBOR_Case_Simple_value;
+      break;
+    }
+    case CBOR_Case_String:
+    {
+      cbor_string s = c.case_CBOR_Case_String;
+      l.leaf_type = s.cbor_string_type;
+      l.leaf_argument = s.cbor_string_length;
+      l.leaf_payload = s.cbor_string_payload;
+      l.leaf_payload_length = (size_t)s.cbor_string_length;
+      break;
+    }
+    case CBOR_Case_Tagged:
+    {
+      l.leaf_type = CBOR_MAJOR_TYPE_TAGGED;
+      l.leaf_argument = c.case_CBOR_Case_Tagged.cbor_tagged0_tag;
+      l.leaf_has_children = true;
+      break;
+    }
+    case CBOR_Case_Array:
+    {
+      l.leaf_type = CBOR_MAJOR_TYPE_ARRAY;
+      l.leaf_argument = c.case_CBOR_Case_Array.cbor_array_length;
+      l.leaf_has_children = l.leaf_argument > 0ULL;
+      break;
+    }
+    case CBOR_Case_Map:
+    {
+      l.leaf_type = CBOR_MAJOR_TYPE_MAP;
+      l.leaf_argument = c.case_CBOR_Case_Map.cbor_map_length;
+      l.leaf_has_children = l.leaf_argument > 0ULL;
+      break;
+    }
+    default:
+    {
+      /* no header: the payload is the whole encoding */
+      l.leaf_type = CBOR_MAJOR_TYPE_SIMPLE_VALUE;
+      l.leaf_argument = 0ULL;
+      l.leaf_payload = c.case_CBOR_Case_Serialized.cbor_serialized_payload;
+      l.leaf_payload_length = c.case_CBOR_Case_Serialized.cbor_serialized_size;
+      break;
+    }
+  }
+  return l;
+}
+
+/* Size and write share the same loop; `out` is NULL for size. If
+   `bounded`, the loop stops as soon as the encoding exceeds `sz`;
+   otherwise, it stops writing but goes on counting, so that `*res` is
+   the size needed, saturated to `SIZE_MAX`. */
+static cbor_traversal_status
+encode_with_stack(
+  cbor c,
+  uint8_t *out,
+  size_t sz,
+  bool bounded,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+)
+{
+  size_t top = (size_t)0U;
+  size_t pos = (size_t)0U;
+  cbor_traversal_status status = CBOR_TRAVERSAL_SUCCESS;
+  do
+  {
+    leaf l = leaf_of(c);
+    size_t hs = (size_t)0U;
+    if (c.tag != CBOR_Case_Serialized)
+      hs = cbor_raw_header_size(l.leaf_argument);
+    size_t n = hs + l.leaf_payload_length;
+    if (n > sz - pos)
+    {
+      if (bounded)
+        return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+      if (status == CBOR_TRAVERSAL_SUCCESS)
+      {
+        status = CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+        out = NULL;
+        sz = SIZE_MAX;
+      }
+      if (n > sz - pos)
+        n = sz - pos;
+    }
+    if (out != NULL)
+    {
+      if (hs > (size_t)0U)
+        cbor_raw_header_write(l.leaf_type, l.leaf_argument, out + pos);
+      if (l.leaf_payload_length > (size_t)0U)
+        memcpy(out + pos + hs, l.leaf_payload, l.leaf_payload_length);
+    }
+    pos += n;
+    if (l.leaf_has_children)
+    {
+      if (top == stack_length)
+        return CBOR_TRAVERSAL_MAX_DEPTH;
+      frame_init(&stack[top], (size_t)0U, c, l.leaf_type);
+      top++;
+    }
+  }
+  while (next_child(stack, &top, &c));
+  *res = pos;
+  return status;
+}
+
+cbor_traversal_status
+cbor_size_with_stack(
+  cbor c,
+  size_t sz,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+)
+{
+  return encode_with_stack(c, NULL, sz, true, stack, stack_length, res);
+}
+
+cbor_traversal_status
+cbor_write_with_stack(
+  cbor c,
+  uint8_t *out,
+  size_t sz,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+)
+{
+  return encode_with_stack(c, out, sz, false, stack, stack_length, res);
+}
+
+cbor_traversal_status
+cbor_encoded_size(cbor c, cbor_traversal_frame *stack, size_t stack_length, size_t *res)
+{
+  cbor_traversal_status status =
+    encode_with_stack(c, NULL, SIZE_MAX, false, stack, stack_length, res);
+  /* with no bound, overflowing means that the size saturated */
+  if (status == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL)
+    return CBOR_TRAVERSAL_SUCCESS;
+  return status;
+}
+
+static int16_t compare_uint64(uint64_t x1, uint64_t x2)
+{
+  if (x1 == x2)
+    return (int16_t)0;
+  else if (x1 < x2)
+    return (int16_t)-1;
+  else
+    return (int16_t)1;
+}
+
+/* The non-recursive part of `CBOR_Pulse_cbor_compare`: compares `c1`
+   and `c2` up to their children, and sets `*has_children` if the
+   result depends on them. */
+static int16_t compare_node(cbor c1, cbor c2, uint8_t *pty, bool *has_children)
+{
+  *has_children = false;
+  int16_t test = cbor_compare_aux(c1, c2);
+  if (test == (int16_t)-1 || test == (int16_t)0 || test == (int16_t)1)
+    return test;
+  uint8_t ty1 = cbor_get_major_type(c1);
+  uint8_t ty2 = cbor_get_major_type(c2);
+  *pty = ty1;
+  if (ty1 != ty2)
+    return ty1 < ty2 ? (int16_t)-1 : (int16_t)1;
+  switch (ty1)
+  {
+    case CBOR_MAJOR_TYPE_UINT64:
+    case CBOR_MAJOR_TYPE_NEG_INT64:
+      return compare_uint64(cbor_destr_int64(c1).cbor_int_value, cbor_destr_int64(c2).cbor_int_value);
+    case CBOR_MAJOR_TYPE_SIMPLE_VALUE:
+      return
+        compare_uint64((uint64_t)cbor_destr_simple_value(c1),
+          (uint64_t)cbor_destr_simple_value(c2));
+    case CBOR_MAJOR_TYPE_BYTE_STRING:
+    case CBOR_MAJOR_TYPE_TEXT_STRING:
+    {
+      cbor_string s1 = cbor_destr_string(c1);
+      cbor_string s2 = cbor_destr_string(c2);
+      int16_t c = compare_uint64(s1.cbor_string_length, s2.cbor_string_length);
+      if (c != (int16_t)0)
+        return c;
+      return
+        cbor_bytes_lex_compare((size_t)s1.cbor_string_length,
+          s1.cbor_string_payload,
+          (size_t)s2.cbor_string_length,
+          s2.cbor_string_payload);
+    }
+    case CBOR_MAJOR_TYPE_ARRAY:
+    {
+      uint64_t len = cbor_array_length(c1);
+      int16_t c = compare_uint64(len, cbor_array_length(c2));
+      *has_children = c == (int16_t)0 && len > 0ULL;
+      return c;
+    }
+    case CBOR_MAJOR_TYPE_MAP:
+    {
+      uint64_t len = cbor_map_length(c1);
+      int16_t c = compare_uint64(len, cbor_map_length(c2));
+      *has_children = c == (int16_t)0 && len > 0ULL;
+      return c;
+    }
+    case CBOR_MAJOR_TYPE_TAGGED:
+    {
+      int16_t
+      c =
+        compare_uint64(cbor_destr_tagged(c1).cbor_tagged_tag,
+          cbor_destr_tagged(c2).cbor_tagged_tag);
+      *has_children = c == (int16_t)0;
+      return c;
+    }
+    default:
+      return (int16_t)2;
+  }
+}
+
+cbor_traversal_status
+cbor_compare_with_stack(
+  cbor c1,
+  cbor c2,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  int16_t *res
+)
+{
+  size_t top = (size_t)0U;
+  while (true)
+  {
+    uint8_t ty = 0U;
+    bool has_children;
+    int16_t c = compare_node(c1, c2, &ty, &has_children);
+    if (c != (int16_t)0)
+    {
+      *res = c;
+      return CBOR_TRAVERSAL_SUCCESS;
+    }
+    if (has_children)
+    {
+      if (top == stack_length)
+        return CBOR_TRAVERSAL_MAX_DEPTH;
+      frame_init(&stack[top], (size_t)0U, c1, ty);
+      frame_init(&stack[top], (size_t)1U, c2, ty);
+      top++;
+    }
+    while (top > (size_t)0U && stack[top - (size_t)1U].cbor_traversal_frame_remaining == 0ULL)
+      top--;
+    if (top == (size_t)0U)
+    {
+      *res = (int16_t)0;
+      return CBOR_TRAVERSAL_SUCCESS;
+    }
+    cbor_traversal_frame *f = &stack[top - (size_t)1U];
+    c1 = frame_child(f, (size_t)0U);
+    c2 = frame_child(f, (size_t)1U);
+    frame_done(f);
+  }
+}
+
+/* Appends `len` bytes at `p` to the list, extending the last entry if
+   `p` directly follows it. */
+static bool iovec_append(struct iovec *iov, size_t iov_length, size_t *n, uint8_t *p, size_t len)
+{
+  if (len == (size_t)0U)
+    return true;
+  if (*n > (size_t)0U)
+  {
+    struct iovec *last = &iov[*n - (size_t)1U];
+    if ((uint8_t *)last->iov_base + last->iov_len == p)
+    {
+      last->iov_len += len;
+      return true;
+    }
+  }
+  if (*n == iov_length)
+    return false;
+  iov[*n].iov_base = p;
+  iov[*n].iov_len = len;
+  (*n)++;
+  return true;
+}
+
+cbor_traversal_status
+cbor_write_iovec(
+  cbor c,
+  uint8_t *scratch,
+  size_t scratch_length,
+  struct iovec *iov,
+  size_t iov_length,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *iov_count
+)
+{
+  size_t top = (size_t)0U;
+  size_t pos = (size_t)0U;
+  size_t n = (size_t)0U;
+  do
+  {
+    leaf l = leaf_of(c);
+    uint8_t *start = scratch + pos;
+    if (c.tag != CBOR_Case_Serialized)
+    {
+      size_t hs = cbor_raw_header_size(l.leaf_argument);
+      if (hs > scratch_length - pos)
+        return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+      cbor_raw_header_write(l.leaf_type, l.leaf_argument, scratch + pos);
+      pos += hs;
+    }
+    if (l.leaf_payload_length <= (size_t)CBOR_WRITE_IOVEC_COPY_THRESHOLD)
+    {
+      if (l.leaf_payload_length > scratch_length - pos)
+        return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+      if (l.leaf_payload_length > (size_t)0U)
+        memcpy(scratch + pos, l.leaf_payload, l.leaf_payload_length);
+      pos += l.leaf_payload_length;
+      if (!iovec_append(iov, iov_length, &n, start, (size_t)(scratch + pos - start)))
+        return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+    }
+    else if
+    (
+      !iovec_append(iov, iov_length, &n, start, (size_t)(scratch + pos - start))
+      || !iovec_append(iov, iov_length, &n, l.leaf_payload, l.leaf_payload_length)
+    )
+      return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+    if (l.leaf_has_children)
+    {
+      if (top == stack_length)
+        return CBOR_TRAVERSAL_MAX_DEPTH;
+      frame_init(&stack[top], (size_t)0U, c, l.leaf_type);
+      top++;
+    }
+  }
+  while (next_child(stack, &top, &c));
+  *iov_count = n;
+  return CBOR_TRAVERSAL_SUCCESS;
+}
+
+/* Copies `len` bytes into `o`, calling its callback whenever the
+   buffer is full. */
+static bool output_put(cbor_output *o, uint8_t *p, size_t len)
+{
+  while (len > (size_t)0U)
+  {
+    if (o->cbor_output_position == o->cbor_output_length)
+    {
+      if (!o->cbor_output_next(o, len) || o->cbor_output_position >= o->cbor_output_length)
+        return false;
+    }
+    size_t n = o->cbor_output_length - o->cbor_output_position;
+    if (n > len)
+      n = len;
+    memcpy(o->cbor_output_buffer + o->cbor_output_position, p, n);
+    o->cbor_output_position += n;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+cbor_traversal_status
+cbor_output_write(cbor c, cbor_output *o, cbor_traversal_frame *stack, size_t stack_length)
+{
+  size_t top = (size_t)0U;
+  do
+  {
+    leaf l = leaf_of(c);
+    if (c.tag != CBOR_Case_Serialized)
+    {
+      size_t hs = cbor_raw_header_size(l.leaf_argument);
+      if (o->cbor_output_length - o->cbor_output_position >= hs)
+      {
+        /* fast path: no call to the callback */
+        cbor_raw_header_write(l.leaf_type, l.leaf_argument, o->cbor_output_buffer + o->cbor_output_position);
+        o->cbor_output_position += hs;
+      }
+      else
+      {
+        uint8_t header[CBOR_RAW_MAX_HEADER_SIZE];
+        cbor_raw_header_write(l.leaf_type, l.leaf_argument, header);
+        if (!output_put(o, header, hs))
+          return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+      }
+    }
+    if (!output_put(o, l.leaf_payload, l.leaf_payload_length))
+      return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+    if (l.leaf_has_children)
+    {
+      if (top == stack_length)
+        return CBOR_TRAVERSAL_MAX_DEPTH;
+      frame_init(&stack[top], (size_t)0U, c, l.leaf_type);
+      top++;
+    }
+  }
+  while (next_child(stack, &top, &c));
+  return CBOR_TRAVERSAL_SUCCESS;
+}
+
+/* Right-to-left writing only needs `cbor_traversal_frame_next[0U]`,
+   which holds the array, map or tag itself: since children are visited
+   last first, they are taken from its payload by index. */
+static cbor r2l_child(cbor_traversal_frame *f)
+{
+  cbor c = f->cbor_traversal_frame_next[0U];
+  uint64_t i = f->cbor_traversal_frame_remaining;
+  switch (c.tag)
+  {
+    case CBOR_Case_Array:
+      return c.case_CBOR_Case_Array.cbor_array_payload[i];
+    case CBOR_Case_Map:
+    {
+      cbor_map_entry e = c.case_CBOR_Case_Map.cbor_map_payload[i / 2ULL];
+      return i % 2ULL == 0ULL ? e.cbor_map_entry_key : e.cbor_map_entry_value;
+    }
+    default:
+      return *c.case_CBOR_Case_Tagged.cbor_tagged0_payload;
+  }
+}
+
+/* Writes the header of `l` just before `*pos`, and its payload
+   before that. */
+static bool r2l_leaf(cbor c, leaf l, uint8_t *out, size_t *pos)
+{
+  if (l.leaf_payload_length > *pos)
+    return false;
+  *pos -= l.leaf_payload_length;
+  if (l.leaf_payload_length > (size_t)0U)
+    memcpy(out + *pos, l.leaf_payload, l.leaf_payload_length);
+  if (c.tag == CBOR_Case_Serialized)
+    return true;
+  size_t hs = cbor_raw_header_size(l.leaf_argument);
+  if (hs > *pos)
+    return false;
+  *pos -= hs;
+  cbor_raw_header_write(l.leaf_type, l.leaf_argument, out + *pos);
+  return true;
+}
+
+cbor_traversal_status
+cbor_r2l_write(
+  cbor c,
+  uint8_t *out,
+  size_t sz,
+  cbor_traversal_frame *stack,
+  size_t stack_length,
+  size_t *res
+)
+{
+  size_t top = (size_t)0U;
+  size_t pos = sz;
+  while (true)
+  {
+    leaf l = leaf_of(c);
+    if (l.leaf_has_children)
+    {
+      if (top == stack_length)
+        return CBOR_TRAVERSAL_MAX_DEPTH;
+      cbor_traversal_frame *f = &stack[top];
+      f->cbor_traversal_frame_type = l.leaf_type;
+      f->cbor_traversal_frame_remaining =
+        l.leaf_type == CBOR_MAJOR_TYPE_MAP ? l.leaf_argument * 2ULL
+        : l.leaf_type == CBOR_MAJOR_TYPE_ARRAY ? l.leaf_argument
+        : 1ULL;
+      f->cbor_traversal_frame_next[0U] = c;
+      top++;
+    }
+    else if (!r2l_leaf(c, l, out, &pos))
+      return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+    /* headers of the complete items go before their children */
+    while (top > (size_t)0U && stack[top - (size_t)1U].cbor_traversal_frame_remaining == 0ULL)
+    {
+      cbor p = stack[top - (size_t)1U].cbor_traversal_frame_next[0U];
+      if (!r2l_leaf(p, leaf_of(p), out, &pos))
+        return CBOR_TRAVERSAL_OUTPUT_TOO_SMALL;
+      top--;
+    }
+    if (top == (size_t)0U)
+    {
+      *res = pos;
+      return CBOR_TRAVERSAL_SUCCESS;
+    }
+    cbor_traversal_frame *f = &stack[top - (size_t)1U];
+    f->cbor_traversal_frame_remaining--;
+    c = r2l_child(f);
+  }
+}
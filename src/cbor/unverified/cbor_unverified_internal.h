@@ -0,0 +1,425 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __cbor_unverified_internal_H
+#define __cbor_unverified_internal_H
+
+#include <string.h>
+#include "CBOR_Unverified.h"
+
+/* Raw CBOR headers, as encoded by the verified serializer: the argument
+   always uses the shortest possible encoding. */
+
+#define CBOR_RAW_MAX_HEADER_SIZE (9U)
+
+static inline size_t cbor_raw_header_size(uint64_t x)
+{
+  if (x < 24ULL)
+    return (size_t)1U;
+  else if (x < 256ULL)
+    return (size_t)2U;
+  else if (x < 65536ULL)
+    return (size_t)3U;
+  else if (x < 4294967296ULL)
+    return (size_t)5U;
+  else
+    return (size_t)9U;
+}
+
+/* Writes the header into `out`, which must have room for
+   `cbor_raw_header_size(x)` bytes, and returns its size. Simple values
+   are encoded as headers of major type 7. */
+static inline size_t cbor_raw_header_write(uint8_t ty, uint64_t x, uint8_t *out)
+{
+  uint8_t t = (uint8_t)(ty << 5U);
+  size_t sz = cbor_raw_header_size(x);
+  switch (sz)
+  {
+    case 1U:
+      out[0U] = t | (uint8_t)x;
+      break;
+    case 2U:
+      out[0U] = t | 24U;
+      break;
+    case 3U:
+      out[0U] = t | 25U;
+      break;
+    case 5U:
+      out[0U] = t | 26U;
+      break;
+    default:
+      out[0U] = t | 27U;
+      break;
+  }
+  for (size_t i = (size_t)1U; i < sz; i++)
+    out[i] = (uint8_t)(x >> (8U * (sz - (size_t)1U - i)));
+  return sz;
+}
+
+/* Decoding of the initial byte of a header. `CBOR_RAW_KIND_INVALID`
+   covers reserved additional information, indefinite lengths, and
+   floating-point numbers, which the verified validator rejects. */
+
+#define CBOR_RAW_KIND_INVALID (0U)
+
+#define CBOR_RAW_KIND_LEAF (1U)
+
+#define CBOR_RAW_KIND_STRING (2U)
+
+#define CBOR_RAW_KIND_ARRAY (3U)
+
+#define CBOR_RAW_KIND_MAP (4U)
+
+#define CBOR_RAW_KIND_TAGGED (5U)
+
+/* The major type, the size of the argument after the initial byte, the
+   kind, and, for 1-byte arguments, the least value that the verified
+   validator accepts (24, or 32 for simple values). */
+typedef struct cbor_raw_initial_byte_s
+{
+  uint8_t cbor_raw_initial_byte_major_type;
+  uint8_t cbor_raw_initial_byte_argument_size;
+  uint8_t cbor_raw_initial_byte_kind;
+  uint8_t cbor_raw_initial_byte_min_uint8;
+}
+cbor_raw_initial_byte;
+
+static inline cbor_raw_initial_byte cbor_raw_initial_byte_decode(uint8_t b)
+{
+  uint8_t ty = (uint8_t)(b >> 5U);
+  uint8_t ai = (uint8_t)(b & 31U);
+  cbor_raw_initial_byte d = {
+    .cbor_raw_initial_byte_major_type = ty,
+    .cbor_raw_initial_byte_argument_size = 0U,
+    .cbor_raw_initial_byte_kind = CBOR_RAW_KIND_INVALID,
+    .cbor_raw_initial_byte_min_uint8 = 0U
+  };
+  if (ai >= 28U || (ty == CBOR_MAJOR_TYPE_SIMPLE_VALUE && ai > 24U))
+    return d;
+  if (ai >= 24U)
+    d.cbor_raw_initial_byte_argument_size = (uint8_t)(1U << (ai - 24U));
+  if (ai == 24U)
+    d.cbor_raw_initial_byte_min_uint8 = ty == CBOR_MAJOR_TYPE_SIMPLE_VALUE ? 32U : 24U;
+  switch (ty)
+  {
+    case CBOR_MAJOR_TYPE_BYTE_STRING:
+    case CBOR_MAJOR_TYPE_TEXT_STRING:
+      d.cbor_raw_initial_byte_kind = CBOR_RAW_KIND_STRING;
+      break;
+    case CBOR_MAJOR_TYPE_ARRAY:
+      d.cbor_raw_initial_byte_kind = CBOR_RAW_KIND_ARRAY;
+      break;
+    case CBOR_MAJOR_TYPE_MAP:
+      d.cbor_raw_initial_byte_kind = CBOR_RAW_KIND_MAP;
+      break;
+    case CBOR_MAJOR_TYPE_TAGGED:
+      d.cbor_raw_initial_byte_kind = CBOR_RAW_KIND_TAGGED;
+      break;
+    default:
+      d.cbor_raw_initial_byte_kind = CBOR_RAW_KIND_LEAF;
+      break;
+  }
+  return d;
+}
+
+static inline uint64_t cbor_raw_argument_min(cbor_raw_initial_byte d)
+{
+  switch (d.cbor_raw_initial_byte_argument_size)
+  {
+    case 1U:
+      return (uint64_t)d.cbor_raw_initial_byte_min_uint8;
+    case 2U:
+      return 256ULL;
+    case 4U:
+      return 65536ULL;
+    default:
+      return 4294967296ULL;
+  }
+}
+
+/* Reads the header at `a`, of which `len` bytes are available, with the
+   same checks as the verified validator (`validate_raw_data_item`):
+   arguments must use the shortest possible encoding, simple values with
+   a 1-byte argument must be at least 32, and floating-point numbers,
+   reserved additional information and indefinite lengths are
+   rejected. Returns `CBOR_RAW_VALID` and fills `h`, or an error. */
+
+#define CBOR_RAW_VALID (0U)
+
+#define CBOR_RAW_NOT_ENOUGH_DATA (1U)
+
+#define CBOR_RAW_INVALID (2U)
+
+typedef struct cbor_raw_header_s
+{
+  uint8_t cbor_raw_header_major_type;
+  uint8_t cbor_raw_header_kind;
+  uint64_t cbor_raw_header_argument;
+  size_t cbor_raw_header_size;
+}
+cbor_raw_header;
+
+static inline uint32_t cbor_raw_header_read(uint8_t *a, size_t len, cbor_raw_header *h)
+{
+  if (len < (size_t)1U)
+    return CBOR_RAW_NOT_ENOUGH_DATA;
+  cbor_raw_initial_byte d = cbor_raw_initial_byte_decode(a[0U]);
+  if (d.cbor_raw_initial_byte_kind == CBOR_RAW_KIND_INVALID)
+    return CBOR_RAW_INVALID;
+  size_t n = (size_t)d.cbor_raw_initial_byte_argument_size;
+  if (len - (size_t)1U < n)
+    return CBOR_RAW_NOT_ENOUGH_DATA;
+  uint64_t x = (uint64_t)(a[0U] & 31U);
+  if (n > (size_t)0U)
+  {
+    x = 0ULL;
+    for (size_t i = (size_t)1U; i <= n; i++)
+      x = x << 8U | (uint64_t)a[i];
+    if (x < cbor_raw_argument_min(d))
+      return CBOR_RAW_INVALID;
+  }
+  h->cbor_raw_header_major_type = d.cbor_raw_initial_byte_major_type;
+  h->cbor_raw_header_kind = d.cbor_raw_initial_byte_kind;
+  h->cbor_raw_header_argument = x;
+  h->cbor_raw_header_size = (size_t)1U + n;
+  return CBOR_RAW_VALID;
+}
+
+/* Size of the item with header `h` excluding its children (i.e. the
+   header, and the payload of strings), checking it against the `len`
+   available bytes. */
+static inline uint32_t cbor_raw_leaf_size(cbor_raw_header *h, size_t len, size_t *res)
+{
+  size_t sz = h->cbor_raw_header_size;
+  if (h->cbor_raw_header_kind == CBOR_RAW_KIND_STRING)
+  {
+    if (h->cbor_raw_header_argument > (uint64_t)(len - sz))
+      return CBOR_RAW_NOT_ENOUGH_DATA;
+    sz += (size_t)h->cbor_raw_header_argument;
+  }
+  *res = sz;
+  return CBOR_RAW_VALID;
+}
+
+/* Number of children of the item with header `h`: elements of an array,
+   keys and values of a map, payload of a tag. Since each child takes
+   at least one byte, it is an error if there are more than `len`. */
+static inline uint32_t cbor_raw_child_count(cbor_raw_header *h, size_t len, size_t *res)
+{
+  uint64_t x = h->cbor_raw_header_argument;
+  switch (h->cbor_raw_header_kind)
+  {
+    case CBOR_RAW_KIND_ARRAY:
+      break;
+    case CBOR_RAW_KIND_MAP:
+      if (x > (uint64_t)len / 2ULL)
+        return CBOR_RAW_NOT_ENOUGH_DATA;
+      x += x;
+      break;
+    case CBOR_RAW_KIND_TAGGED:
+      x = 1ULL;
+      break;
+    default:
+      x = 0ULL;
+      break;
+  }
+  if (x > (uint64_t)len)
+    return CBOR_RAW_NOT_ENOUGH_DATA;
+  *res = (size_t)x;
+  return CBOR_RAW_VALID;
+}
+
+/* Size of the valid data item at the beginning of `a`, looking only at
+   headers and string lengths, without bounds checks (as
+   `jump_raw_data_item` in the verified code.) Leaves are skipped
+   without reading their argument. */
+static inline size_t cbor_raw_skip(uint8_t *a)
+{
+  size_t off = (size_t)0U;
+  size_t n = (size_t)1U;
+  do
+  {
+    uint8_t b = a[off];
+    uint8_t ai = b & 31U;
+    size_t hs = ai < 24U ? (size_t)1U : (size_t)1U + ((size_t)1U << (ai - 24U));
+    uint8_t kind = cbor_raw_initial_byte_decode(b).cbor_raw_initial_byte_kind;
+    n--;
+    if (kind != CBOR_RAW_KIND_LEAF)
+    {
+      uint64_t x = (uint64_t)ai;
+      if (hs > (size_t)1U)
+      {
+        x = 0ULL;
+        for (size_t i = (size_t)1U; i < hs; i++)
+          x = x << 8U | (uint64_t)a[off + i];
+      }
+      switch (kind)
+      {
+        case CBOR_RAW_KIND_STRING:
+          off += (size_t)x;
+          break;
+        case CBOR_RAW_KIND_ARRAY:
+          n += (size_t)x;
+          break;
+        case CBOR_RAW_KIND_MAP:
+          n += (size_t)(x + x);
+          break;
+        default:
+          n++;
+          break;
+      }
+    }
+    off += hs;
+  }
+  while (n > (size_t)0U);
+  return off;
+}
+
+/* The worklist loop of `validate_raw_data_item_`, with the checks
+   above: returns the size of the data item at the beginning of `a`, or
+   sets `*perr` to `CBOR_RAW_NOT_ENOUGH_DATA` if it is truncated, or to
+   `CBOR_RAW_INVALID`. */
+size_t cbor_raw_validate(uint8_t *a, size_t len, uint32_t *perr);
+
+/* 64-bit FNV-1a hash of the deterministic encoding of `c`, computed
+   without materializing the encoding. Equal values (in the sense of
+   `CBOR_Pulse_cbor_is_equal`) have equal hashes, whether serialized or
+   not. */
+uint64_t cbor_hash(cbor c);
+
+/* Instructions of a `cddl_program`. Types and groups have distinct
+   opcodes; the kind of each instruction records whether it is a type,
+   an array group, a map group, or a group that fits both (`GNop` and
+   `GAlwaysFalse`.) */
+
+#define CDDL_KIND_TYPE (0U)
+
+#define CDDL_KIND_GROUP (1U)
+
+#define CDDL_KIND_ARRAY_GROUP (2U)
+
+#define CDDL_KIND_MAP_GROUP (3U)
+
+/* the key table of a `TMap` */
+#define CDDL_KIND_KEYS (4U)
+
+/* `argument` is one of `CDDL_ELEM_*`, except `ELiteral` */
+#define CDDL_OP_TELEM (0U)
+
+/* the encoding of the literal is at offset `left` in the literals of
+   the program, and has `argument` bytes */
+#define CDDL_OP_TLITERAL (1U)
+
+/* `left` is the number of the definition */
+#define CDDL_OP_TDEF (2U)
+
+/* `left` is the group */
+#define CDDL_OP_TARRAY (3U)
+
+/* `left` is the group, `right` its key table */
+#define CDDL_OP_TMAP (4U)
+
+/* `argument` is the tag number, `left` the type of the payload */
+#define CDDL_OP_TTAGGED (5U)
+
+/* For `CDDL_OP_TCHOICE`, `CDDL_OP_GZERO_OR_ONE`,
+   `CDDL_OP_GZERO_OR_MORE`, `CDDL_OP_GONE_OR_MORE` and
+   `CDDL_OP_GCHOICE`, `argument` tells whether `left` (and `right`, for
+   `CDDL_OP_TCHOICE`) may write a field before it fails, so that
+   `cddl_decode` must save the fields that they write to restore them
+   when their failure is recovered from. */
+#define CDDL_SAVE_LEFT (1ULL)
+
+#define CDDL_SAVE_RIGHT (2ULL)
+
+#define CDDL_OP_TCHOICE (6U)
+
+#define CDDL_OP_GDEF (7U)
+
+/* `left` is the type of the element */
+#define CDDL_OP_GARRAY_ELEM (8U)
+
+/* Bit 0 of `argument` is the cut flag, `left` the type of the key,
+   which is a `CDDL_OP_TLITERAL`, and `right` the type of the value.
+   The other bits of `argument` are the position of the key in the key
+   table of the last `TMap` built on this group: since groups may be
+   shared, this is only a hint, checked before use. */
+#define CDDL_OP_GMAP_LITERAL (9U)
+
+/* `GMapElem` with any other key; only valid below `GZeroOrMore` or
+   `GOneOrMore`, which turn it into a `CDDL_OP_GMAP_FILTER` */
+#define CDDL_OP_GMAP_ELEM (10U)
+
+/* Consumes all remaining entries whose key matches `left` and whose
+   value matches `right`, and fails if there are fewer than `argument`
+   of them */
+#define CDDL_OP_GMAP_FILTER (11U)
+
+#define CDDL_OP_GALWAYS_FALSE (12U)
+
+#define CDDL_OP_GNOP (13U)
+
+#define CDDL_OP_GZERO_OR_ONE (14U)
+
+#define CDDL_OP_GZERO_OR_MORE (15U)
+
+#define CDDL_OP_GONE_OR_MORE (16U)
+
+#define CDDL_OP_GCONCAT (17U)
+
+#define CDDL_OP_GCHOICE (18U)
+
+/* Key table of the map group `left`: the distinct literal keys of its
+   `GMapElem`, in the `argument` instructions that follow, sorted by
+   `cddl_key_compare`. Its set of initial bytes is that of the keys of
+   the filters of the group, so that an entry whose key is not in the
+   table, and whose initial byte is not in the set, cannot be
+   consumed. */
+#define CDDL_OP_TKEYS (19U)
+
+/* `left` and `argument` are the offset and size of the literal */
+#define CDDL_OP_TKEY (20U)
+
+/* Stores for `cddl_decode`: they accept the data items of the type
+   `left`, and write the field at offset `argument` of the current
+   record. `CDDL_OP_TSTORE` writes the data item as `right`, one of
+   `CDDL_FIELD_*`; `CDDL_OP_TCASE` writes `right` as a `uint32_t`. */
+#define CDDL_OP_TSTORE (21U)
+
+#define CDDL_OP_TCASE (22U)
+
+/* `left` is matched with the record at offset `argument` of the
+   current record as the current record */
+#define CDDL_OP_TSTRUCT (23U)
+
+/* `left` is a `GZeroOrMore` or `GOneOrMore` of an array group, or a
+   `CDDL_OP_GMAP_FILTER`; each element (or entry) is matched with a new
+   record of `right` bytes as the current record, and the
+   `cddl_records` of them all is written at offset `argument` */
+#define CDDL_OP_GSTORE_EACH (24U)
+
+static inline int cddl_key_compare(uint8_t *k1, size_t len1, uint8_t *k2, size_t len2)
+{
+  if (len1 != len2)
+    return len1 < len2 ? -1 : 1;
+  /* most keys are small integers or short strings */
+  if (k1[0U] != k2[0U])
+    return k1[0U] < k2[0U] ? -1 : 1;
+  return memcmp(k1 + 1U, k2 + 1U, len1 - (size_t)1U);
+}
+
+#define __cbor_unverified_internal_H_DEFINED
+#endif
@@ -0,0 +1,462 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <stdint.h>
+#include "cbor_unverified_internal.h"
+
+typedef struct cddl_encoder_s
+{
+  cddl_program *p;
+  /* NULL when computing the size */
+  uint8_t *out;
+  size_t length;
+  size_t pos;
+  /* the current record */
+  uint8_t *in;
+  uint32_t depth;
+  cddl_validate_status error;
+}
+cddl_encoder;
+
+static bool cddl_encode_enter(cddl_encoder *e)
+{
+  if (e->depth >= CDDL_MAX_DEPTH)
+  {
+    e->error = CDDL_VALIDATE_MAX_DEPTH;
+    return false;
+  }
+  e->depth++;
+  return true;
+}
+
+static bool cddl_put(cddl_encoder *e, uint8_t *a, size_t len)
+{
+  if (len > e->length - e->pos)
+  {
+    e->error = CDDL_VALIDATE_OUTPUT_TOO_SMALL;
+    return false;
+  }
+  if (e->out != NULL && len > (size_t)0U)
+    memcpy(e->out + e->pos, a, len);
+  e->pos += len;
+  return true;
+}
+
+static bool cddl_put_header(cddl_encoder *e, uint8_t ty, uint64_t x)
+{
+  uint8_t h[CBOR_RAW_MAX_HEADER_SIZE];
+  return cddl_put(e, h, cbor_raw_header_write(ty, x, h));
+}
+
+static inline bool cddl_encode_accepts(cddl_program *p, uint32_t t, uint8_t b)
+{
+  return (p->cddl_program_insns[t].cddl_insn_first_bytes[b / 64U] >> (b % 64U) & 1ULL) != 0ULL;
+}
+
+/* The major type of all data items that type `t` may accept, or 8 if
+   they have several */
+static uint8_t cddl_encode_major_type(cddl_program *p, uint32_t t)
+{
+  uint64_t *m = p->cddl_program_insns[t].cddl_insn_first_bytes;
+  uint8_t res = 8U;
+  for (uint8_t ty = 0U; ty < 8U; ty++)
+    if ((m[ty / 2U] >> (32U * (ty % 2U)) & 0xFFFFFFFFULL) != 0ULL)
+    {
+      if (res != 8U)
+        return 8U;
+      res = ty;
+    }
+  return res;
+}
+
+static bool cddl_encode_typ(cddl_encoder *e, uint32_t t);
+
+/* Group `g`, adding the number of array elements (or map entries) that
+   it writes to `*count`. On failure, `e->pos` and `*count` are
+   unchanged. */
+static bool cddl_encode_group(cddl_encoder *e, uint32_t g, uint64_t *count)
+{
+  if (!cddl_encode_enter(e))
+    return false;
+  cddl_program *p = e->p;
+  cddl_insn *i = p->cddl_program_insns + g;
+  size_t pos = e->pos;
+  uint64_t count0 = *count;
+  bool res = false;
+  switch (i->cddl_insn_op)
+  {
+    case CDDL_OP_GDEF:
+    {
+      uint32_t d = p->cddl_program_defs[i->cddl_insn_left];
+      res = d != CDDL_NONE && cddl_encode_group(e, d, count);
+      break;
+    }
+    case CDDL_OP_GARRAY_ELEM:
+      res = cddl_encode_typ(e, i->cddl_insn_left);
+      (*count)++;
+      break;
+    case CDDL_OP_GMAP_LITERAL:
+    case CDDL_OP_GMAP_ELEM:
+      res = cddl_encode_typ(e, i->cddl_insn_left) && cddl_encode_typ(e, i->cddl_insn_right);
+      (*count)++;
+      break;
+    case CDDL_OP_GMAP_FILTER:
+      /* without records, only the least number of entries */
+      res =
+        i->cddl_insn_argument == 0ULL
+        || (cddl_encode_typ(e, i->cddl_insn_left) && cddl_encode_typ(e, i->cddl_insn_right));
+      if (i->cddl_insn_argument != 0ULL)
+        (*count)++;
+      break;
+    case CDDL_OP_GNOP:
+      res = true;
+      break;
+    case CDDL_OP_GZERO_OR_ONE:
+      res = cddl_encode_group(e, i->cddl_insn_left, count) || e->error == CDDL_VALIDATE_VALID;
+      break;
+    case CDDL_OP_GZERO_OR_MORE:
+      res = true;
+      break;
+    case CDDL_OP_GONE_OR_MORE:
+      res = cddl_encode_group(e, i->cddl_insn_left, count);
+      break;
+    case CDDL_OP_GSTORE_EACH:
+    {
+      /* one iteration per record */
+      cddl_insn r = p->cddl_program_insns[i->cddl_insn_left];
+      cddl_records rec;
+      memcpy(&rec, e->in + i->cddl_insn_argument, sizeof(rec));
+      uint8_t *in = e->in;
+      uint64_t min =
+        r.cddl_insn_op == CDDL_OP_GMAP_FILTER
+          ? r.cddl_insn_argument
+          : r.cddl_insn_op == CDDL_OP_GONE_OR_MORE ? 1ULL : 0ULL;
+      res = (uint64_t)rec.cddl_records_length >= min;
+      for (size_t j = (size_t)0U; res && j < rec.cddl_records_length; j++)
+      {
+        e->in = rec.cddl_records_payload + j * (size_t)i->cddl_insn_right;
+        if (r.cddl_insn_op == CDDL_OP_GMAP_FILTER)
+        {
+          res = cddl_encode_typ(e, r.cddl_insn_left) && cddl_encode_typ(e, r.cddl_insn_right);
+          (*count)++;
+        }
+        else
+          res = cddl_encode_group(e, r.cddl_insn_left, count);
+      }
+      e->in = in;
+      break;
+    }
+    case CDDL_OP_GCONCAT:
+      res = cddl_encode_group(e, i->cddl_insn_left, count) && cddl_encode_group(e, i->cddl_insn_right, count);
+      break;
+    case CDDL_OP_GCHOICE:
+      res =
+        cddl_encode_group(e, i->cddl_insn_left, count)
+        || (e->error == CDDL_VALIDATE_VALID && cddl_encode_group(e, i->cddl_insn_right, count));
+      break;
+    default:
+      break;
+  }
+  if (!res)
+  {
+    e->pos = pos;
+    *count = count0;
+  }
+  e->depth--;
+  return res;
+}
+
+static void cddl_encode_reverse(uint8_t *a, size_t len)
+{
+  for (size_t i = (size_t)0U, j = len; i + (size_t)1U < j; i++)
+  {
+    j--;
+    uint8_t b = a[i];
+    a[i] = a[j];
+    a[j] = b;
+  }
+}
+
+/* Sorts the `count` entries written at `a` by their encoded keys, in
+   place: each entry whose key is less than that of the last sorted
+   entry is rotated into place, so that entries written in order only
+   cost one comparison each, and entries written in reverse order move
+   all the bytes before them (see `cddl_encode` in CBOR_Unverified.h.)
+   Returns false if two keys are equal. */
+static bool cddl_encode_sort_entries(uint8_t *a, uint64_t count)
+{
+  size_t pos = (size_t)0U;
+  size_t last = (size_t)0U;
+  size_t last_size = (size_t)0U;
+  for (uint64_t j = 0ULL; j < count; j++)
+  {
+    uint8_t *k = a + pos;
+    size_t ks = cbor_raw_skip(k);
+    size_t es = ks + cbor_raw_skip(k + ks);
+    int16_t c = j == 0ULL ? (int16_t)-1 : cbor_bytes_lex_compare(last_size, a + last, ks, k);
+    if (c == 0)
+      return false;
+    if (c < 0)
+    {
+      last = pos;
+      last_size = ks;
+    }
+    else
+    {
+      /* before the first entry of a greater key */
+      size_t ins = (size_t)0U;
+      while (true)
+      {
+        size_t is = cbor_raw_skip(a + ins);
+        int16_t d = cbor_bytes_lex_compare(is, a + ins, ks, k);
+        if (d == 0)
+          return false;
+        if (d > 0)
+          break;
+        ins += is;
+        ins += cbor_raw_skip(a + ins);
+      }
+      cddl_encode_reverse(a + ins, pos - ins);
+      cddl_encode_reverse(k, es);
+      cddl_encode_reverse(a + ins, pos + es - ins);
+      last += es;
+    }
+    pos += es;
+  }
+  return true;
+}
+
+/* An array or a map of major type `ty`, with the elements or entries of
+   group `g`. The header comes first, but the number of elements is
+   only known once the group is written: it is written after a 1-byte
+   header, which is widened afterwards if needed (for 24 elements or
+   more), by moving the elements. The entries of a map are sorted by
+   their keys before. */
+static bool cddl_encode_container(cddl_encoder *e, uint8_t ty, uint32_t g)
+{
+  size_t pos = e->pos;
+  uint64_t count = 0ULL;
+  if (e->out == NULL)
+    return cddl_encode_group(e, g, &count) && cddl_put_header(e, ty, count);
+  if (e->length == pos)
+  {
+    e->error = CDDL_VALIDATE_OUTPUT_TOO_SMALL;
+    return false;
+  }
+  e->pos++;
+  if (!cddl_encode_group(e, g, &count))
+    return false;
+  if (ty == CBOR_MAJOR_TYPE_MAP && !cddl_encode_sort_entries(e->out + pos + (size_t)1U, count))
+    return false;
+  size_t hs = cbor_raw_header_size(count);
+  if (hs > (size_t)1U)
+  {
+    if (hs - (size_t)1U > e->length - e->pos)
+    {
+      e->error = CDDL_VALIDATE_OUTPUT_TOO_SMALL;
+      return false;
+    }
+    memmove(e->out + pos + hs, e->out + pos + (size_t)1U, e->pos - pos - (size_t)1U);
+    e->pos += hs - (size_t)1U;
+  }
+  cbor_raw_header_write(ty, count, e->out + pos);
+  return true;
+}
+
+/* Writes the field at `field` as `kind` (one of `CDDL_FIELD_*`), as a
+   data item of type `t` */
+static bool cddl_encode_field(cddl_encoder *e, uint8_t *field, uint8_t kind, uint32_t t)
+{
+  cddl_program *p = e->p;
+  switch (kind)
+  {
+    case CDDL_FIELD_BOOL:
+    {
+      bool v;
+      memcpy(&v, field, sizeof(v));
+      uint8_t b = (uint8_t)(CBOR_MAJOR_TYPE_SIMPLE_VALUE << 5U | (v ? 21U : 20U));
+      return cddl_encode_accepts(p, t, b) && cddl_put(e, &b, (size_t)1U);
+    }
+    case CDDL_FIELD_UINT64:
+    {
+      uint64_t v;
+      memcpy(&v, field, sizeof(v));
+      /* an integer or simple value, of the only major type of `t` */
+      uint8_t ty = cddl_encode_major_type(p, t);
+      if
+      (
+        !(ty == CBOR_MAJOR_TYPE_UINT64 || ty == CBOR_MAJOR_TYPE_NEG_INT64 || ty == CBOR_MAJOR_TYPE_SIMPLE_VALUE)
+        || (ty == CBOR_MAJOR_TYPE_SIMPLE_VALUE && ((v >= 24ULL && v < 32ULL) || v > 255ULL))
+      )
+        return false;
+      uint8_t h[CBOR_RAW_MAX_HEADER_SIZE];
+      size_t hs = cbor_raw_header_write(ty, v, h);
+      return cddl_encode_accepts(p, t, h[0U]) && cddl_put(e, h, hs);
+    }
+    case CDDL_FIELD_INT:
+    {
+      cbor_int v;
+      memcpy(&v, field, sizeof(v));
+      if (v.cbor_int_type != CBOR_MAJOR_TYPE_UINT64 && v.cbor_int_type != CBOR_MAJOR_TYPE_NEG_INT64)
+        return false;
+      uint8_t h[CBOR_RAW_MAX_HEADER_SIZE];
+      size_t hs = cbor_raw_header_write(v.cbor_int_type, v.cbor_int_value, h);
+      return cddl_encode_accepts(p, t, h[0U]) && cddl_put(e, h, hs);
+    }
+    case CDDL_FIELD_STRING:
+    {
+      cbor_string v;
+      memcpy(&v, field, sizeof(v));
+      if
+      (
+        (v.cbor_string_type != CBOR_MAJOR_TYPE_BYTE_STRING && v.cbor_string_type != CBOR_MAJOR_TYPE_TEXT_STRING)
+        || v.cbor_string_length > (uint64_t)SIZE_MAX
+      )
+        return false;
+      uint8_t h[CBOR_RAW_MAX_HEADER_SIZE];
+      size_t hs = cbor_raw_header_write(v.cbor_string_type, v.cbor_string_length, h);
+      return
+        cddl_encode_accepts(p, t, h[0U])
+        && cddl_put(e, h, hs)
+        && cddl_put(e, v.cbor_string_payload, (size_t)v.cbor_string_length);
+    }
+    case CDDL_FIELD_ITEM:
+    {
+      cbor v;
+      memcpy(&v, field, sizeof(v));
+      if (v.tag != CBOR_Case_Serialized)
+        return false;
+      uint8_t *a = v.case_CBOR_Case_Serialized.cbor_serialized_payload;
+      size_t sz = v.case_CBOR_Case_Serialized.cbor_serialized_size;
+      /* a single data item, which `cddl_encode_sort_entries` may skip */
+      cbor_read_t r = cbor_read_deterministically_encoded(a, sz);
+      return
+        r.cbor_read_is_success
+        && r.cbor_read_remainder_length == (size_t)0U
+        && cddl_encode_accepts(p, t, a[0U])
+        && cddl_put(e, a, sz);
+    }
+    default:
+      return false;
+  }
+}
+
+/* Type `t`. On failure, `e->pos` is unchanged. */
+static bool cddl_encode_typ(cddl_encoder *e, uint32_t t)
+{
+  if (!cddl_encode_enter(e))
+    return false;
+  cddl_program *p = e->p;
+  cddl_insn *i = p->cddl_program_insns + t;
+  size_t pos = e->pos;
+  bool res = false;
+  switch (i->cddl_insn_op)
+  {
+    case CDDL_OP_TLITERAL:
+      res = cddl_put(e, p->cddl_program_literals + i->cddl_insn_left, (size_t)i->cddl_insn_argument);
+      break;
+    case CDDL_OP_TDEF:
+    {
+      uint32_t d = p->cddl_program_defs[i->cddl_insn_left];
+      res = d != CDDL_NONE && cddl_encode_typ(e, d);
+      break;
+    }
+    case CDDL_OP_TARRAY:
+      res = cddl_encode_container(e, CBOR_MAJOR_TYPE_ARRAY, i->cddl_insn_left);
+      break;
+    case CDDL_OP_TMAP:
+      res = cddl_encode_container(e, CBOR_MAJOR_TYPE_MAP, i->cddl_insn_left);
+      break;
+    case CDDL_OP_TTAGGED:
+      res = cddl_put_header(e, CBOR_MAJOR_TYPE_TAGGED, i->cddl_insn_argument) && cddl_encode_typ(e, i->cddl_insn_left);
+      break;
+    case CDDL_OP_TCHOICE:
+    {
+      /* the first alternative that the record describes */
+      uint32_t u = t;
+      while (!res && e->error == CDDL_VALIDATE_VALID)
+      {
+        cddl_insn *c = p->cddl_program_insns + u;
+        uint32_t alt = c->cddl_insn_op == CDDL_OP_TCHOICE ? c->cddl_insn_left : u;
+        res = cddl_encode_typ(e, alt);
+        if (alt == u)
+          break;
+        u = c->cddl_insn_right;
+      }
+      break;
+    }
+    case CDDL_OP_TSTORE:
+      res = cddl_encode_field(e, e->in + i->cddl_insn_argument, (uint8_t)i->cddl_insn_right, i->cddl_insn_left);
+      break;
+    case CDDL_OP_TCASE:
+    {
+      uint32_t v;
+      memcpy(&v, e->in + i->cddl_insn_argument, sizeof(v));
+      res = v == i->cddl_insn_right && cddl_encode_typ(e, i->cddl_insn_left);
+      break;
+    }
+    case CDDL_OP_TSTRUCT:
+    {
+      uint8_t *in = e->in;
+      e->in = in + i->cddl_insn_argument;
+      res = cddl_encode_typ(e, i->cddl_insn_left);
+      e->in = in;
+      break;
+    }
+    default:
+      /* no data to write elements of other types from */
+      break;
+  }
+  if (!res)
+    e->pos = pos;
+  e->depth--;
+  return res;
+}
+
+static cddl_validate_status
+cddl_encode_run(cddl_program *p, uint32_t t, uint8_t *in, uint8_t *out, size_t sz, size_t *res)
+{
+  cddl_encoder e = {
+    .p = p,
+    .out = out,
+    .length = sz,
+    .pos = (size_t)0U,
+    .in = in,
+    .depth = 0U,
+    .error = CDDL_VALIDATE_VALID
+  };
+  if (t >= p->cddl_program_insns_length || p->cddl_program_insns[t].cddl_insn_kind != CDDL_KIND_TYPE)
+    return CDDL_VALIDATE_INVALID;
+  bool ok = cddl_encode_typ(&e, t);
+  if (e.error != CDDL_VALIDATE_VALID)
+    return e.error;
+  if (!ok)
+    return CDDL_VALIDATE_INVALID;
+  *res = e.pos;
+  return CDDL_VALIDATE_VALID;
+}
+
+cddl_validate_status cddl_encoded_size(cddl_program *p, uint32_t t, uint8_t *in, size_t *res)
+{
+  return cddl_encode_run(p, t, in, NULL, SIZE_MAX, res);
+}
+
+cddl_validate_status
+cddl_encode(cddl_program *p, uint32_t t, uint8_t *in, uint8_t *out, size_t sz, size_t *res)
+{
+  return cddl_encode_run(p, t, in, out, sz, res);
+}
@@ -0,0 +1,601 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cbor_unverified_internal.h"
+
+void
+cddl_program_init(
+  cddl_program *p,
+  cddl_insn *insns,
+  uint32_t insns_capacity,
+  uint8_t *literals,
+  size_t literals_capacity,
+  uint32_t *defs,
+  uint32_t defs_length
+)
+{
+  p->cddl_program_insns = insns;
+  p->cddl_program_insns_length = 0U;
+  p->cddl_program_insns_capacity = insns_capacity < CDDL_NONE ? insns_capacity : CDDL_NONE;
+  p->cddl_program_literals = literals;
+  p->cddl_program_literals_length = (size_t)0U;
+  p->cddl_program_literals_capacity = literals_capacity;
+  p->cddl_program_defs = defs;
+  p->cddl_program_defs_length = defs_length;
+  p->cddl_program_max_keys = 0U;
+  for (uint32_t i = 0U; i < defs_length; i++)
+    defs[i] = CDDL_NONE;
+}
+
+/* Initial bytes of the keys of the filters of map group `g` */
+static void cddl_filter_keys(cddl_program *p, uint32_t g, uint64_t *res)
+{
+  cddl_insn *e = p->cddl_program_insns + g;
+  switch (e->cddl_insn_op)
+  {
+    case CDDL_OP_GMAP_FILTER:
+      for (size_t j = (size_t)0U; j < (size_t)4U; j++)
+        res[j] |= p->cddl_program_insns[e->cddl_insn_left].cddl_insn_first_bytes[j];
+      break;
+    case CDDL_OP_GCONCAT:
+    case CDDL_OP_GCHOICE:
+      cddl_filter_keys(p, e->cddl_insn_right, res);
+      cddl_filter_keys(p, e->cddl_insn_left, res);
+      break;
+    case CDDL_OP_GZERO_OR_ONE:
+    case CDDL_OP_GZERO_OR_MORE:
+    case CDDL_OP_GONE_OR_MORE:
+    case CDDL_OP_GSTORE_EACH:
+      cddl_filter_keys(p, e->cddl_insn_left, res);
+      break;
+    default:
+      break;
+  }
+}
+
+/* Initial bytes of the data items that type `i` may accept, from those
+   of the types it refers to (or, for a key table, of the keys of
+   filters) */
+static void cddl_first_bytes(cddl_program *p, uint32_t i, uint64_t *res)
+{
+  cddl_insn *e = p->cddl_program_insns + i;
+  uint8_t ty = 8U;
+  for (size_t j = (size_t)0U; j < (size_t)4U; j++)
+    res[j] = 0ULL;
+  switch (e->cddl_insn_op)
+  {
+    case CDDL_OP_TELEM:
+      switch (e->cddl_insn_argument)
+      {
+        case CDDL_ELEM_BOOL:
+          res[3U] = 3ULL << 52U;
+          break;
+        case CDDL_ELEM_BYTE_STRING:
+          ty = CBOR_MAJOR_TYPE_BYTE_STRING;
+          break;
+        case CDDL_ELEM_TEXT_STRING:
+          ty = CBOR_MAJOR_TYPE_TEXT_STRING;
+          break;
+        case CDDL_ELEM_UINT:
+          ty = CBOR_MAJOR_TYPE_UINT64;
+          break;
+        case CDDL_ELEM_NINT:
+          ty = CBOR_MAJOR_TYPE_NEG_INT64;
+          break;
+        case CDDL_ELEM_ANY:
+          for (size_t b = (size_t)0U; b < (size_t)256U; b++)
+            if (cbor_raw_initial_byte_decode(b).cbor_raw_initial_byte_kind != CBOR_RAW_KIND_INVALID)
+              res[b / (size_t)64U] |= 1ULL << (b % (size_t)64U);
+          break;
+        default:
+          break;
+      }
+      break;
+    case CDDL_OP_TLITERAL:
+    {
+      uint8_t b = p->cddl_program_literals[e->cddl_insn_left];
+      res[b / 64U] = 1ULL << (b % 64U);
+      break;
+    }
+    case CDDL_OP_TDEF:
+    {
+      uint32_t d = p->cddl_program_defs[e->cddl_insn_left];
+      if (d != CDDL_NONE)
+        for (size_t j = (size_t)0U; j < (size_t)4U; j++)
+          res[j] = p->cddl_program_insns[d].cddl_insn_first_bytes[j];
+      break;
+    }
+    case CDDL_OP_TARRAY:
+      ty = CBOR_MAJOR_TYPE_ARRAY;
+      break;
+    case CDDL_OP_TMAP:
+      ty = CBOR_MAJOR_TYPE_MAP;
+      break;
+    case CDDL_OP_TTAGGED:
+    {
+      uint8_t h[CBOR_RAW_MAX_HEADER_SIZE];
+      cbor_raw_header_write(CBOR_MAJOR_TYPE_TAGGED, e->cddl_insn_argument, h);
+      res[h[0U] / 64U] = 1ULL << (h[0U] % 64U);
+      break;
+    }
+    case CDDL_OP_TSTORE:
+    case CDDL_OP_TCASE:
+    case CDDL_OP_TSTRUCT:
+      for (size_t j = (size_t)0U; j < (size_t)4U; j++)
+        res[j] = p->cddl_program_insns[e->cddl_insn_left].cddl_insn_first_bytes[j];
+      break;
+    case CDDL_OP_TCHOICE:
+      for (size_t j = (size_t)0U; j < (size_t)4U; j++)
+        res[j] =
+          p->cddl_program_insns[e->cddl_insn_left].cddl_insn_first_bytes[j]
+          | p->cddl_program_insns[e->cddl_insn_right].cddl_insn_first_bytes[j];
+      break;
+    case CDDL_OP_TKEYS:
+      cddl_filter_keys(p, e->cddl_insn_left, res);
+      break;
+    default:
+      break;
+  }
+  /* all valid initial bytes of major type `ty`: additional information
+     up to 27 */
+  if (ty < 8U)
+    res[ty / 2U] = 0x0FFFFFFFULL << (32U * (ty % 2U));
+}
+
+bool cddl_program_define(cddl_program *p, uint32_t def, uint32_t insn)
+{
+  if (def >= p->cddl_program_defs_length || insn >= p->cddl_program_insns_length)
+    return false;
+  p->cddl_program_defs[def] = insn;
+  /* Definitions may be recursive: start from all bytes for all types,
+     and narrow down until nothing changes, which over-approximates the
+     sets. */
+  uint32_t n = p->cddl_program_insns_length;
+  for (uint32_t i = 0U; i < n; i++)
+    if (p->cddl_program_insns[i].cddl_insn_kind == CDDL_KIND_TYPE || p->cddl_program_insns[i].cddl_insn_op == CDDL_OP_TKEYS)
+      memset(p->cddl_program_insns[i].cddl_insn_first_bytes, 0xFF, sizeof(p->cddl_program_insns[i].cddl_insn_first_bytes));
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (uint32_t i = 0U; i < n; i++)
+    {
+      cddl_insn *e = p->cddl_program_insns + i;
+      uint64_t m[4U];
+      if (e->cddl_insn_kind != CDDL_KIND_TYPE && e->cddl_insn_op != CDDL_OP_TKEYS)
+        continue;
+      cddl_first_bytes(p, i, m);
+      if (memcmp(m, e->cddl_insn_first_bytes, sizeof(m)) != 0)
+      {
+        memcpy(e->cddl_insn_first_bytes, m, sizeof(m));
+        changed = true;
+      }
+    }
+  }
+  return true;
+}
+
+static uint32_t
+cddl_emit(cddl_program *p, uint8_t op, uint8_t kind, uint32_t left, uint32_t right, uint64_t argument)
+{
+  uint32_t i = p->cddl_program_insns_length;
+  if (i >= p->cddl_program_insns_capacity)
+    return CDDL_NONE;
+  p->cddl_program_insns[i] =
+    (
+      (cddl_insn){
+        .cddl_insn_op = op,
+        .cddl_insn_kind = kind,
+        .cddl_insn_left = left,
+        .cddl_insn_right = right,
+        .cddl_insn_argument = argument,
+        .cddl_insn_first_bytes = { 0ULL, 0ULL, 0ULL, 0ULL }
+      }
+    );
+  p->cddl_program_insns_length = i + 1U;
+  if (kind == CDDL_KIND_TYPE || op == CDDL_OP_TKEYS)
+    cddl_first_bytes(p, i, p->cddl_program_insns[i].cddl_insn_first_bytes);
+  return i;
+}
+
+static bool cddl_is_kind(cddl_program *p, uint32_t i, uint8_t kind)
+{
+  return i < p->cddl_program_insns_length && p->cddl_program_insns[i].cddl_insn_kind == kind;
+}
+
+/* Kind of a group made of `g1` and `g2`, or `CDDL_NONE` */
+static uint32_t cddl_group_kind(cddl_program *p, uint32_t g1, uint32_t g2)
+{
+  if (g1 >= p->cddl_program_insns_length || g2 >= p->cddl_program_insns_length)
+    return CDDL_NONE;
+  uint8_t k1 = p->cddl_program_insns[g1].cddl_insn_kind;
+  uint8_t k2 = p->cddl_program_insns[g2].cddl_insn_kind;
+  if (k1 == CDDL_KIND_TYPE || k2 == CDDL_KIND_TYPE || k1 == CDDL_KIND_KEYS || k2 == CDDL_KIND_KEYS)
+    return CDDL_NONE;
+  if (k1 == CDDL_KIND_GROUP)
+    return (uint32_t)k2;
+  if (k2 == CDDL_KIND_GROUP || k1 == k2)
+    return (uint32_t)k1;
+  return CDDL_NONE;
+}
+
+/* `CDDL_OP_GMAP_ELEM` may only appear below `GZeroOrMore` and
+   `GOneOrMore` */
+static bool cddl_is_composable(cddl_program *p, uint32_t g)
+{
+  return p->cddl_program_insns[g].cddl_insn_op != CDDL_OP_GMAP_ELEM;
+}
+
+uint32_t cddl_telem(cddl_program *p, uint8_t elem)
+{
+  if (elem > CDDL_ELEM_ANY)
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_TELEM, CDDL_KIND_TYPE, 0U, 0U, (uint64_t)elem);
+}
+
+/* Appends the literal of `len` bytes, starting with a header of major
+   type `ty` and argument `x`, followed by the `payload_len` bytes of
+   `payload` */
+static uint32_t
+cddl_literal(cddl_program *p, uint8_t ty, uint64_t x, uint8_t *payload, size_t payload_len)
+{
+  size_t off = p->cddl_program_literals_length;
+  size_t hs = cbor_raw_header_size(x);
+  if
+  (
+    off >= (size_t)CDDL_NONE
+    || p->cddl_program_literals_capacity - off < hs
+    || p->cddl_program_literals_capacity - off - hs < payload_len
+  )
+    return CDDL_NONE;
+  uint8_t *out = p->cddl_program_literals + off;
+  cbor_raw_header_write(ty, x, out);
+  if (payload_len > (size_t)0U)
+    memcpy(out + hs, payload, payload_len);
+  uint32_t res =
+    cddl_emit(p, CDDL_OP_TLITERAL, CDDL_KIND_TYPE, (uint32_t)off, 0U, (uint64_t)(hs + payload_len));
+  if (res != CDDL_NONE)
+    p->cddl_program_literals_length = off + hs + payload_len;
+  return res;
+}
+
+uint32_t cddl_tliteral_simple(cddl_program *p, uint8_t v)
+{
+  /* as `cbor_read`, reject the simple values that are not encoded as
+     such */
+  if (v >= 24U && v < 32U)
+    return CDDL_NONE;
+  return cddl_literal(p, CBOR_MAJOR_TYPE_SIMPLE_VALUE, (uint64_t)v, NULL, (size_t)0U);
+}
+
+uint32_t cddl_tliteral_int(cddl_program *p, uint8_t ty, uint64_t v)
+{
+  if (ty != CBOR_MAJOR_TYPE_UINT64 && ty != CBOR_MAJOR_TYPE_NEG_INT64)
+    return CDDL_NONE;
+  return cddl_literal(p, ty, v, NULL, (size_t)0U);
+}
+
+uint32_t cddl_tliteral_string(cddl_program *p, uint8_t ty, uint8_t *s, uint64_t len)
+{
+  if
+  (
+    (ty != CBOR_MAJOR_TYPE_BYTE_STRING && ty != CBOR_MAJOR_TYPE_TEXT_STRING)
+    || len > (uint64_t)SIZE_MAX
+  )
+    return CDDL_NONE;
+  return cddl_literal(p, ty, len, s, (size_t)len);
+}
+
+uint32_t cddl_tdef(cddl_program *p, uint32_t def)
+{
+  if (def >= p->cddl_program_defs_length)
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_TDEF, CDDL_KIND_TYPE, def, 0U, 0ULL);
+}
+
+uint32_t cddl_tarray(cddl_program *p, uint32_t g)
+{
+  uint32_t k = cddl_group_kind(p, g, g);
+  if (k == CDDL_NONE || k == CDDL_KIND_MAP_GROUP)
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_TARRAY, CDDL_KIND_TYPE, g, 0U, 0ULL);
+}
+
+/* Adds the literal keys of map group `g` to the key table at `keys`,
+   which has `*count` entries so far, keeping it sorted */
+static bool cddl_collect_keys(cddl_program *p, uint32_t g, uint32_t keys, uint32_t *count)
+{
+  cddl_insn e = p->cddl_program_insns[g];
+  switch (e.cddl_insn_op)
+  {
+    case CDDL_OP_GMAP_LITERAL:
+    {
+      cddl_insn l = p->cddl_program_insns[e.cddl_insn_left];
+      uint8_t *lit = p->cddl_program_literals + l.cddl_insn_left;
+      size_t lit_len = (size_t)l.cddl_insn_argument;
+      uint32_t j = *count;
+      int c = 1;
+      while (j > 0U)
+      {
+        cddl_insn *k = p->cddl_program_insns + keys + j - 1U;
+        c = cddl_key_compare(p->cddl_program_literals + k->cddl_insn_left, (size_t)k->cddl_insn_argument, lit, lit_len);
+        if (c <= 0)
+          break;
+        j--;
+      }
+      if (j > 0U && c == 0)
+        return true;
+      if (cddl_emit(p, CDDL_OP_TKEY, CDDL_KIND_KEYS, l.cddl_insn_left, 0U, l.cddl_insn_argument) == CDDL_NONE)
+        return false;
+      cddl_insn k = p->cddl_program_insns[keys + *count];
+      memmove(p->cddl_program_insns + keys + j + 1U, p->cddl_program_insns + keys + j, (size_t)(*count - j) * sizeof(cddl_insn));
+      p->cddl_program_insns[keys + j] = k;
+      (*count)++;
+      return true;
+    }
+    case CDDL_OP_GCONCAT:
+    case CDDL_OP_GCHOICE:
+      return
+        cddl_collect_keys(p, e.cddl_insn_left, keys, count)
+        && cddl_collect_keys(p, e.cddl_insn_right, keys, count);
+    case CDDL_OP_GZERO_OR_ONE:
+    case CDDL_OP_GZERO_OR_MORE:
+    case CDDL_OP_GONE_OR_MORE:
+      return cddl_collect_keys(p, e.cddl_insn_left, keys, count);
+    default:
+      return true;
+  }
+}
+
+/* Records in each `GMapElem` with a literal key of map group `g` the
+   position of its key in the key table at `keys` */
+static void cddl_hint_keys(cddl_program *p, uint32_t g, uint32_t keys, uint32_t count)
+{
+  cddl_insn *e = p->cddl_program_insns + g;
+  switch (e->cddl_insn_op)
+  {
+    case CDDL_OP_GMAP_LITERAL:
+    {
+      cddl_insn l = p->cddl_program_insns[e->cddl_insn_left];
+      uint8_t *lit = p->cddl_program_literals + l.cddl_insn_left;
+      uint32_t j = 0U;
+      while
+      (
+        j < count
+        && cddl_key_compare(p->cddl_program_literals + p->cddl_program_insns[keys + j].cddl_insn_left,
+          (size_t)p->cddl_program_insns[keys + j].cddl_insn_argument, lit, (size_t)l.cddl_insn_argument)
+        != 0
+      )
+        j++;
+      e->cddl_insn_argument = (e->cddl_insn_argument & 1ULL) | (uint64_t)j << 1U;
+      break;
+    }
+    case CDDL_OP_GCONCAT:
+    case CDDL_OP_GCHOICE:
+      cddl_hint_keys(p, e->cddl_insn_left, keys, count);
+      cddl_hint_keys(p, e->cddl_insn_right, keys, count);
+      break;
+    case CDDL_OP_GZERO_OR_ONE:
+    case CDDL_OP_GZERO_OR_MORE:
+    case CDDL_OP_GONE_OR_MORE:
+      cddl_hint_keys(p, e->cddl_insn_left, keys, count);
+      break;
+    default:
+      break;
+  }
+}
+
+uint32_t cddl_tmap(cddl_program *p, uint32_t g)
+{
+  uint32_t k = cddl_group_kind(p, g, g);
+  if (k == CDDL_NONE || k == CDDL_KIND_ARRAY_GROUP || !cddl_is_composable(p, g))
+    return CDDL_NONE;
+  /* the key table, built once so that matching a map looks up each
+     entry in it instead of scanning the map for each key */
+  uint32_t table = cddl_emit(p, CDDL_OP_TKEYS, CDDL_KIND_KEYS, g, 0U, 0ULL);
+  uint32_t count = 0U;
+  if (table == CDDL_NONE || !cddl_collect_keys(p, g, table + 1U, &count))
+    return CDDL_NONE;
+  p->cddl_program_insns[table].cddl_insn_argument = (uint64_t)count;
+  cddl_hint_keys(p, g, table + 1U, count);
+  if (count > p->cddl_program_max_keys)
+    p->cddl_program_max_keys = count;
+  return cddl_emit(p, CDDL_OP_TMAP, CDDL_KIND_TYPE, g, table, 0ULL);
+}
+
+uint32_t cddl_ttagged(cddl_program *p, uint64_t tag, uint32_t t)
+{
+  if (!cddl_is_kind(p, t, CDDL_KIND_TYPE))
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_TTAGGED, CDDL_KIND_TYPE, t, 0U, tag);
+}
+
+/* Whether `cddl_decode` may write a field while matching type or group
+   `t` before it fails: anything but a chain of stores, tags, array
+   elements and map entry values on a choice between types that may not,
+   or on a type that writes nothing. Definitions may not be defined
+   yet. */
+static bool cddl_may_fail_after_writing(cddl_program *p, uint32_t t)
+{
+  while (true)
+  {
+    cddl_insn e = p->cddl_program_insns[t];
+    switch (e.cddl_insn_op)
+    {
+      case CDDL_OP_TSTORE:
+      case CDDL_OP_TCASE:
+      case CDDL_OP_TSTRUCT:
+      case CDDL_OP_TTAGGED:
+      case CDDL_OP_GARRAY_ELEM:
+        t = e.cddl_insn_left;
+        break;
+      case CDDL_OP_GMAP_LITERAL:
+        t = e.cddl_insn_right;
+        break;
+      case CDDL_OP_TCHOICE:
+        return e.cddl_insn_argument != 0ULL;
+      case CDDL_OP_TELEM:
+      case CDDL_OP_TLITERAL:
+      case CDDL_OP_GNOP:
+      case CDDL_OP_GALWAYS_FALSE:
+        return false;
+      default:
+        return true;
+    }
+  }
+}
+
+uint32_t cddl_tchoice(cddl_program *p, uint32_t t1, uint32_t t2)
+{
+  if (!cddl_is_kind(p, t1, CDDL_KIND_TYPE) || !cddl_is_kind(p, t2, CDDL_KIND_TYPE))
+    return CDDL_NONE;
+  uint64_t save =
+    (cddl_may_fail_after_writing(p, t1) ? CDDL_SAVE_LEFT : 0ULL)
+    | (cddl_may_fail_after_writing(p, t2) ? CDDL_SAVE_RIGHT : 0ULL);
+  return cddl_emit(p, CDDL_OP_TCHOICE, CDDL_KIND_TYPE, t1, t2, save);
+}
+
+uint32_t cddl_gdef(cddl_program *p, uint32_t def)
+{
+  /* as in the AST, only array groups have names */
+  if (def >= p->cddl_program_defs_length)
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_GDEF, CDDL_KIND_ARRAY_GROUP, def, 0U, 0ULL);
+}
+
+uint32_t cddl_garray_elem(cddl_program *p, uint32_t t)
+{
+  if (!cddl_is_kind(p, t, CDDL_KIND_TYPE))
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_GARRAY_ELEM, CDDL_KIND_ARRAY_GROUP, t, 0U, 0ULL);
+}
+
+uint32_t cddl_gmap_elem(cddl_program *p, bool cut, uint32_t key, uint32_t value)
+{
+  if (!cddl_is_kind(p, key, CDDL_KIND_TYPE) || !cddl_is_kind(p, value, CDDL_KIND_TYPE))
+    return CDDL_NONE;
+  uint8_t op =
+    p->cddl_program_insns[key].cddl_insn_op == CDDL_OP_TLITERAL
+      ? CDDL_OP_GMAP_LITERAL
+      : CDDL_OP_GMAP_ELEM;
+  return cddl_emit(p, op, CDDL_KIND_MAP_GROUP, key, value, cut ? 1ULL : 0ULL);
+}
+
+uint32_t cddl_galways_false(cddl_program *p)
+{
+  return cddl_emit(p, CDDL_OP_GALWAYS_FALSE, CDDL_KIND_GROUP, 0U, 0U, 0ULL);
+}
+
+uint32_t cddl_gnop(cddl_program *p)
+{
+  return cddl_emit(p, CDDL_OP_GNOP, CDDL_KIND_GROUP, 0U, 0U, 0ULL);
+}
+
+uint32_t cddl_gzero_or_one(cddl_program *p, uint32_t g)
+{
+  uint32_t k = cddl_group_kind(p, g, g);
+  if (k == CDDL_NONE || !cddl_is_composable(p, g))
+    return CDDL_NONE;
+  uint64_t save = cddl_may_fail_after_writing(p, g) ? CDDL_SAVE_LEFT : 0ULL;
+  return cddl_emit(p, CDDL_OP_GZERO_OR_ONE, (uint8_t)k, g, 0U, save);
+}
+
+/* `GZeroOrMore` (`min` = 0) or `GOneOrMore` (`min` = 1) */
+static uint32_t cddl_repeat(cddl_program *p, uint8_t op, uint64_t min, uint32_t g)
+{
+  uint32_t k = cddl_group_kind(p, g, g);
+  if (k == CDDL_NONE)
+    return CDDL_NONE;
+  if (k != CDDL_KIND_MAP_GROUP)
+    return cddl_emit(p, op, (uint8_t)k, g, 0U, cddl_may_fail_after_writing(p, g) ? CDDL_SAVE_LEFT : 0ULL);
+  /* In a map, the only repeated groups are `GMapElem` without cut,
+     which consume all matching entries at once */
+  cddl_insn e = p->cddl_program_insns[g];
+  if
+  (
+    (e.cddl_insn_op != CDDL_OP_GMAP_LITERAL && e.cddl_insn_op != CDDL_OP_GMAP_ELEM)
+    || (e.cddl_insn_argument & 1ULL) != 0ULL
+  )
+    return CDDL_NONE;
+  return
+    cddl_emit(p, CDDL_OP_GMAP_FILTER, CDDL_KIND_MAP_GROUP, e.cddl_insn_left, e.cddl_insn_right, min);
+}
+
+uint32_t cddl_gzero_or_more(cddl_program *p, uint32_t g)
+{
+  return cddl_repeat(p, CDDL_OP_GZERO_OR_MORE, 0ULL, g);
+}
+
+uint32_t cddl_gone_or_more(cddl_program *p, uint32_t g)
+{
+  return cddl_repeat(p, CDDL_OP_GONE_OR_MORE, 1ULL, g);
+}
+
+/* `GConcat` or `GChoice` */
+static uint32_t cddl_binary(cddl_program *p, uint8_t op, uint32_t g1, uint32_t g2)
+{
+  uint32_t k = cddl_group_kind(p, g1, g2);
+  if (k == CDDL_NONE || !cddl_is_composable(p, g1) || !cddl_is_composable(p, g2))
+    return CDDL_NONE;
+  uint64_t save = op == CDDL_OP_GCHOICE && cddl_may_fail_after_writing(p, g1) ? CDDL_SAVE_LEFT : 0ULL;
+  return cddl_emit(p, op, (uint8_t)k, g1, g2, save);
+}
+
+uint32_t cddl_gconcat(cddl_program *p, uint32_t g1, uint32_t g2)
+{
+  return cddl_binary(p, CDDL_OP_GCONCAT, g1, g2);
+}
+
+uint32_t cddl_gchoice(cddl_program *p, uint32_t g1, uint32_t g2)
+{
+  return cddl_binary(p, CDDL_OP_GCHOICE, g1, g2);
+}
+
+uint32_t cddl_tstore(cddl_program *p, uint32_t t, uint8_t field, size_t offset)
+{
+  if (!cddl_is_kind(p, t, CDDL_KIND_TYPE) || field > CDDL_FIELD_ITEM)
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_TSTORE, CDDL_KIND_TYPE, t, (uint32_t)field, (uint64_t)offset);
+}
+
+uint32_t cddl_tcase(cddl_program *p, uint32_t t, size_t offset, uint32_t value)
+{
+  if (!cddl_is_kind(p, t, CDDL_KIND_TYPE))
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_TCASE, CDDL_KIND_TYPE, t, value, (uint64_t)offset);
+}
+
+uint32_t cddl_tstruct(cddl_program *p, uint32_t t, size_t offset)
+{
+  if (!cddl_is_kind(p, t, CDDL_KIND_TYPE))
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_TSTRUCT, CDDL_KIND_TYPE, t, 0U, (uint64_t)offset);
+}
+
+uint32_t cddl_gstore_each(cddl_program *p, uint32_t g, size_t offset, uint32_t size)
+{
+  if (g >= p->cddl_program_insns_length || size == 0U)
+    return CDDL_NONE;
+  cddl_insn e = p->cddl_program_insns[g];
+  if
+  (
+    !(e.cddl_insn_kind == CDDL_KIND_ARRAY_GROUP
+      && (e.cddl_insn_op == CDDL_OP_GZERO_OR_MORE || e.cddl_insn_op == CDDL_OP_GONE_OR_MORE))
+    && e.cddl_insn_op != CDDL_OP_GMAP_FILTER
+  )
+    return CDDL_NONE;
+  return cddl_emit(p, CDDL_OP_GSTORE_EACH, e.cddl_insn_kind, g, size, (uint64_t)offset);
+}
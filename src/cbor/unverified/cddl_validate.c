@@ -0,0 +1,995 @@
+/*
+   Copyright 2024 Microsoft Research
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cbor_unverified_internal.h"
+
+/* Results of map groups, as `MapGroupResult` (with a nonempty set),
+   `MapGroupFail` and `MapGroupCutFail` in CDDL.Spec.MapGroupGen.Base */
+#define MAP_GROUP_SUCCESS (0U)
+#define MAP_GROUP_FAILURE (1U)
+#define MAP_GROUP_CUT_FAILURE (2U)
+
+typedef struct cddl_state_s
+{
+  cddl_program *p;
+  uint8_t *scratch;
+  size_t scratch_length;
+  size_t scratch_top;
+  uint32_t depth;
+  cddl_validate_status error;
+  /* the current record of `cddl_decode`, or NULL when validating */
+  uint8_t *out;
+  uint8_t *storage;
+  size_t storage_top;
+  /* the number of alternatives, optional or repeated groups and map
+     filters being matched whose failure is recovered from, within the
+     current record: while it is not zero, the former contents of the
+     fields written are saved from the end of `storage` down to
+     `saved_bottom` */
+  uint32_t choices;
+  size_t saved_bottom;
+}
+cddl_state;
+
+/* The contents of any field */
+typedef union cddl_field_u
+{
+  bool cddl_field_bool;
+  uint64_t cddl_field_uint64;
+  cbor_int cddl_field_int;
+  cbor_string cddl_field_string;
+  cbor cddl_field_item;
+  uint32_t cddl_field_case;
+  cddl_records cddl_field_records;
+}
+cddl_field;
+
+/* The former contents of the field of `cddl_saved_size` bytes at
+   `cddl_saved_field` */
+typedef struct cddl_saved_s
+{
+  uint8_t *cddl_saved_field;
+  size_t cddl_saved_size;
+  cddl_field cddl_saved_contents;
+}
+cddl_saved;
+
+/* A map being matched. The key of entry `i` is at offset
+   `offsets[2 * i]` of `base`, its value at `offsets[2 * i + 1]`, and
+   the next entry at `offsets[2 * i + 2]`. The entries consumed by the
+   map group so far are marked in `consumed`, and listed in `trail` in
+   the order they were consumed, so that a failed group can give them
+   back. The entry with the `i`-th key of the key table `keys` of the
+   group is `key_entries[i] - 1`, or none if `key_entries[i]` is 0. */
+typedef struct cddl_map_s
+{
+  uint8_t *base;
+  size_t *offsets;
+  size_t length;
+  bool *consumed;
+  size_t *trail;
+  size_t trail_length;
+  cddl_insn *keys;
+  size_t keys_length;
+  size_t *key_entries;
+}
+cddl_map;
+
+size_t cddl_validate_scratch_length(cddl_program *p, size_t sz)
+{
+  /* Each entry of a map takes at least 2 bytes, distinct from those of
+     the entries of the maps that it contains, and needs less than 9
+     words (and 1 byte) of scratch space, alignment included. Each
+     nonempty map takes at least 3 bytes, and needs one more word per
+     key of its key table. */
+  return sz * sizeof(size_t) * ((size_t)5U + (size_t)p->cddl_program_max_keys);
+}
+
+static void *cddl_alloc(cddl_state *st, size_t size)
+{
+  size_t avail = st->scratch_length - st->scratch_top;
+  size_t pad =
+    (size_t)(-(uintptr_t)(st->scratch + st->scratch_top) & (uintptr_t)(sizeof(size_t) - (size_t)1U));
+  if (avail < pad || avail - pad < size)
+  {
+    st->error = CDDL_VALIDATE_OUT_OF_SCRATCH;
+    return NULL;
+  }
+  void *res = st->scratch + st->scratch_top + pad;
+  st->scratch_top += pad + size;
+  return res;
+}
+
+/* Allocates `count` zeroed records of `size` bytes from the storage of
+   `cddl_decode`. Allocations made while matching a type or group that
+   fails are given back, so only those of the result remain. */
+static uint8_t *cddl_records_alloc(cddl_state *st, size_t count, size_t size)
+{
+  size_t avail = st->saved_bottom - st->storage_top;
+  size_t pad =
+    (size_t)(-(uintptr_t)(st->storage + st->storage_top) & (uintptr_t)(_Alignof(max_align_t) - (size_t)1U));
+  if (avail < pad || (size > (size_t)0U && (avail - pad) / size < count))
+  {
+    st->error = CDDL_VALIDATE_OUT_OF_STORAGE;
+    return NULL;
+  }
+  uint8_t *res = st->storage + st->storage_top + pad;
+  st->storage_top += pad + count * size;
+  memset(res, 0, count * size);
+  return res;
+}
+
+/* Saves the `size` bytes of `field` at the end of `storage`. Returns
+   false if `storage` is too small. */
+static bool cddl_save(cddl_state *st, uint8_t *field, size_t size)
+{
+  if (st->saved_bottom - st->storage_top < sizeof(cddl_saved))
+  {
+    st->error = CDDL_VALIDATE_OUT_OF_STORAGE;
+    return false;
+  }
+  cddl_saved d = { .cddl_saved_field = field, .cddl_saved_size = size };
+  memcpy(&d.cddl_saved_contents, field, size);
+  st->saved_bottom -= sizeof(d);
+  memcpy(st->storage + st->saved_bottom, &d, sizeof(d));
+  return true;
+}
+
+/* Writes the `size` bytes at `v` at `offset` of the current record,
+   first saving its former contents if a failure may still be recovered
+   from. Returns false if `storage` is too small to save them. */
+static inline bool cddl_write(cddl_state *st, uint64_t offset, void *v, size_t size)
+{
+  uint8_t *field = st->out + offset;
+  if (st->choices > 0U && !cddl_save(st, field, size))
+    return false;
+  memcpy(field, v, size);
+  return true;
+}
+
+/* Restores the fields written since `saved_bottom` was `mark`. */
+static void cddl_restore(cddl_state *st, size_t mark)
+{
+  while (st->saved_bottom < mark)
+  {
+    cddl_saved d;
+    memcpy(&d, st->storage + st->saved_bottom, sizeof(d));
+    st->saved_bottom += sizeof(d);
+    memcpy(d.cddl_saved_field, &d.cddl_saved_contents, d.cddl_saved_size);
+  }
+}
+
+#define CDDL_NO_CHOICE SIZE_MAX
+
+/* Starts matching a type or group whose failure is recovered from, and
+   which may write a field before it fails if `save` (one of the
+   `CDDL_SAVE_*` bits of its parent) is set; returns the mark to give
+   to `cddl_choice_leave`. Any other failure makes its parent fail, so
+   that the fields are only restored here, as `storage_top` gives back
+   the records allocated by each type or group that fails. */
+static inline size_t cddl_choice_enter(cddl_state *st, uint64_t save)
+{
+  if (save == 0ULL || st->out == NULL)
+    return CDDL_NO_CHOICE;
+  st->choices++;
+  return st->saved_bottom;
+}
+
+/* Restores the fields written since `mark` if `ok` is false, or forgets
+   their former contents if nothing else can fail and be recovered from */
+static inline void cddl_choice_leave(cddl_state *st, size_t mark, bool ok)
+{
+  if (mark == CDDL_NO_CHOICE)
+    return;
+  st->choices--;
+  if (!ok)
+    cddl_restore(st, mark);
+  else if (st->choices == 0U)
+    st->saved_bottom = mark;
+}
+
+/* Writes the `cddl_records` of `length` records at `offset` of the
+   current record */
+static bool cddl_records_write(cddl_state *st, uint64_t offset, uint8_t *records, size_t length)
+{
+  cddl_records r = { .cddl_records_payload = records, .cddl_records_length = length };
+  return cddl_write(st, offset, &r, sizeof(r));
+}
+
+/* Header of a valid data item: returns its size, and sets `*x` to its
+   argument. */
+static inline size_t cddl_header(uint8_t *a, uint64_t *x)
+{
+  uint8_t ai = a[0U] & 31U;
+  if (ai < 24U)
+  {
+    *x = (uint64_t)ai;
+    return (size_t)1U;
+  }
+  size_t n = (size_t)1U << (ai - 24U);
+  uint64_t v = 0ULL;
+  for (size_t i = (size_t)1U; i <= n; i++)
+    v = v << 8U | (uint64_t)a[i];
+  *x = v;
+  return (size_t)1U + n;
+}
+
+static uint64_t cddl_hash(uint8_t *a, size_t len)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = (size_t)0U; i < len; i++)
+    h = (h ^ (uint64_t)a[i]) * 1099511628211ULL;
+  return h;
+}
+
+/* Position of `key` in the sorted key table `keys`, or `keys_length` */
+static size_t
+cddl_key_find(cddl_program *p, cddl_insn *keys, size_t keys_length, uint8_t *key, size_t key_len)
+{
+  size_t lo = (size_t)0U;
+  size_t hi = keys_length;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / (size_t)2U;
+    int c =
+      cddl_key_compare(p->cddl_program_literals + keys[mid].cddl_insn_left, (size_t)keys[mid].cddl_insn_argument, key, key_len);
+    if (c == 0)
+      return mid;
+    if (c < 0)
+      lo = mid + (size_t)1U;
+    else
+      hi = mid;
+  }
+  return keys_length;
+}
+
+static bool cddl_enter(cddl_state *st)
+{
+  if (st->depth >= CDDL_MAX_DEPTH)
+  {
+    st->error = CDDL_VALIDATE_MAX_DEPTH;
+    return false;
+  }
+  st->depth++;
+  return true;
+}
+
+static bool cddl_typ(cddl_state *st, uint32_t t, uint8_t *a, size_t len, size_t *res);
+
+static inline bool cddl_may_accept(cddl_program *p, uint32_t t, uint8_t b)
+{
+  return (p->cddl_program_insns[t].cddl_insn_first_bytes[b / 64U] >> (b % 64U) & 1ULL) != 0ULL;
+}
+
+/* Array group `g`, from the element at offset `*pos` of `a`, with
+   `*count` elements left. As in CDDL.Spec.ArrayGroup, groups are
+   deterministic: on success, `*pos` and `*count` are advanced past the
+   elements consumed; on failure, they are unchanged. */
+static bool
+cddl_array_group(cddl_state *st, uint32_t g, uint8_t *a, size_t len, size_t *pos, uint64_t *count);
+
+/* `GZeroOrMore` (`min` = 0) or `GOneOrMore` (`min` = 1) of array group
+   `g`, which stops at the first failure, or as soon as the group
+   matches the empty list. If `records` is not NULL, each iteration
+   matches with the next record of `size` bytes as the current record;
+   `*matched` is the number of iterations that matched. `save` is as
+   for `cddl_choice_enter`. */
+static bool
+cddl_array_repeat(
+  cddl_state *st,
+  uint32_t g,
+  uint64_t save,
+  uint64_t min,
+  uint8_t *a,
+  size_t len,
+  size_t *pos,
+  uint64_t *count,
+  uint8_t *records,
+  size_t size,
+  size_t *matched
+)
+{
+  uint8_t *out = st->out;
+  uint32_t choices = st->choices;
+  size_t pos0 = *pos;
+  size_t n = (size_t)0U;
+  /* the record of an iteration that fails is past the `n` records
+     matched, so what it holds does not matter */
+  size_t c = CDDL_NO_CHOICE;
+  if (records != NULL)
+    st->choices = 0U;
+  else
+    c = cddl_choice_enter(st, save);
+  while (true)
+  {
+    size_t mark = st->saved_bottom;
+    if (records != NULL)
+      st->out = records + n * size;
+    if (!cddl_array_group(st, g, a, len, pos, count))
+    {
+      cddl_restore(st, mark);
+      break;
+    }
+    n++;
+    if (*pos == pos0)
+      break;
+    pos0 = *pos;
+  }
+  if (records != NULL)
+    st->choices = choices;
+  else
+    cddl_choice_leave(st, c, true);
+  st->out = out;
+  *matched = n;
+  return (uint64_t)n >= min && st->error == CDDL_VALIDATE_VALID;
+}
+
+static bool
+cddl_array_group(cddl_state *st, uint32_t g, uint8_t *a, size_t len, size_t *pos, uint64_t *count)
+{
+  if (!cddl_enter(st))
+    return false;
+  cddl_program *p = st->p;
+  size_t storage_top = st->storage_top;
+  cddl_insn i = p->cddl_program_insns[g];
+  bool res;
+  switch (i.cddl_insn_op)
+  {
+    case CDDL_OP_GDEF:
+    {
+      uint32_t d = p->cddl_program_defs[i.cddl_insn_left];
+      res = d != CDDL_NONE && cddl_array_group(st, d, a, len, pos, count);
+      break;
+    }
+    case CDDL_OP_GARRAY_ELEM:
+    {
+      size_t sz;
+      res = *count > 0ULL && cddl_typ(st, i.cddl_insn_left, a + *pos, len - *pos, &sz);
+      if (res)
+      {
+        *pos += sz;
+        (*count)--;
+      }
+      break;
+    }
+    case CDDL_OP_GNOP:
+      res = true;
+      break;
+    case CDDL_OP_GZERO_OR_ONE:
+    {
+      size_t c = cddl_choice_enter(st, i.cddl_insn_argument & CDDL_SAVE_LEFT);
+      res = cddl_array_group(st, i.cddl_insn_left, a, len, pos, count);
+      cddl_choice_leave(st, c, res);
+      res = res || st->error == CDDL_VALIDATE_VALID;
+      break;
+    }
+    case CDDL_OP_GZERO_OR_MORE:
+    case CDDL_OP_GONE_OR_MORE:
+    {
+      size_t n;
+      uint64_t min = i.cddl_insn_op == CDDL_OP_GONE_OR_MORE ? 1ULL : 0ULL;
+      res =
+        cddl_array_repeat(st, i.cddl_insn_left, i.cddl_insn_argument, min, a, len, pos, count, NULL, (size_t)0U, &n);
+      break;
+    }
+    case CDDL_OP_GSTORE_EACH:
+    {
+      /* each iteration but the last consumes at least one element */
+      cddl_insn r = p->cddl_program_insns[i.cddl_insn_left];
+      uint64_t min = r.cddl_insn_op == CDDL_OP_GONE_OR_MORE ? 1ULL : 0ULL;
+      size_t size = (size_t)i.cddl_insn_right;
+      uint8_t *records = NULL;
+      size_t n;
+      if (st->out != NULL && (records = cddl_records_alloc(st, (size_t)*count + (size_t)1U, size)) == NULL)
+      {
+        res = false;
+        break;
+      }
+      res = cddl_array_repeat(st, r.cddl_insn_left, r.cddl_insn_argument, min, a, len, pos, count, records, size, &n);
+      if (res && records != NULL)
+        res = cddl_records_write(st, i.cddl_insn_argument, records, n);
+      break;
+    }
+    case CDDL_OP_GCONCAT:
+    {
+      size_t pos0 = *pos;
+      uint64_t count0 = *count;
+      res = cddl_array_group(st, i.cddl_insn_left, a, len, pos, count);
+      if (res && !cddl_array_group(st, i.cddl_insn_right, a, len, pos, count))
+      {
+        *pos = pos0;
+        *count = count0;
+        res = false;
+      }
+      break;
+    }
+    case CDDL_OP_GCHOICE:
+    {
+      size_t c = cddl_choice_enter(st, i.cddl_insn_argument & CDDL_SAVE_LEFT);
+      res = cddl_array_group(st, i.cddl_insn_left, a, len, pos, count);
+      cddl_choice_leave(st, c, res);
+      res = res || (st->error == CDDL_VALIDATE_VALID && cddl_array_group(st, i.cddl_insn_right, a, len, pos, count));
+      break;
+    }
+    default:
+      res = false;
+      break;
+  }
+  if (!res)
+    st->storage_top = storage_top;
+  st->depth--;
+  return res;
+}
+
+static void cddl_map_consume(cddl_map *m, size_t j)
+{
+  m->consumed[j] = true;
+  m->trail[m->trail_length] = j;
+  m->trail_length++;
+}
+
+static void cddl_map_restore(cddl_map *m, size_t mark)
+{
+  while (m->trail_length > mark)
+  {
+    m->trail_length--;
+    m->consumed[m->trail[m->trail_length]] = false;
+  }
+}
+
+/* Whether the key (`value` = false) or the value of entry `j` matches
+   type `t` */
+static bool cddl_map_entry(cddl_state *st, cddl_map *m, size_t j, bool value, uint32_t t)
+{
+  size_t k = j + j + (value ? (size_t)1U : (size_t)0U);
+  size_t sz;
+  return
+    cddl_typ(st, t, m->base + m->offsets[k], m->offsets[k + (size_t)1U] - m->offsets[k], &sz);
+}
+
+/* Consumes all entries not consumed yet whose key matches `key` and
+   whose value matches `value`, and fails (giving them back) if there
+   are fewer than `min` of them. If `records` is not NULL, each entry
+   is matched with the next record of `size` bytes as the current
+   record, zeroed again if the entry does not match; `*matched` is the
+   number of entries consumed. */
+static bool
+cddl_map_filter(
+  cddl_state *st,
+  cddl_map *m,
+  uint32_t key,
+  uint32_t value,
+  uint64_t min,
+  uint8_t *records,
+  size_t size,
+  size_t *matched
+)
+{
+  uint8_t *out = st->out;
+  uint32_t choices = st->choices;
+  size_t mark = m->trail_length;
+  size_t c = CDDL_NO_CHOICE;
+  if (records != NULL)
+    st->choices = 0U;
+  else if (st->out != NULL)
+  {
+    st->choices++;
+    c = st->saved_bottom;
+  }
+  for (size_t j = (size_t)0U; j < m->length; j++)
+  {
+    if (m->consumed[j])
+      continue;
+    if (records != NULL)
+      st->out = records + (m->trail_length - mark) * size;
+    size_t saved_bottom = st->saved_bottom;
+    if (cddl_map_entry(st, m, j, false, key) && cddl_map_entry(st, m, j, true, value))
+      cddl_map_consume(m, j);
+    else if (records != NULL)
+      memset(st->out, 0, size);
+    else
+      cddl_restore(st, saved_bottom);
+  }
+  st->out = out;
+  *matched = m->trail_length - mark;
+  bool res = (uint64_t)*matched >= min;
+  if (records != NULL)
+    st->choices = choices;
+  else
+    cddl_choice_leave(st, c, res);
+  if (!res)
+    cddl_map_restore(m, mark);
+  return res;
+}
+
+/* Map group `g` against the entries of `m` not consumed yet. Since the
+   map groups of a program are deterministic, the set of results of the
+   specification has at most one element, which is represented by the
+   entries consumed. On failure (but not on cut failure, which always
+   makes the whole map fail), the consumed entries are unchanged. */
+static uint8_t cddl_map_group(cddl_state *st, uint32_t g, cddl_map *m)
+{
+  if (!cddl_enter(st))
+    return MAP_GROUP_FAILURE;
+  cddl_program *p = st->p;
+  size_t storage_top = st->storage_top;
+  cddl_insn i = p->cddl_program_insns[g];
+  uint8_t res = MAP_GROUP_FAILURE;
+  switch (i.cddl_insn_op)
+  {
+    case CDDL_OP_GMAP_LITERAL:
+    {
+      /* keys are distinct, so at most one entry has this key, which
+         the key table gives */
+      if (m->length == (size_t)0U)
+        break;
+      cddl_insn key = p->cddl_program_insns[i.cddl_insn_left];
+      size_t k = (size_t)(i.cddl_insn_argument >> 1U);
+      if (k >= m->keys_length || m->keys[k].cddl_insn_left != key.cddl_insn_left)
+        k =
+          cddl_key_find(p, m->keys, m->keys_length, p->cddl_program_literals + key.cddl_insn_left, (size_t)key.cddl_insn_argument);
+      if (k == m->keys_length || m->key_entries[k] == (size_t)0U)
+        break;
+      size_t j = m->key_entries[k] - (size_t)1U;
+      if (m->consumed[j])
+        break;
+      if (cddl_map_entry(st, m, j, true, i.cddl_insn_right))
+      {
+        cddl_map_consume(m, j);
+        res = MAP_GROUP_SUCCESS;
+      }
+      else if ((i.cddl_insn_argument & 1ULL) != 0ULL)
+        res = MAP_GROUP_CUT_FAILURE;
+      break;
+    }
+    case CDDL_OP_GMAP_FILTER:
+    {
+      size_t n;
+      if
+      (
+        cddl_map_filter(st, m, i.cddl_insn_left, i.cddl_insn_right, i.cddl_insn_argument, NULL, (size_t)0U, &n)
+      )
+        res = MAP_GROUP_SUCCESS;
+      break;
+    }
+    case CDDL_OP_GSTORE_EACH:
+    {
+      cddl_insn f = p->cddl_program_insns[i.cddl_insn_left];
+      size_t size = (size_t)i.cddl_insn_right;
+      uint8_t *records = NULL;
+      size_t n;
+      if (st->out != NULL && (records = cddl_records_alloc(st, m->length, size)) == NULL)
+        break;
+      if
+      (
+        cddl_map_filter(st, m, f.cddl_insn_left, f.cddl_insn_right, f.cddl_insn_argument, records, size, &n)
+      )
+      {
+        res = MAP_GROUP_SUCCESS;
+        if (records != NULL && !cddl_records_write(st, i.cddl_insn_argument, records, n))
+          res = MAP_GROUP_FAILURE;
+      }
+      break;
+    }
+    case CDDL_OP_GNOP:
+      res = MAP_GROUP_SUCCESS;
+      break;
+    case CDDL_OP_GZERO_OR_ONE:
+    {
+      size_t c = cddl_choice_enter(st, i.cddl_insn_argument & CDDL_SAVE_LEFT);
+      res = cddl_map_group(st, i.cddl_insn_left, m);
+      cddl_choice_leave(st, c, res == MAP_GROUP_SUCCESS);
+      if (res == MAP_GROUP_FAILURE)
+        res = MAP_GROUP_SUCCESS;
+      break;
+    }
+    case CDDL_OP_GZERO_OR_MORE:
+    case CDDL_OP_GONE_OR_MORE:
+    {
+      /* only `GNop` and `GAlwaysFalse` are repeated in maps (repeated
+         `GMapElem` are filters): stop as soon as an iteration consumes
+         nothing, as `bound_map_group` */
+      res =
+        i.cddl_insn_op == CDDL_OP_GZERO_OR_MORE
+          ? MAP_GROUP_SUCCESS
+          : MAP_GROUP_FAILURE;
+      size_t mark = m->trail_length;
+      uint8_t r;
+      size_t c = cddl_choice_enter(st, i.cddl_insn_argument & CDDL_SAVE_LEFT);
+      size_t saved_bottom = st->saved_bottom;
+      while ((r = cddl_map_group(st, i.cddl_insn_left, m)) == MAP_GROUP_SUCCESS)
+      {
+        res = MAP_GROUP_SUCCESS;
+        saved_bottom = st->saved_bottom;
+        if (m->trail_length == mark)
+          break;
+        mark = m->trail_length;
+      }
+      cddl_restore(st, saved_bottom);
+      if (r == MAP_GROUP_CUT_FAILURE)
+        res = r;
+      cddl_choice_leave(st, c, res == MAP_GROUP_SUCCESS);
+      break;
+    }
+    case CDDL_OP_GCONCAT:
+    {
+      size_t mark = m->trail_length;
+      res = cddl_map_group(st, i.cddl_insn_left, m);
+      if (res == MAP_GROUP_SUCCESS)
+      {
+        res = cddl_map_group(st, i.cddl_insn_right, m);
+        if (res == MAP_GROUP_FAILURE)
+          cddl_map_restore(m, mark);
+      }
+      break;
+    }
+    case CDDL_OP_GCHOICE:
+    {
+      size_t c = cddl_choice_enter(st, i.cddl_insn_argument & CDDL_SAVE_LEFT);
+      res = cddl_map_group(st, i.cddl_insn_left, m);
+      cddl_choice_leave(st, c, res == MAP_GROUP_SUCCESS);
+      if (res == MAP_GROUP_FAILURE && st->error == CDDL_VALIDATE_VALID)
+        res = cddl_map_group(st, i.cddl_insn_right, m);
+      break;
+    }
+    default:
+      break;
+  }
+  if (res != MAP_GROUP_SUCCESS)
+    st->storage_top = storage_top;
+  st->depth--;
+  return res;
+}
+
+/* `t_map`: the keys of the map of `length` entries at `a` (of which the
+   header takes `hs` bytes) must be distinct, and `g` must consume all
+   entries. A single pass over the map records the offsets of its
+   entries, looks up each key in the key table `table` of `g`, and
+   rejects the map as soon as an entry can be consumed neither by a
+   `GMapElem` with a literal key nor by a filter. */
+static bool
+cddl_map_typ(cddl_state *st, uint32_t g, uint32_t table, uint8_t *a, size_t hs, uint64_t length, size_t *res)
+{
+  cddl_program *p = st->p;
+  cddl_insn *keys = p->cddl_program_insns + table;
+  size_t keys_length = (size_t)keys->cddl_insn_argument;
+  size_t n = (size_t)length;
+  cddl_map m = {
+    .base = a,
+    .offsets = NULL,
+    .length = n,
+    .consumed = NULL,
+    .trail = NULL,
+    .trail_length = (size_t)0U,
+    .keys = keys + 1U,
+    .keys_length = keys_length,
+    .key_entries = NULL
+  };
+  if (n == (size_t)0U)
+  {
+    *res = hs;
+    return cddl_map_group(st, g, &m) == MAP_GROUP_SUCCESS;
+  }
+  size_t slots = (size_t)1U;
+  while (slots < n + n)
+    slots += slots;
+  size_t top = st->scratch_top;
+  size_t words = n + n + (size_t)1U + n + slots + keys_length;
+  size_t *offsets = cddl_alloc(st, words * sizeof(size_t) + n);
+  if (offsets == NULL)
+    return false;
+  m.offsets = offsets;
+  m.trail = offsets + n + n + (size_t)1U;
+  m.key_entries = m.trail + n;
+  m.consumed = (bool *)(offsets + words);
+  /* the other keys are checked to be distinct in an open-addressing hash
+     table */
+  size_t *others = m.key_entries + keys_length;
+  memset(m.key_entries, 0, (keys_length + slots) * sizeof(size_t));
+  bool ok = true;
+  size_t off = hs;
+  for (size_t j = (size_t)0U; ok && j < n; j++)
+  {
+    uint8_t *key = a + off;
+    size_t key_len = cbor_raw_skip(key);
+    offsets[j + j] = off;
+    off += key_len;
+    offsets[j + j + (size_t)1U] = off;
+    off += cbor_raw_skip(a + off);
+    size_t k = cddl_key_find(p, m.keys, keys_length, key, key_len);
+    if (k < keys_length)
+    {
+      ok = m.key_entries[k] == (size_t)0U;
+      m.key_entries[k] = j + (size_t)1U;
+    }
+    else if (!(keys->cddl_insn_first_bytes[key[0U] / 64U] >> (key[0U] % 64U) & 1ULL))
+      ok = false;
+    else
+    {
+      size_t s = (size_t)cddl_hash(key, key_len) & (slots - (size_t)1U);
+      while (ok && others[s] != (size_t)0U)
+      {
+        size_t o = others[s] - (size_t)1U;
+        ok = cddl_key_compare(a + offsets[o + o], offsets[o + o + (size_t)1U] - offsets[o + o], key, key_len) != 0;
+        s = (s + (size_t)1U) & (slots - (size_t)1U);
+      }
+      others[s] = j + (size_t)1U;
+    }
+  }
+  offsets[n + n] = off;
+  if (ok)
+  {
+    memset(m.consumed, 0, n * sizeof(bool));
+    ok = cddl_map_group(st, g, &m) == MAP_GROUP_SUCCESS && m.trail_length == n;
+  }
+  st->scratch_top = top;
+  *res = off;
+  return ok;
+}
+
+/* Writes the data item of `sz` bytes at `a` into the field at
+   `offset` of the current record, as `kind` (one of `CDDL_FIELD_*`) */
+static bool cddl_store(cddl_state *st, uint64_t offset, uint8_t kind, uint8_t *a, size_t sz)
+{
+  uint64_t x;
+  size_t hs = cddl_header(a, &x);
+  switch (kind)
+  {
+    case CDDL_FIELD_BOOL:
+    {
+      bool v = a[0U] == (CBOR_MAJOR_TYPE_SIMPLE_VALUE << 5U | 21U);
+      return cddl_write(st, offset, &v, sizeof(v));
+    }
+    case CDDL_FIELD_UINT64:
+      return cddl_write(st, offset, &x, sizeof(x));
+    case CDDL_FIELD_INT:
+    {
+      cbor_int v = { .cbor_int_type = a[0U] >> 5U, .cbor_int_value = x };
+      return cddl_write(st, offset, &v, sizeof(v));
+    }
+    case CDDL_FIELD_STRING:
+    {
+      cbor_string v = { .cbor_string_type = a[0U] >> 5U, .cbor_string_length = x, .cbor_string_payload = a + hs };
+      return cddl_write(st, offset, &v, sizeof(v));
+    }
+    case CDDL_FIELD_ITEM:
+    {
+      cbor v = {
+        .tag = CBOR_Case_Serialized,
+        { .case_CBOR_Case_Serialized = { .cbor_serialized_size = sz, .cbor_serialized_payload = a } }
+      };
+      return cddl_write(st, offset, &v, sizeof(v));
+    }
+    default:
+      return true;
+  }
+}
+
+/* Type `t` against the valid data item at `a`, of which `len` bytes
+   are available; on success, `*res` is its size. */
+static bool cddl_typ(cddl_state *st, uint32_t t, uint8_t *a, size_t len, size_t *res)
+{
+  if (!cddl_enter(st))
+    return false;
+  cddl_program *p = st->p;
+  size_t storage_top = st->storage_top;
+  cddl_insn i = p->cddl_program_insns[t];
+  uint8_t b = a[0U];
+  uint8_t ty = b >> 5U;
+  uint64_t x;
+  bool ok = false;
+  switch (i.cddl_insn_op)
+  {
+    case CDDL_OP_TELEM:
+      switch (i.cddl_insn_argument)
+      {
+        case CDDL_ELEM_BOOL:
+          ok = b == (CBOR_MAJOR_TYPE_SIMPLE_VALUE << 5U | 20U) || b == (CBOR_MAJOR_TYPE_SIMPLE_VALUE << 5U | 21U);
+          *res = (size_t)1U;
+          break;
+        case CDDL_ELEM_BYTE_STRING:
+        case CDDL_ELEM_TEXT_STRING:
+          ok =
+            ty
+            == (i.cddl_insn_argument == CDDL_ELEM_BYTE_STRING ? CBOR_MAJOR_TYPE_BYTE_STRING : CBOR_MAJOR_TYPE_TEXT_STRING);
+          if (ok)
+            *res = cddl_header(a, &x) + (size_t)x;
+          break;
+        case CDDL_ELEM_UINT:
+        case CDDL_ELEM_NINT:
+          ok = ty == (i.cddl_insn_argument == CDDL_ELEM_UINT ? CBOR_MAJOR_TYPE_UINT64 : CBOR_MAJOR_TYPE_NEG_INT64);
+          if (ok)
+            *res = cddl_header(a, &x);
+          break;
+        case CDDL_ELEM_ANY:
+          ok = true;
+          *res = cbor_raw_skip(a);
+          break;
+        default:
+          break;
+      }
+      break;
+    case CDDL_OP_TLITERAL:
+    {
+      /* encodings are deterministic, and no encoding is a prefix of
+         another */
+      size_t lit_len = (size_t)i.cddl_insn_argument;
+      ok = lit_len <= len && memcmp(a, p->cddl_program_literals + i.cddl_insn_left, lit_len) == 0;
+      *res = lit_len;
+      break;
+    }
+    case CDDL_OP_TDEF:
+    {
+      uint32_t d = p->cddl_program_defs[i.cddl_insn_left];
+      ok = d != CDDL_NONE && cddl_typ(st, d, a, len, res);
+      break;
+    }
+    case CDDL_OP_TARRAY:
+      if (ty == CBOR_MAJOR_TYPE_ARRAY)
+      {
+        size_t pos = cddl_header(a, &x);
+        ok = cddl_array_group(st, i.cddl_insn_left, a, len, &pos, &x) && x == 0ULL;
+        *res = pos;
+      }
+      break;
+    case CDDL_OP_TMAP:
+      if (ty == CBOR_MAJOR_TYPE_MAP)
+      {
+        size_t hs = cddl_header(a, &x);
+        ok = cddl_map_typ(st, i.cddl_insn_left, i.cddl_insn_right, a, hs, x, res);
+      }
+      break;
+    case CDDL_OP_TTAGGED:
+      if (ty == CBOR_MAJOR_TYPE_TAGGED)
+      {
+        size_t hs = cddl_header(a, &x);
+        size_t sz;
+        ok = x == i.cddl_insn_argument && cddl_typ(st, i.cddl_insn_left, a + hs, len - hs, &sz);
+        if (ok)
+          *res = hs + sz;
+      }
+      break;
+    case CDDL_OP_TCHOICE:
+    {
+      /* along the chain of alternatives, only try those that may
+         accept `b` */
+      uint32_t u = t;
+      while (!ok && st->error == CDDL_VALIDATE_VALID)
+      {
+        cddl_insn *e = p->cddl_program_insns + u;
+        uint32_t alt = e->cddl_insn_op == CDDL_OP_TCHOICE ? e->cddl_insn_left : u;
+        if (alt == u)
+        {
+          ok = cddl_may_accept(p, alt, b) && cddl_typ(st, alt, a, len, res);
+          break;
+        }
+        if (cddl_may_accept(p, alt, b))
+        {
+          size_t c = cddl_choice_enter(st, e->cddl_insn_argument & CDDL_SAVE_LEFT);
+          ok = cddl_typ(st, alt, a, len, res);
+          cddl_choice_leave(st, c, ok);
+        }
+        u = e->cddl_insn_right;
+      }
+      break;
+    }
+    case CDDL_OP_TSTORE:
+      ok = cddl_typ(st, i.cddl_insn_left, a, len, res);
+      if (ok && st->out != NULL)
+        ok = cddl_store(st, i.cddl_insn_argument, (uint8_t)i.cddl_insn_right, a, *res);
+      break;
+    case CDDL_OP_TCASE:
+      ok = cddl_typ(st, i.cddl_insn_left, a, len, res);
+      if (ok && st->out != NULL)
+        ok = cddl_write(st, i.cddl_insn_argument, &i.cddl_insn_right, sizeof(uint32_t));
+      break;
+    case CDDL_OP_TSTRUCT:
+    {
+      uint8_t *out = st->out;
+      if (out != NULL)
+        st->out = out + i.cddl_insn_argument;
+      ok = cddl_typ(st, i.cddl_insn_left, a, len, res);
+      st->out = out;
+      break;
+    }
+    default:
+      break;
+  }
+  if (!ok)
+    st->storage_top = storage_top;
+  st->depth--;
+  return ok;
+}
+
+static cddl_validate_status
+cddl_run(
+  cddl_program *p,
+  uint32_t t,
+  cbor c,
+  uint8_t *out,
+  uint8_t *storage,
+  size_t storage_length,
+  uint8_t *scratch,
+  size_t scratch_length
+)
+{
+  cddl_state st = {
+    .p = p,
+    .scratch = scratch,
+    .scratch_length = scratch_length,
+    .scratch_top = (size_t)0U,
+    .depth = 0U,
+    .error = CDDL_VALIDATE_VALID,
+    .out = out,
+    .storage = storage,
+    .storage_top = (size_t)0U,
+    .choices = 0U,
+    .saved_bottom = storage_length
+  };
+  uint8_t *a;
+  size_t sz;
+  if (c.tag == CBOR_Case_Serialized)
+  {
+    a = c.case_CBOR_Case_Serialized.cbor_serialized_payload;
+    sz = c.case_CBOR_Case_Serialized.cbor_serialized_size;
+  }
+  else
+  {
+    sz = cbor_write(c, scratch, scratch_length);
+    if (sz == (size_t)0U)
+      return CDDL_VALIDATE_OUT_OF_SCRATCH;
+    a = scratch;
+    st.scratch_top = sz;
+  }
+  if (t >= p->cddl_program_insns_length || p->cddl_program_insns[t].cddl_insn_kind != CDDL_KIND_TYPE)
+    return CDDL_VALIDATE_INVALID;
+  size_t res;
+  bool ok = cddl_typ(&st, t, a, sz, &res);
+  if (st.error != CDDL_VALIDATE_VALID)
+    return st.error;
+  return ok ? CDDL_VALIDATE_VALID : CDDL_VALIDATE_INVALID;
+}
+
+cddl_validate_status
+cddl_validate(
+  cddl_program *p,
+  uint32_t t,
+  cbor c,
+  uint8_t *scratch,
+  size_t scratch_length
+)
+{
+  return cddl_run(p, t, c, NULL, NULL, (size_t)0U, scratch, scratch_length);
+}
+
+cddl_validate_status
+cddl_decode(
+  cddl_program *p,
+  uint32_t t,
+  cbor c,
+  uint8_t *out,
+  size_t out_size,
+  uint8_t *storage,
+  size_t storage_length,
+  uint8_t *scratch,
+  size_t scratch_length
+)
+{
+  memset(out, 0, out_size);
+  return cddl_run(p, t, c, out, storage, storage_length, scratch, scratch_length);
+}
@@ -0,0 +1,1802 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "CBOR.h"
+#include "CBOR_Unverified.h"
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    return 1; \
+  }
+
+/* [0, 1, ..., n-1] followed by a byte string of length n, so that
+   elements have different encoded sizes */
+static size_t write_test_array(uint8_t *out, size_t sz, cbor *elts, uint8_t *str, uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+    elts[i] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i * i * i);
+  elts[n] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, str, n);
+  return cbor_write(cbor_constr_array(elts, n + 1), out, sz);
+}
+
+static int test_indexed_array(void)
+{
+  printf("Testing: indexed arrays\n");
+  uint64_t n = 1000;
+  static uint8_t bytes[16384];
+  static uint8_t str[1000];
+  static cbor elts[1001];
+  static size_t offsets[1002];
+  memset(str, 0x42, sizeof(str));
+  size_t len = write_test_array(bytes, sizeof(bytes), elts, str, n);
+  CHECK(len > 0);
+  cbor_read_t r = cbor_read(bytes, len);
+  CHECK(r.cbor_read_is_success);
+  cbor a = r.cbor_read_payload;
+  cbor_indexed_array ia = cbor_indexed_array_init(a, offsets, n + 2);
+  CHECK(cbor_indexed_array_length(&ia) == n + 1);
+  for (size_t i = 0; i <= n; i++)
+    CHECK(CBOR_Pulse_cbor_is_equal(cbor_indexed_array_index(&ia, i), cbor_array_index(a, i)));
+  CHECK(CBOR_Pulse_cbor_is_equal(cbor_indexed_array_index(&ia, n), elts[n]));
+  /* not enough room for the offsets: falls back to cbor_array_index */
+  cbor_indexed_array ib = cbor_indexed_array_init(a, offsets, n);
+  CHECK(CBOR_Pulse_cbor_is_equal(cbor_indexed_array_index(&ib, 17), elts[17]));
+  /* not serialized */
+  cbor_indexed_array ic = cbor_indexed_array_init(cbor_constr_array(elts, n + 1), NULL, 0);
+  CHECK(CBOR_Pulse_cbor_is_equal(cbor_indexed_array_index(&ic, 42), elts[42]));
+  return 0;
+}
+
+static bool same_map_get(CBOR_Pulse_cbor_map_get_t r1, CBOR_Pulse_cbor_map_get_t r2)
+{
+  if (r1.tag != r2.tag)
+    return false;
+  return r1.tag == CBOR_Pulse_NotFound || CBOR_Pulse_cbor_is_equal(r1._0, r2._0);
+}
+
+/* {0: "a", "k1": 1, 2: "a", "k3": 3, ...} plus a duplicate of key 0
+   at the end */
+static size_t write_test_map(uint8_t *out, size_t sz, cbor_map_entry *entries, uint8_t (*keys)[8], uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    cbor k, v;
+    if (i % 2 == 0)
+    {
+      k = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i);
+      v = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, (uint8_t *)"a", 1);
+    }
+    else
+    {
+      int klen = snprintf((char *)keys[i], 8, "k%" PRIu64, i);
+      k = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, keys[i], (uint64_t)klen);
+      v = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, i);
+    }
+    entries[i] = cbor_mk_map_entry(k, v);
+  }
+  entries[n] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 0), cbor_constr_simple_value(20));
+  return cbor_write(cbor_constr_map(entries, n + 1), out, sz);
+}
+
+static int test_map_index(void)
+{
+  printf("Testing: map index\n");
+  uint64_t n = 500;
+  static uint8_t bytes[16384];
+  static uint8_t keys[500][8];
+  static cbor_map_entry entries[501];
+  static cbor_map_index_slot slots[2048];
+  size_t len = write_test_map(bytes, sizeof(bytes), entries, keys, n);
+  CHECK(len > 0);
+  cbor_read_t r = cbor_read(bytes, len);
+  CHECK(r.cbor_read_is_success);
+  cbor maps[2] = { r.cbor_read_payload, cbor_constr_map(entries, n + 1) };
+  for (int m = 0; m < 2; m++)
+  {
+    cbor map = maps[m];
+    size_t slots_length = cbor_map_index_slots_length(map);
+    CHECK(slots_length == 1024);
+    cbor_map_index idx;
+    CHECK(!cbor_map_index_init(map, slots, 1000, &idx));
+    CHECK(cbor_map_index_init(map, slots, slots_length, &idx));
+    for (uint64_t i = 0; i < n + 10; i++)
+    {
+      uint8_t key[8];
+      int klen = snprintf((char *)key, 8, "k%" PRIu64, i);
+      cbor k1 = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i);
+      cbor k2 = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, key, (uint64_t)klen);
+      CHECK(same_map_get(cbor_map_index_get(&idx, k1), CBOR_Pulse_cbor_map_get(k1, map)));
+      CHECK(same_map_get(cbor_map_index_get(&idx, k2), CBOR_Pulse_cbor_map_get(k2, map)));
+    }
+    /* serialized keys */
+    cbor_map_iterator_t it = cbor_map_iterator_init(maps[0]);
+    while (!cbor_map_iterator_is_done(it))
+    {
+      cbor k = cbor_map_iterator_next(&it).cbor_map_entry_key;
+      CHECK(same_map_get(cbor_map_index_get(&idx, k), CBOR_Pulse_cbor_map_get(k, map)));
+    }
+  }
+  return 0;
+}
+
+static int test_canonical_map(void)
+{
+  printf("Testing: canonical map lookup\n");
+  uint64_t n = 500;
+  static uint8_t bytes[16384];
+  static uint8_t keys[500][8];
+  static cbor_map_entry entries[501];
+  static size_t offsets[1001];
+  write_test_map(bytes, sizeof(bytes), entries, keys, n);
+  CHECK(CBOR_Pulse_cbor_map_sort(entries, n));
+  size_t len = cbor_write(cbor_constr_map(entries, n), bytes, sizeof(bytes));
+  CHECK(len > 0);
+  cbor_read_t r = cbor_read_deterministically_encoded(bytes, len);
+  CHECK(r.cbor_read_is_success);
+  cbor map = r.cbor_read_payload;
+  cbor_canonical_map m;
+  CHECK(!cbor_canonical_map_init(map, offsets, 2 * n, &m));
+  CHECK(!cbor_canonical_map_init(cbor_constr_map(entries, n), offsets, 2 * n + 1, &m));
+  CHECK(cbor_canonical_map_init(map, offsets, 2 * n + 1, &m));
+  for (uint64_t i = 0; i < n + 10; i++)
+  {
+    uint8_t key[8];
+    int klen = snprintf((char *)key, 8, "k%" PRIu64, i);
+    cbor k1 = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i);
+    cbor k2 = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, key, (uint64_t)klen);
+    CHECK(same_map_get(cbor_canonical_map_get(&m, k1), CBOR_Pulse_cbor_map_get(k1, map)));
+    CHECK(same_map_get(cbor_canonical_map_get(&m, k2), CBOR_Pulse_cbor_map_get(k2, map)));
+    uint8_t enc[16];
+    size_t enc_len = cbor_write(k2, enc, sizeof(enc));
+    CHECK(same_map_get(cbor_canonical_map_get_encoded(&m, enc, enc_len), CBOR_Pulse_cbor_map_get(k2, map)));
+  }
+  for (uint64_t i = 0; i < n; i++)
+  {
+    uint8_t *pk = m.cbor_canonical_map_base + offsets[2 * i];
+    cbor k = cbor_read(pk, (size_t)(bytes + len - pk)).cbor_read_payload;
+    CHECK(cbor_canonical_map_get(&m, k).tag == CBOR_Pulse_Found);
+  }
+  return 0;
+}
+
+/* The SIMD comparison against the verified loop, on all
+   alignments, on lengths around the vector sizes, and with the first
+   difference at every position */
+/* Lengths up to 100 cover the 32-byte blocks of the AVX2 loop (taken
+   at run time on processors that support it), the 16-byte blocks of
+   the SSE2 loop, and the 8-byte words of the portable tail, around all
+   their boundaries */
+static int test_bytes_compare(void)
+{
+  printf("Testing: byte comparison\n");
+  static uint8_t a1[160];
+  static uint8_t a2[160];
+  uint32_t seed = 42;
+  for (size_t i = 0; i < sizeof(a1); i++)
+  {
+    seed = seed * 1103515245U + 12345U;
+    a1[i] = (uint8_t)(seed >> 16);
+  }
+  for (size_t off1 = 0; off1 < 8; off1++)
+    for (size_t off2 = 0; off2 < 8; off2++)
+      for (size_t sz = 0; sz <= 100; sz++)
+      {
+        memcpy(a2 + off2, a1 + off1, sz);
+        CHECK(CBOR_Pulse_byte_array_compare(sz, a1 + off1, a2 + off2) == 0);
+        CHECK(cbor_bytes_lex_compare(sz, a1 + off1, sz, a2 + off2) == 0);
+        CHECK(cbor_bytes_lex_compare(sz, a1 + off1, sz + 1, a2 + off2) == -1);
+        CHECK(cbor_bytes_lex_compare(sz + 1, a2 + off2, sz, a1 + off1) == 1);
+        for (size_t i = 0; i < sz; i++)
+        {
+          uint8_t save = a2[off2 + i];
+          a2[off2 + i] = (uint8_t)(save + 1 + (i % 255));
+          int16_t c = CBOR_Pulse_byte_array_compare(sz, a1 + off1, a2 + off2);
+          CHECK(c != 0);
+          CHECK(cbor_bytes_lex_compare(sz, a1 + off1, sz, a2 + off2) == c);
+          CHECK(cbor_bytes_lex_compare(sz, a2 + off2, sz, a1 + off1) == -c);
+          CHECK(cbor_bytes_lex_compare(sz, a1 + off1, i + 1, a2 + off2) == c);
+          CHECK(cbor_bytes_lex_compare(sz, a1 + off1, i, a2 + off2) == 1);
+          a2[off2 + i] = save;
+        }
+      }
+  return 0;
+}
+
+/* Keys of all kinds, some of them serialized, with long common
+   prefixes, compared against the verified sort */
+static int test_map_sort(void)
+{
+  printf("Testing: map sort with scratch buffer\n");
+  size_t n = 600;
+  static uint8_t bytes[16384];
+  static uint8_t strs[600][24];
+  static cbor payloads[600];
+  static cbor_map_entry e1[601];
+  static cbor_map_entry e2[601];
+  static cbor_map_sort_entry scratch[1202];
+  size_t pos = 0;
+  uint32_t seed = 17;
+  for (size_t i = 0; i < n; i++)
+  {
+    cbor k;
+    size_t klen = i % 20;
+    memset(strs[i], 'x', sizeof(strs[i]));
+    snprintf((char *)strs[i] + klen, 8, "%zu", i);
+    switch (i % 5)
+    {
+      case 0:
+        k = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, (uint64_t)i * 0x10001ULL);
+        break;
+      case 1:
+        k = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, i);
+        break;
+      case 2:
+        k = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, strs[i], klen + 4);
+        break;
+      case 3:
+        payloads[i] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, strs[i], klen + 4);
+        k = cbor_constr_tagged(1000, &payloads[i]);
+        break;
+      default:
+        k = cbor_constr_simple_value((uint8_t)(i % 20 + (i % 40 < 20 ? 0 : 32)));
+        if (i >= 40)
+          k = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, strs[i], klen + 4);
+        break;
+    }
+    if (i % 3 == 0)
+    {
+      /* serialized key */
+      size_t sz = cbor_write(k, bytes + pos, sizeof(bytes) - pos);
+      CHECK(sz > 0);
+      k = cbor_read(bytes + pos, sz).cbor_read_payload;
+      pos += sz;
+    }
+    e1[i] = cbor_mk_map_entry(k, cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i));
+  }
+  /* shuffle */
+  for (size_t i = n - 1; i > 0; i--)
+  {
+    seed = seed * 1103515245U + 12345U;
+    size_t j = (seed >> 8) % (i + 1);
+    cbor_map_entry tmp = e1[i];
+    e1[i] = e1[j];
+    e1[j] = tmp;
+  }
+  memcpy(e2, e1, n * sizeof(cbor_map_entry));
+  CHECK(CBOR_Pulse_cbor_map_sort(e1, n));
+  CHECK(cbor_map_sort_with_scratch(e2, n, scratch, 2 * n));
+  for (size_t i = 0; i < n; i++)
+  {
+    CHECK(CBOR_Pulse_cbor_is_equal(e1[i].cbor_map_entry_key, e2[i].cbor_map_entry_key));
+    CHECK(CBOR_Pulse_cbor_is_equal(e1[i].cbor_map_entry_value, e2[i].cbor_map_entry_value));
+  }
+  /* sorting again is a no-op */
+  CHECK(cbor_map_sort_with_scratch(e2, n, scratch, 2 * n));
+  for (size_t i = 0; i < n; i++)
+    CHECK(CBOR_Pulse_cbor_is_equal(e1[i].cbor_map_entry_key, e2[i].cbor_map_entry_key));
+  /* duplicate keys, one of them serialized */
+  for (size_t d = 0; d < n; d += 37)
+  {
+    memcpy(e2, e1, n * sizeof(cbor_map_entry));
+    uint8_t enc[64];
+    size_t sz = cbor_write(e1[d].cbor_map_entry_key, enc, sizeof(enc));
+    CHECK(sz > 0);
+    e2[n] = cbor_mk_map_entry(cbor_read(enc, sz).cbor_read_payload, cbor_constr_simple_value(0));
+    cbor_map_entry tmp = e2[n];
+    e2[n] = e2[(d * 7) % n];
+    e2[(d * 7) % n] = tmp;
+    CHECK(!cbor_map_sort_with_scratch(e2, n + 1, scratch, 2 * n + 2));
+    /* left unchanged */
+    CHECK(CBOR_Pulse_cbor_is_equal(e2[(d * 7) % n].cbor_map_entry_key, e1[d].cbor_map_entry_key));
+    CHECK(!CBOR_Pulse_cbor_map_sort(e2, n + 1));
+  }
+  /* scratch too small: falls back to CBOR_Pulse_cbor_map_sort */
+  memcpy(e2, e1, n * sizeof(cbor_map_entry));
+  e2[0] = e1[n - 1];
+  e2[n - 1] = e1[0];
+  CHECK(cbor_map_sort_with_scratch(e2, n, scratch, 2 * n - 1));
+  for (size_t i = 0; i < n; i++)
+    CHECK(CBOR_Pulse_cbor_is_equal(e1[i].cbor_map_entry_key, e2[i].cbor_map_entry_key));
+  return 0;
+}
+
+/* Walks `x` along with the verified API */
+static int check_indexed_item(cbor_indexed_item x, cbor c)
+{
+  CHECK(CBOR_Pulse_cbor_is_equal(cbor_indexed_item_get(x), c));
+  switch (cbor_get_major_type(c))
+  {
+    case CBOR_MAJOR_TYPE_ARRAY:
+    {
+      CHECK(cbor_indexed_item_length(x) == cbor_array_length(c));
+      cbor_array_iterator_t it = cbor_array_iterator_init(c);
+      for (size_t i = 0; !cbor_array_iterator_is_done(it); i++)
+        if (check_indexed_item(cbor_indexed_item_array_index(x, i), cbor_array_iterator_next(&it)))
+          return 1;
+      break;
+    }
+    case CBOR_MAJOR_TYPE_MAP:
+    {
+      CHECK(cbor_indexed_item_length(x) == cbor_map_length(c));
+      cbor_map_iterator_t it = cbor_map_iterator_init(c);
+      for (size_t i = 0; !cbor_map_iterator_is_done(it); i++)
+      {
+        cbor_map_entry e = cbor_map_iterator_next(&it);
+        if (check_indexed_item(cbor_indexed_item_map_key(x, i), e.cbor_map_entry_key)
+          || check_indexed_item(cbor_indexed_item_map_value(x, i), e.cbor_map_entry_value))
+          return 1;
+      }
+      break;
+    }
+    case CBOR_MAJOR_TYPE_TAGGED:
+      CHECK(cbor_indexed_item_length(x) == 1);
+      return check_indexed_item(cbor_indexed_item_tagged_payload(x), cbor_destr_tagged(c).cbor_tagged_payload);
+    default:
+      CHECK(cbor_indexed_item_length(x) == 0);
+      break;
+  }
+  return 0;
+}
+
+/* A nested object: [{"a": [1, [], {}], h'...': 18(-3)}, [[[]]], "xyz", simple(40), 1000000] */
+static size_t write_nested(uint8_t *out, size_t sz)
+{
+  static cbor inner[3];
+  static cbor_map_entry entries[2];
+  static cbor deep[3];
+  static cbor tagged_payload;
+  static cbor top[5];
+  static uint8_t bstr[300];
+  memset(bstr, 7, sizeof(bstr));
+  inner[0] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1);
+  inner[1] = cbor_constr_array(NULL, 0);
+  inner[2] = cbor_constr_map(NULL, 0);
+  tagged_payload = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, 2);
+  entries[0] = cbor_mk_map_entry(cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, (uint8_t *)"a", 1), cbor_constr_array(inner, 3));
+  entries[1] = cbor_mk_map_entry(cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, bstr, sizeof(bstr)), cbor_constr_tagged(18, &tagged_payload));
+  deep[0] = cbor_constr_array(NULL, 0);
+  deep[1] = cbor_constr_array(&deep[0], 1);
+  deep[2] = cbor_constr_array(&deep[1], 1);
+  top[0] = cbor_constr_map(entries, 2);
+  top[1] = deep[2];
+  top[2] = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, (uint8_t *)"xyz", 3);
+  top[3] = cbor_constr_simple_value(40);
+  top[4] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1000000);
+  return cbor_write(cbor_constr_array(top, 5), out, sz);
+}
+
+static int test_read_indexed(void)
+{
+  printf("Testing: validate-and-index reader\n");
+  static uint8_t bytes[1024];
+  static uint8_t mutated[1024];
+  static size_t index[5 * 1024];
+  size_t len = write_nested(bytes, sizeof(bytes));
+  CHECK(len > 0);
+  /* with trailing bytes */
+  bytes[len] = 0x01;
+  cbor_read_t r = cbor_read(bytes, len + 1);
+  CHECK(r.cbor_read_is_success);
+  CHECK(cbor_read_indexed_index_length(len + 1) <= sizeof(index) / sizeof(index[0]));
+  cbor_read_indexed_t ri = cbor_read_indexed(bytes, len + 1, index, cbor_read_indexed_index_length(len + 1));
+  CHECK(ri.cbor_read_indexed_is_success);
+  CHECK(ri.cbor_read_indexed_remainder_length == 1);
+  CHECK(ri.cbor_read_indexed_remainder == bytes + len);
+  if (check_indexed_item(ri.cbor_read_indexed_payload, r.cbor_read_payload))
+    return 1;
+  /* index too short */
+  CHECK(!cbor_read_indexed(bytes, len, index, 10).cbor_read_indexed_is_success);
+  /* same outcome as cbor_read on all prefixes and single-byte mutations */
+  for (size_t i = 0; i <= len; i++)
+  {
+    cbor_read_t r1 = cbor_read(bytes, i);
+    cbor_read_indexed_t r2 = cbor_read_indexed(bytes, i, index, sizeof(index) / sizeof(index[0]));
+    CHECK(r1.cbor_read_is_success == r2.cbor_read_indexed_is_success);
+  }
+  uint8_t values[] = { 0x00, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1f, 0x40, 0x5f, 0x7f, 0x80, 0x9f, 0xa0, 0xbf, 0xc0, 0xd8, 0xe0, 0xf4, 0xf7, 0xf8, 0xf9, 0xfb, 0xff };
+  for (size_t i = 0; i < len; i++)
+    for (size_t v = 0; v < sizeof(values); v++)
+    {
+      memcpy(mutated, bytes, len);
+      mutated[i] = values[v];
+      cbor_read_t r1 = cbor_read(mutated, len);
+      cbor_read_indexed_t r2 = cbor_read_indexed(mutated, len, index, sizeof(index) / sizeof(index[0]));
+      CHECK(r1.cbor_read_is_success == r2.cbor_read_indexed_is_success);
+      if (r1.cbor_read_is_success)
+      {
+        CHECK(r1.cbor_read_remainder_length == r2.cbor_read_indexed_remainder_length);
+        if (check_indexed_item(r2.cbor_read_indexed_payload, r1.cbor_read_payload))
+          return 1;
+      }
+    }
+  return 0;
+}
+
+/* Feeds `a` in chunks of `chunk` bytes; returns the final status */
+static cbor_stream_validator_status stream_validate(uint8_t *a, size_t len, size_t chunk, uint64_t *consumed)
+{
+  cbor_stream_validator v;
+  cbor_stream_validator_init(&v);
+  cbor_stream_validator_status st = CBOR_STREAM_VALIDATOR_NEED_MORE_DATA;
+  size_t off = 0;
+  while (st == CBOR_STREAM_VALIDATOR_NEED_MORE_DATA && off < len)
+  {
+    size_t n = len - off < chunk ? len - off : chunk;
+    size_t pos;
+    st = cbor_stream_validator_feed(&v, a + off, n, &pos);
+    if (st == CBOR_STREAM_VALIDATOR_COMPLETE && off + pos != cbor_stream_validator_consumed(&v))
+      return CBOR_STREAM_VALIDATOR_ERROR;
+    if (st == CBOR_STREAM_VALIDATOR_NEED_MORE_DATA && pos != n)
+      return CBOR_STREAM_VALIDATOR_ERROR;
+    off += n;
+  }
+  *consumed = cbor_stream_validator_consumed(&v);
+  return st;
+}
+
+static int test_stream_validator(void)
+{
+  printf("Testing: incremental validator\n");
+  static uint8_t bytes[1024];
+  static uint8_t mutated[1024];
+  size_t len = write_nested(bytes, sizeof(bytes));
+  CHECK(len > 0);
+  bytes[len] = 0x01;
+  uint8_t values[] = { 0x00, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1f, 0x40, 0x5f, 0x7f, 0x80, 0x9f, 0xa0, 0xbf, 0xc0, 0xd8, 0xe0, 0xf4, 0xf7, 0xf8, 0xf9, 0xfb, 0xff };
+  size_t chunks[] = { 1, 2, 3, 5, 8, 64, 1024 };
+  for (size_t i = 0; i <= len; i++)
+    for (size_t v = 0; v <= sizeof(values); v++)
+    {
+      memcpy(mutated, bytes, len + 1);
+      if (v < sizeof(values))
+        mutated[i] = values[v];
+      cbor_read_t r = cbor_read(mutated, len + 1);
+      for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+      {
+        uint64_t consumed;
+        cbor_stream_validator_status st = stream_validate(mutated, len + 1, chunks[c], &consumed);
+        CHECK((st == CBOR_STREAM_VALIDATOR_COMPLETE) == r.cbor_read_is_success);
+        if (r.cbor_read_is_success)
+          CHECK(consumed == len + 1 - r.cbor_read_remainder_length);
+      }
+    }
+  /* a complete validator consumes nothing more */
+  cbor_stream_validator sv;
+  size_t pos;
+  cbor_stream_validator_init(&sv);
+  CHECK(cbor_stream_validator_feed(&sv, bytes, len + 1, &pos) == CBOR_STREAM_VALIDATOR_COMPLETE);
+  CHECK(pos == len);
+  CHECK(cbor_stream_validator_feed(&sv, bytes, len + 1, &pos) == CBOR_STREAM_VALIDATOR_COMPLETE);
+  CHECK(pos == 0);
+  CHECK(cbor_stream_validator_consumed(&sv) == len);
+  return 0;
+}
+
+static int test_read_sequence(void)
+{
+  printf("Testing: CBOR sequences\n");
+  static uint8_t bytes[65536];
+  static cbor items[64];
+  static size_t offsets[64];
+  size_t len = 0;
+  size_t n = 0;
+  for (; n < 500; n++)
+  {
+    size_t sz;
+    if (n % 10 == 0)
+      sz = write_nested(bytes + len, sizeof(bytes) - len);
+    else if (n % 2 == 0)
+      sz = cbor_write(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, n * n * n), bytes + len, sizeof(bytes) - len);
+    else
+      sz = cbor_write(cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, bytes, n % 30), bytes + len, sizeof(bytes) - len);
+    CHECK(sz > 0);
+    len += sz;
+  }
+  /* a truncated item at the end */
+  size_t full = len;
+  len += write_nested(bytes + len, sizeof(bytes) - len) - 1;
+  uint8_t *p = bytes;
+  size_t rem = len;
+  size_t total = 0;
+  cbor_read_sequence_t rs;
+  do
+  {
+    uint8_t *base = p;
+    rs = cbor_read_sequence(p, rem, items, offsets, 64);
+    CHECK(!rs.cbor_read_sequence_is_invalid);
+    for (size_t i = 0; i < rs.cbor_read_sequence_count; i++)
+    {
+      cbor_read_t r = cbor_read(p, rem);
+      CHECK(r.cbor_read_is_success);
+      CHECK(offsets[i] == (size_t)(p - base));
+      CHECK(CBOR_Pulse_cbor_is_equal(items[i], r.cbor_read_payload));
+      p = r.cbor_read_remainder;
+      rem = r.cbor_read_remainder_length;
+    }
+    CHECK(p == rs.cbor_read_sequence_remainder);
+    total += rs.cbor_read_sequence_count;
+  }
+  while (rs.cbor_read_sequence_count == 64);
+  CHECK(total == n);
+  CHECK(rs.cbor_read_sequence_remainder == bytes + full);
+  CHECK(rs.cbor_read_sequence_remainder_length == len - full);
+  /* an invalid item */
+  bytes[full] = 0x1c;
+  rs = cbor_read_sequence(bytes + full, len - full, items, NULL, 64);
+  CHECK(rs.cbor_read_sequence_count == 0);
+  CHECK(rs.cbor_read_sequence_is_invalid);
+  /* an item that claims more elements than there are bytes left, but
+     is invalid anyway, is not reported as truncated */
+  uint8_t short_invalid[] = { 0x83, 0x01, 0xff };
+  rs = cbor_read_sequence(short_invalid, sizeof(short_invalid), items, NULL, 64);
+  CHECK(rs.cbor_read_sequence_count == 0);
+  CHECK(rs.cbor_read_sequence_is_invalid);
+  rs = cbor_read_sequence(short_invalid, 2, items, NULL, 64);
+  CHECK(rs.cbor_read_sequence_count == 0);
+  CHECK(!rs.cbor_read_sequence_is_invalid);
+  CHECK(rs.cbor_read_sequence_remainder_length == 2);
+  uint8_t short_map[] = { 0xbb, 0x40, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x1c };
+  rs = cbor_read_sequence(short_map, sizeof(short_map), items, NULL, 64);
+  CHECK(rs.cbor_read_sequence_is_invalid);
+  rs = cbor_read_sequence(short_map, sizeof(short_map) - 1, items, NULL, 64);
+  CHECK(!rs.cbor_read_sequence_is_invalid);
+  /* same outcome as cbor_read on single-byte mutations */
+  len = write_nested(bytes, sizeof(bytes));
+  for (size_t i = 0; i < len; i++)
+    for (size_t v = 0; v < 256; v++)
+    {
+      uint8_t save = bytes[i];
+      bytes[i] = (uint8_t)v;
+      cbor_read_t r = cbor_read(bytes, len);
+      rs = cbor_read_sequence(bytes, len, items, NULL, 1);
+      CHECK((rs.cbor_read_sequence_count == 1) == r.cbor_read_is_success);
+      if (r.cbor_read_is_success)
+        CHECK(rs.cbor_read_sequence_remainder_length == r.cbor_read_remainder_length);
+      bytes[i] = save;
+    }
+  return 0;
+}
+
+static int test_header_decoding(void)
+{
+  printf("Testing: header decoding\n");
+  static const uint64_t args[] = {
+    0, 23, 24, 31, 32, 255, 256, 65535, 65536, 4294967295ULL, 4294967296ULL, UINT64_MAX
+  };
+  uint8_t bytes[64];
+  cbor items[1];
+  /* every initial byte, with arguments at the bounds of each encoding
+     size, followed by zeros, as a whole and truncated */
+  for (size_t b = 0; b < 256; b++)
+    for (size_t j = 0; j < sizeof(args) / sizeof(args[0]); j++)
+    {
+      size_t ai = b & 31;
+      size_t hs = 1 + (ai >= 24 && ai < 28 ? (size_t)1 << (ai - 24) : 0);
+      memset(bytes, 0, sizeof(bytes));
+      bytes[0] = (uint8_t)b;
+      for (size_t i = 1; i < hs; i++)
+        bytes[i] = (uint8_t)(args[j] >> (8 * (hs - 1 - i)));
+      for (size_t len = 1; len <= sizeof(bytes); len++)
+      {
+        cbor_read_t r = cbor_read(bytes, len);
+        cbor_read_sequence_t rs = cbor_read_sequence(bytes, len, items, NULL, 1);
+        CHECK((rs.cbor_read_sequence_count == 1) == r.cbor_read_is_success);
+        if (r.cbor_read_is_success)
+          CHECK(rs.cbor_read_sequence_remainder_length == r.cbor_read_remainder_length);
+      }
+    }
+  return 0;
+}
+
+static int test_traversal(void)
+{
+  printf("Testing: traversals with an explicit stack\n");
+  static uint8_t nested[1024];
+  static uint8_t out1[1024];
+  static uint8_t out2[1024];
+  static cbor_traversal_frame stack[20000];
+  static cbor deep[20000];
+  static uint8_t deep_bytes[20000];
+  static cbor elts[5];
+  static cbor_map_entry entries[2];
+  static cbor tagged_payload;
+  size_t nested_len = write_nested(nested, sizeof(nested));
+  cbor_read_t rn = cbor_read(nested, nested_len);
+  CHECK(rn.cbor_read_is_success);
+  tagged_payload = rn.cbor_read_payload;
+  entries[0] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 3), cbor_constr_tagged(1000, &tagged_payload));
+  entries[1] = cbor_mk_map_entry(cbor_constr_simple_value(20), cbor_constr_map(NULL, 0));
+  elts[0] = rn.cbor_read_payload;
+  elts[1] = cbor_constr_map(entries, 2);
+  elts[2] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, nested, 30);
+  elts[3] = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, 65536);
+  deep[0] = cbor_constr_array(NULL, 0);
+  for (size_t i = 1; i < 20; i++)
+    deep[i] = cbor_constr_array(&deep[i - 1], 1);
+  elts[4] = deep[19];
+  cbor c = cbor_constr_array(elts, 5);
+  /* same encoding as cbor_write */
+  size_t len = cbor_write(c, out1, sizeof(out1));
+  CHECK(len > 0);
+  size_t res;
+  CHECK(cbor_size_with_stack(c, sizeof(out2), stack, 100, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(res == len);
+  CHECK(cbor_write_with_stack(c, out2, sizeof(out2), stack, 100, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(res == len);
+  CHECK(memcmp(out1, out2, len) == 0);
+  for (size_t sz = 0; sz < len; sz++)
+  {
+    CHECK(cbor_size_with_stack(c, sz, stack, 100, &res) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+    CHECK(cbor_write_with_stack(c, out2, sz, stack, 100, &res) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+    CHECK(res == len);
+  }
+  /* 21 levels: the array, deep[19] to deep[1] */
+  CHECK(cbor_write_with_stack(c, out2, sizeof(out2), stack, 20, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(cbor_write_with_stack(c, out2, sizeof(out2), stack, 19, &res) == CBOR_TRAVERSAL_MAX_DEPTH);
+  /* same order as CBOR_Pulse_cbor_compare, on constructed and serialized
+     items, including mixed */
+  cbor_read_t rc = cbor_read(out1, len);
+  CHECK(rc.cbor_read_is_success);
+  cbor vals[16];
+  size_t n = 0;
+  vals[n++] = c;
+  vals[n++] = rc.cbor_read_payload;
+  for (size_t i = 0; i < 5; i++)
+    vals[n++] = elts[i];
+  vals[n++] = entries[0].cbor_map_entry_value;
+  vals[n++] = cbor_constr_tagged(1000, &elts[3]);
+  vals[n++] = deep[18];
+  vals[n++] = cbor_constr_array(elts, 4);
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < n; j++)
+    {
+      int16_t r;
+      CHECK(cbor_compare_with_stack(vals[i], vals[j], stack, 100, &r) == CBOR_TRAVERSAL_SUCCESS);
+      CHECK(r == CBOR_Pulse_cbor_compare(vals[i], vals[j]));
+    }
+  /* deeper than the C stack would allow with recursion */
+  size_t depth = sizeof(deep) / sizeof(deep[0]);
+  for (size_t i = 1; i < depth; i++)
+    deep[i] = cbor_constr_array(&deep[i - 1], 1);
+  CHECK(cbor_write_with_stack(deep[depth - 1], deep_bytes, sizeof(deep_bytes), stack, depth, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(res == depth);
+  CHECK(deep_bytes[0] == 0x81 && deep_bytes[depth - 1] == 0x80);
+  cbor_read_t rd = cbor_read(deep_bytes, depth);
+  CHECK(rd.cbor_read_is_success);
+  int16_t r;
+  CHECK(cbor_compare_with_stack(deep[depth - 1], rd.cbor_read_payload, stack, depth, &r) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(r == 0);
+  CHECK(cbor_compare_with_stack(deep[depth - 2], rd.cbor_read_payload, stack, depth, &r) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(r == -1);
+  CHECK(cbor_compare_with_stack(deep[depth - 1], rd.cbor_read_payload, stack, 100, &r) == CBOR_TRAVERSAL_MAX_DEPTH);
+  return 0;
+}
+
+static int test_compact(void)
+{
+  printf("Testing: compact representation\n");
+  static uint8_t nested[1024];
+  static uint8_t out1[1024];
+  static uint8_t out2[1024];
+  static cbor elts[5];
+  static cbor_map_entry entries[2];
+  static cbor tagged_payload;
+  static cbor_compact storage[64];
+  static cbor_compact_frame stack[4];
+  static cbor back[16];
+  static cbor_map_entry back_entries[4];
+  if (sizeof(void *) == 8)
+    CHECK(sizeof(cbor_compact) == 16);
+  size_t nested_len = write_nested(nested, sizeof(nested));
+  cbor_read_t rn = cbor_read(nested, nested_len);
+  CHECK(rn.cbor_read_is_success);
+  tagged_payload = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, (uint8_t *)"tag", 3);
+  entries[0] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 3), cbor_constr_tagged(1000, &tagged_payload));
+  entries[1] = cbor_mk_map_entry(cbor_constr_simple_value(20), cbor_constr_map(NULL, 0));
+  elts[0] = rn.cbor_read_payload;
+  elts[1] = cbor_constr_map(entries, 2);
+  elts[2] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, nested, 30);
+  elts[3] = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, 65536);
+  elts[4] = cbor_constr_array(NULL, 0);
+  cbor c = cbor_constr_array(elts, 5);
+  size_t len = cbor_write(c, out1, sizeof(out1));
+  CHECK(len > 0);
+  /* 5 elements, 4 keys and values, 1 tag payload */
+  cbor_compact cc;
+  CHECK(!cbor_compact_of_cbor(c, storage, 9, &cc));
+  CHECK(cbor_compact_of_cbor(c, storage, 10, &cc));
+  size_t len2;
+  CHECK(cbor_compact_write(cc, out2, sizeof(out2), stack, 4, &len2) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(len2 == len && memcmp(out1, out2, len) == 0);
+  CHECK(cbor_compact_write(cc, out2, len - 1, stack, 4, &len2) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  /* the array, the map and the tag; the frame of the tag is dropped
+     before its payload is written */
+  CHECK(cbor_compact_write(cc, out2, sizeof(out2), stack, 2, &len2) == CBOR_TRAVERSAL_MAX_DEPTH);
+  CHECK(cbor_compact_write(cc, out2, sizeof(out2), stack, 3, &len2) == CBOR_TRAVERSAL_SUCCESS);
+  /* back to `cbor`: 5 elements and 1 tag payload, 2 map entries */
+  cbor cb;
+  CHECK(!cbor_of_compact(cc, back, 5, back_entries, 2, &cb));
+  CHECK(!cbor_of_compact(cc, back, 6, back_entries, 1, &cb));
+  CHECK(cbor_of_compact(cc, back, 6, back_entries, 2, &cb));
+  CHECK(cbor_write(cb, out2, sizeof(out2)) == len);
+  CHECK(memcmp(out1, out2, len) == 0);
+  CHECK(cb.case_CBOR_Case_Array.cbor_array_payload[0].tag == CBOR_Case_Serialized);
+  /* destructors, on the constructed and serialized forms */
+  cbor_read_t rc = cbor_read(out1, len);
+  CHECK(rc.cbor_read_is_success);
+  cbor_compact cs;
+  CHECK(cbor_compact_of_cbor(rc.cbor_read_payload, storage, 0, &cs));
+  cbor_compact both[2] = { cc, cs };
+  for (size_t i = 0; i < 2; i++)
+  {
+    cbor_compact x = both[i];
+    CHECK(cbor_compact_get_major_type(x) == CBOR_MAJOR_TYPE_ARRAY);
+    CHECK(cbor_compact_array_length(x) == 5);
+    CHECK(cbor_compact_write(cbor_compact_array_index(x, 0), out2, sizeof(out2), stack, 4, &len2) == CBOR_TRAVERSAL_SUCCESS);
+    CHECK(len2 == nested_len && memcmp(out2, nested, nested_len) == 0);
+    cbor_compact m = cbor_compact_array_index(x, 1);
+    CHECK(cbor_compact_get_major_type(m) == CBOR_MAJOR_TYPE_MAP);
+    CHECK(cbor_compact_map_length(m) == 2);
+    CHECK(cbor_compact_destr_int64(cbor_compact_map_key(m, 0)).cbor_int_value == 3);
+    cbor_compact t = cbor_compact_map_value(m, 0);
+    CHECK(cbor_compact_get_major_type(t) == CBOR_MAJOR_TYPE_TAGGED);
+    CHECK(cbor_compact_tagged_tag(t) == 1000);
+    cbor_string s = cbor_compact_destr_string(cbor_compact_tagged_payload(t));
+    CHECK(s.cbor_string_type == CBOR_MAJOR_TYPE_TEXT_STRING && s.cbor_string_length == 3);
+    CHECK(memcmp(s.cbor_string_payload, "tag", 3) == 0);
+    CHECK(cbor_compact_destr_simple_value(cbor_compact_map_key(m, 1)) == 20);
+    CHECK(cbor_compact_map_length(cbor_compact_map_value(m, 1)) == 0);
+    s = cbor_compact_destr_string(cbor_compact_array_index(x, 2));
+    CHECK(s.cbor_string_type == CBOR_MAJOR_TYPE_BYTE_STRING && s.cbor_string_length == 30);
+    cbor_int n = cbor_compact_destr_int64(cbor_compact_array_index(x, 3));
+    CHECK(n.cbor_int_type == CBOR_MAJOR_TYPE_NEG_INT64 && n.cbor_int_value == 65536);
+    CHECK(cbor_compact_array_length(cbor_compact_array_index(x, 4)) == 0);
+  }
+  /* constructors */
+  cbor_compact kv[2] = {
+    cbor_compact_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, (uint8_t *)"a", 1),
+    cbor_compact_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1000000)
+  };
+  cbor_compact items[2] = { cbor_compact_constr_map(kv, 1), cbor_compact_constr_simple_value(40) };
+  cbor_compact tg = cbor_compact_constr_tagged(2, &items[1]);
+  cbor_compact arr[2] = { items[0], tg };
+  CHECK(cbor_compact_write(cbor_compact_constr_array(arr, 2), out2, sizeof(out2), stack, 4, &len) == CBOR_TRAVERSAL_SUCCESS);
+  static const uint8_t expected[] = { 0x82, 0xa1, 0x61, 'a', 0x1a, 0x00, 0x0f, 0x42, 0x40, 0xc2, 0xf8, 40 };
+  CHECK(len == sizeof(expected));
+  CHECK(memcmp(out2, expected, len) == 0);
+  return 0;
+}
+
+static int test_iovec(void)
+{
+  printf("Testing: scatter-gather writing\n");
+  static uint8_t nested[1024];
+  static uint8_t big[1000];
+  static uint8_t out1[4096];
+  static uint8_t out2[4096];
+  static uint8_t scratch[1024];
+  static cbor_traversal_frame stack[16];
+  static cbor elts[6];
+  static cbor_map_entry entries[2];
+  struct iovec iov[32];
+  for (size_t i = 0; i < sizeof(big); i++)
+    big[i] = (uint8_t)i;
+  size_t nested_len = write_nested(nested, sizeof(nested));
+  cbor_read_t rn = cbor_read(nested, nested_len);
+  CHECK(rn.cbor_read_is_success);
+  entries[0] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 3), cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, big, 10));
+  entries[1] = cbor_mk_map_entry(cbor_constr_simple_value(20), cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, big, sizeof(big)));
+  elts[0] = rn.cbor_read_payload;
+  elts[1] = cbor_constr_map(entries, 2);
+  elts[2] = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, 65536);
+  elts[3] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, big, 100);
+  elts[4] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 1);
+  elts[5] = cbor_constr_array(NULL, 0);
+  cbor c = cbor_constr_array(elts, 6);
+  size_t len = cbor_write(c, out1, sizeof(out1));
+  CHECK(len > 0);
+  size_t n;
+  CHECK(cbor_write_iovec(c, scratch, sizeof(scratch), iov, 32, stack, 16, &n) == CBOR_TRAVERSAL_SUCCESS);
+  /* the concatenation of the buffers is the encoding */
+  size_t pos = 0;
+  bool found = false;
+  for (size_t i = 0; i < n; i++)
+  {
+    CHECK(iov[i].iov_len > 0 && pos + iov[i].iov_len <= sizeof(out2));
+    memcpy(out2 + pos, iov[i].iov_base, iov[i].iov_len);
+    pos += iov[i].iov_len;
+    /* long payloads are not copied */
+    if (iov[i].iov_base == big)
+    {
+      CHECK(iov[i].iov_len == sizeof(big) || iov[i].iov_len == 100);
+      found = true;
+    }
+    CHECK(iov[i].iov_base != nested || iov[i].iov_len == nested_len);
+  }
+  CHECK(found);
+  CHECK(pos == len);
+  CHECK(memcmp(out1, out2, len) == 0);
+  /* array and map headers, the short string and the small integers are
+     merged: scratch, nested, scratch, big (1000), scratch, big (100),
+     scratch */
+  CHECK(n == 7);
+  CHECK(cbor_write_iovec(c, scratch, sizeof(scratch), iov, 6, stack, 16, &n) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  CHECK(cbor_write_iovec(c, scratch, 16, iov, 32, stack, 16, &n) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  CHECK(cbor_write_iovec(c, scratch, sizeof(scratch), iov, 32, stack, 1, &n) == CBOR_TRAVERSAL_MAX_DEPTH);
+  return 0;
+}
+
+static int test_encoded_size(void)
+{
+  printf("Testing: encoded size\n");
+  static uint8_t nested[1024];
+  static uint8_t out[4096];
+  static cbor_traversal_frame stack[16];
+  static cbor elts[3];
+  size_t nested_len = write_nested(nested, sizeof(nested));
+  cbor_read_t rn = cbor_read(nested, nested_len);
+  CHECK(rn.cbor_read_is_success);
+  elts[0] = rn.cbor_read_payload;
+  elts[1] = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, nested, 300);
+  elts[2] = cbor_constr_array(elts, 2);
+  cbor c = cbor_constr_array(elts, 3);
+  size_t len = cbor_write(c, out, sizeof(out));
+  CHECK(len > 0);
+  size_t res;
+  CHECK(cbor_encoded_size(c, stack, 16, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(res == len);
+  /* a buffer of the size returned on overflow is large enough */
+  CHECK(cbor_write_with_stack(c, out, 10, stack, 16, &res) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  CHECK(res == len);
+  CHECK(cbor_write_with_stack(c, out, res, stack, 16, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(res == len);
+  CHECK(cbor_encoded_size(c, stack, 1, &res) == CBOR_TRAVERSAL_MAX_DEPTH);
+  /* sizes beyond SIZE_MAX saturate; the payloads are never read */
+  elts[0] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, nested, (uint64_t)(SIZE_MAX / 2U));
+  elts[1] = elts[0];
+  elts[2] = elts[0];
+  CHECK(cbor_encoded_size(c, stack, 16, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(res == SIZE_MAX);
+  CHECK(cbor_write_with_stack(c, out, sizeof(out), stack, 16, &res) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  CHECK(res == SIZE_MAX);
+  return 0;
+}
+
+static bool give_up(cbor_output *o, size_t needed)
+{
+  return false;
+}
+
+static int test_output(void)
+{
+  printf("Testing: growable output\n");
+  static uint8_t nested[1024];
+  static uint8_t out[4096];
+  static uint8_t flat[4096];
+  static cbor_traversal_frame stack[16];
+  static cbor elts[4];
+  size_t nested_len = write_nested(nested, sizeof(nested));
+  cbor_read_t rn = cbor_read(nested, nested_len);
+  CHECK(rn.cbor_read_is_success);
+  elts[0] = rn.cbor_read_payload;
+  elts[1] = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, nested, 300);
+  elts[2] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 0x123456789ULL);
+  elts[3] = cbor_constr_array(elts, 3);
+  cbor c = cbor_constr_array(elts, 4);
+  size_t len = cbor_write(c, out, sizeof(out));
+  CHECK(len > 0);
+  /* with realloc, starting from no buffer, and appending twice */
+  cbor_output o = {
+    .cbor_output_buffer = NULL,
+    .cbor_output_length = 0,
+    .cbor_output_position = 0,
+    .cbor_output_next = cbor_output_next_realloc,
+    .cbor_output_context = NULL
+  };
+  CHECK(cbor_output_write(c, &o, stack, 16) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(cbor_output_write(c, &o, stack, 16) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(o.cbor_output_position == 2 * len && o.cbor_output_length >= 2 * len);
+  CHECK(memcmp(o.cbor_output_buffer, out, len) == 0);
+  CHECK(memcmp(o.cbor_output_buffer + len, out, len) == 0);
+  free(o.cbor_output_buffer);
+  /* in chunks of all sizes, including smaller than headers */
+  for (size_t chunk_size = 1; chunk_size <= len + 1; chunk_size += chunk_size < 16 ? 1 : 37)
+  {
+    cbor_output_chunk *first = cbor_output_chunks_init(&o, chunk_size);
+    CHECK(first != NULL);
+    CHECK(cbor_output_write(c, &o, stack, 16) == CBOR_TRAVERSAL_SUCCESS);
+    size_t pos = 0;
+    for (cbor_output_chunk *ch = first; ch != NULL; ch = ch->cbor_output_chunk_next)
+    {
+      size_t n = ch->cbor_output_chunk_next == NULL ? o.cbor_output_position : chunk_size;
+      CHECK(pos + n <= sizeof(flat));
+      memcpy(flat + pos, ch->cbor_output_chunk_data, n);
+      pos += n;
+    }
+    cbor_output_chunks_free(first);
+    CHECK(pos == len);
+    CHECK(memcmp(flat, out, len) == 0);
+  }
+  /* a callback that gives up, and a stack too small */
+  uint8_t small[16];
+  o.cbor_output_buffer = small;
+  o.cbor_output_length = sizeof(small);
+  o.cbor_output_position = 0;
+  o.cbor_output_next = give_up;
+  CHECK(cbor_output_write(c, &o, stack, 16) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  o.cbor_output_buffer = flat;
+  o.cbor_output_length = sizeof(flat);
+  o.cbor_output_position = 0;
+  CHECK(cbor_output_write(c, &o, stack, 1) == CBOR_TRAVERSAL_MAX_DEPTH);
+  return 0;
+}
+
+static int test_r2l_write(void)
+{
+  printf("Testing: right-to-left writing\n");
+  static uint8_t nested[1024];
+  static uint8_t out1[4096];
+  static uint8_t out2[4096];
+  static cbor_traversal_frame stack[32];
+  static cbor deep[20];
+  static cbor elts[6];
+  static cbor_map_entry entries[3];
+  static cbor tagged_payload;
+  size_t nested_len = write_nested(nested, sizeof(nested));
+  cbor_read_t rn = cbor_read(nested, nested_len);
+  CHECK(rn.cbor_read_is_success);
+  tagged_payload = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, nested, 30);
+  entries[0] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 3), cbor_constr_tagged(1000, &tagged_payload));
+  entries[1] = cbor_mk_map_entry(cbor_constr_simple_value(20), cbor_constr_map(NULL, 0));
+  entries[2] = cbor_mk_map_entry(rn.cbor_read_payload, cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, 70000));
+  deep[0] = cbor_constr_array(NULL, 0);
+  for (size_t i = 1; i < 20; i++)
+    deep[i] = cbor_constr_array(&deep[i - 1], 1);
+  elts[0] = rn.cbor_read_payload;
+  elts[1] = cbor_constr_map(entries, 3);
+  elts[2] = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, nested, 300);
+  elts[3] = deep[19];
+  elts[4] = cbor_constr_tagged(55799, &elts[2]);
+  elts[5] = cbor_constr_simple_value(255);
+  cbor c = cbor_constr_array(elts, 6);
+  size_t len = cbor_write(c, out1, sizeof(out1));
+  CHECK(len > 0);
+  size_t start;
+  CHECK(cbor_r2l_write(c, out2, sizeof(out2), stack, 32, &start) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(start == sizeof(out2) - len);
+  CHECK(memcmp(out1, out2 + start, len) == 0);
+  /* an exact fit, then one byte short */
+  CHECK(cbor_r2l_write(c, out2, len, stack, 32, &start) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(start == 0);
+  CHECK(memcmp(out1, out2, len) == 0);
+  for (size_t sz = 0; sz < len; sz++)
+    CHECK(cbor_r2l_write(c, out2, sz, stack, 32, &start) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  /* 21 levels: the array, deep[19] to deep[1] */
+  CHECK(cbor_r2l_write(c, out2, sizeof(out2), stack, 20, &start) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(cbor_r2l_write(c, out2, sizeof(out2), stack, 19, &start) == CBOR_TRAVERSAL_MAX_DEPTH);
+  /* a tag around it only adds its header in front */
+  CHECK(cbor_r2l_write(c, out2, sizeof(out2), stack, 32, &start) == CBOR_TRAVERSAL_SUCCESS);
+  size_t inner = start;
+  CHECK(cbor_r2l_write(cbor_constr_tagged(18, &c), out1, sizeof(out1), stack, 32, &start) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(start == sizeof(out1) - len - 1);
+  CHECK(out1[start] == 0xd2);
+  CHECK(memcmp(out1 + start + 1, out2 + inner, len) == 0);
+  return 0;
+}
+
+static int test_write_canonical_map(void)
+{
+  printf("Testing: canonical map writing\n");
+  size_t n = 600;
+  static uint8_t bytes[16384];
+  static uint8_t keys[16384];
+  static uint8_t out1[32768];
+  static uint8_t out2[32768];
+  static uint8_t strs[600][24];
+  static cbor payloads[600];
+  static cbor_map_entry e1[600];
+  static cbor_map_entry e2[600];
+  static cbor_canonical_map_entry entries[600];
+  static cbor_traversal_frame stack[8];
+  size_t pos = 0;
+  uint32_t seed = 42;
+  for (size_t i = 0; i < n; i++)
+  {
+    cbor k;
+    size_t klen = i % 20;
+    memset(strs[i], 'y', sizeof(strs[i]));
+    snprintf((char *)strs[i] + klen, 8, "%zu", i);
+    switch (i % 4)
+    {
+      case 0:
+        k = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, (uint64_t)i * 0x10001ULL);
+        break;
+      case 1:
+        k = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, strs[i], klen + 4);
+        break;
+      case 2:
+        payloads[i] = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, strs[i], klen + 4);
+        k = cbor_constr_tagged(1000, &payloads[i]);
+        break;
+      default:
+        k = cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, i);
+        break;
+    }
+    if (i % 3 == 0)
+    {
+      /* serialized key */
+      size_t sz = cbor_write(k, bytes + pos, sizeof(bytes) - pos);
+      CHECK(sz > 0);
+      k = cbor_read(bytes + pos, sz).cbor_read_payload;
+      pos += sz;
+    }
+    e1[i] = cbor_mk_map_entry(k, cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i));
+  }
+  for (size_t i = n - 1; i > 0; i--)
+  {
+    seed = seed * 1103515245U + 12345U;
+    size_t j = (seed >> 8) % (i + 1);
+    cbor_map_entry tmp = e1[i];
+    e1[i] = e1[j];
+    e1[j] = tmp;
+  }
+  memcpy(e2, e1, n * sizeof(cbor_map_entry));
+  /* same bytes as sorting, then writing */
+  size_t len1;
+  CHECK(cbor_write_canonical_map(e1, n, out1, sizeof(out1), keys, sizeof(keys), entries, n, stack, 8, &len1) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(memcmp(e1, e2, n * sizeof(cbor_map_entry)) == 0);
+  CHECK(CBOR_Pulse_cbor_map_sort(e2, n));
+  size_t len2 = cbor_write(cbor_constr_map(e2, n), out2, sizeof(out2));
+  CHECK(len2 > 0);
+  CHECK(len1 == len2);
+  CHECK(memcmp(out1, out2, len1) == 0);
+  CHECK(cbor_read_deterministically_encoded(out1, len1).cbor_read_is_success);
+  size_t res;
+  CHECK(cbor_write_canonical_map(e1, 0, out1, 1, keys, 0, entries, 0, stack, 8, &res) == CBOR_TRAVERSAL_SUCCESS);
+  CHECK(res == 1 && out1[0] == 0xa0);
+  /* storage too small */
+  CHECK(cbor_write_canonical_map(e1, n, out1, len1 - 1, keys, sizeof(keys), entries, n, stack, 8, &res) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  CHECK(cbor_write_canonical_map(e1, n, out1, sizeof(out1), keys, 100, entries, n, stack, 8, &res) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  CHECK(cbor_write_canonical_map(e1, n, out1, sizeof(out1), keys, sizeof(keys), entries, n - 1, stack, 8, &res) == CBOR_TRAVERSAL_OUTPUT_TOO_SMALL);
+  /* a duplicate key, serialized on one side */
+  uint8_t dup[64];
+  size_t dup_len = cbor_write(e1[0].cbor_map_entry_key, dup, sizeof(dup));
+  CHECK(dup_len > 0);
+  e1[1].cbor_map_entry_key = cbor_read(dup, dup_len).cbor_read_payload;
+  CHECK(cbor_write_canonical_map(e1, n, out1, sizeof(out1), keys, sizeof(keys), entries, n, stack, 8, &res) == CBOR_CANONICAL_MAP_DUPLICATE_KEY);
+  return 0;
+}
+
+static int test_file(void)
+{
+  printf("Testing: memory-mapped files\n");
+  static uint8_t nested[1024];
+  size_t nested_len = write_nested(nested, sizeof(nested));
+  char path[] = "/tmp/CBORUnverifiedTestXXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  /* two items, then a truncated one */
+  bool written =
+    write(fd, nested, nested_len) == (ssize_t)nested_len
+    && write(fd, nested, nested_len) == (ssize_t)nested_len
+    && write(fd, nested, 3) == 3;
+  close(fd);
+  cbor_file f;
+  cbor_file_status st = cbor_file_open(path, &f);
+  unlink(path);
+  CHECK(written);
+  CHECK(st == CBOR_FILE_SUCCESS);
+  CHECK(f.cbor_file_size == 2 * nested_len + 3);
+  cbor_read_t r = cbor_file_read(&f, 0);
+  CHECK(r.cbor_read_is_success);
+  CHECK(r.cbor_read_payload.tag == CBOR_Case_Serialized);
+  CHECK(r.cbor_read_payload.case_CBOR_Case_Serialized.cbor_serialized_payload == f.cbor_file_base);
+  CHECK(r.cbor_read_remainder_length == nested_len + 3);
+  cbor_read_t rn = cbor_read(nested, nested_len);
+  CHECK(CBOR_Pulse_cbor_compare(r.cbor_read_payload, rn.cbor_read_payload) == 0);
+  r = cbor_file_read(&f, nested_len);
+  CHECK(r.cbor_read_is_success);
+  CHECK(r.cbor_read_remainder_length == 3);
+  CHECK(!cbor_file_read(&f, 2 * nested_len).cbor_read_is_success);
+  CHECK(!cbor_file_read(&f, f.cbor_file_size).cbor_read_is_success);
+  cbor_file_close(&f);
+  CHECK(f.cbor_file_base == NULL);
+  /* empty and missing files */
+  strcpy(path + strlen(path) - 6, "XXXXXX");
+  fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+  st = cbor_file_open(path, &f);
+  unlink(path);
+  CHECK(st == CBOR_FILE_SUCCESS);
+  CHECK(f.cbor_file_size == 0);
+  CHECK(!cbor_file_read(&f, 0).cbor_read_is_success);
+  cbor_file_close(&f);
+  CHECK(cbor_file_open(path, &f) == CBOR_FILE_ERROR);
+  return 0;
+}
+
+static int test_path(void)
+{
+  printf("Testing: path queries\n");
+  static uint8_t out[65536];
+  static uint8_t keybuf[64];
+  static cbor rows[40];
+  static cbor fields[40][5];
+  static cbor_map_entry entries[3];
+  static cbor tagged_payload;
+  static uint8_t str[] = "payload";
+  tagged_payload = cbor_constr_string(CBOR_MAJOR_TYPE_BYTE_STRING, str, 3);
+  for (size_t i = 0; i < 40; i++)
+  {
+    fields[i][0] = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i);
+    fields[i][1] = cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, str, i % 8);
+    fields[i][2] = cbor_constr_array(fields[i], 2);
+    fields[i][3] = cbor_constr_tagged(1000 + i, &tagged_payload);
+    fields[i][4] = cbor_constr_simple_value(21);
+    rows[i] = cbor_constr_array(fields[i], 5);
+  }
+  entries[0] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_NEG_INT64, 4), cbor_constr_array(rows, 10));
+  entries[1] = cbor_mk_map_entry(cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, str, 7), cbor_constr_array(rows, 40));
+  entries[2] = cbor_mk_map_entry(cbor_constr_simple_value(20), cbor_constr_map(NULL, 0));
+  cbor doc = cbor_constr_map(entries, 3);
+  size_t len = cbor_write(doc, out, sizeof(out));
+  CHECK(len > 0);
+  cbor_read_t r = cbor_read(out, len);
+  CHECK(r.cbor_read_is_success);
+  /* field 3 of element 17 of key "payload", then its tag */
+  cbor_path_step path[4];
+  CHECK(cbor_path_step_key_of_cbor(entries[1].cbor_map_entry_key, keybuf, sizeof(keybuf), &path[0]));
+  path[1] = cbor_path_step_index(17);
+  path[2] = cbor_path_step_index(3);
+  path[3] = cbor_path_step_tag(1017);
+  cbor res;
+  /* on the serialized, constructed, and mixed documents */
+  cbor docs[3];
+  static cbor_map_entry mixed[3];
+  memcpy(mixed, entries, sizeof(mixed));
+  mixed[1].cbor_map_entry_value = CBOR_Pulse_cbor_map_get(entries[1].cbor_map_entry_key, r.cbor_read_payload)._0;
+  docs[0] = r.cbor_read_payload;
+  docs[1] = doc;
+  docs[2] = cbor_constr_map(mixed, 3);
+  for (size_t d = 0; d < 3; d++)
+  {
+    CHECK(cbor_path_get(docs[d], path, 3, &res));
+    CHECK(CBOR_Pulse_cbor_is_equal(res, fields[17][3]));
+    if (d != 1)
+    {
+      CHECK(res.tag == CBOR_Case_Serialized);
+      CHECK(res.case_CBOR_Case_Serialized.cbor_serialized_payload > out);
+      CHECK(res.case_CBOR_Case_Serialized.cbor_serialized_payload < out + len);
+    }
+    CHECK(cbor_path_get(docs[d], path, 4, &res));
+    CHECK(CBOR_Pulse_cbor_is_equal(res, tagged_payload));
+    CHECK(cbor_path_get(docs[d], path, 0, &res));
+    CHECK(CBOR_Pulse_cbor_is_equal(res, doc));
+    /* the last element of the last array */
+    cbor_path_step last[3] = { path[0], cbor_path_step_index(39), cbor_path_step_index(4) };
+    CHECK(cbor_path_get(docs[d], last, 3, &res));
+    CHECK(CBOR_Pulse_cbor_is_equal(res, fields[39][4]));
+    /* steps that do not apply */
+    cbor_path_step bad[4];
+    bad[0] = path[0];
+    bad[1] = cbor_path_step_index(40);
+    CHECK(!cbor_path_get(docs[d], bad, 2, &res));
+    bad[1] = path[1];
+    bad[2] = path[2];
+    bad[3] = cbor_path_step_tag(1016);
+    CHECK(!cbor_path_get(docs[d], bad, 4, &res));
+    bad[3] = cbor_path_step_index(0);
+    CHECK(!cbor_path_get(docs[d], bad, 4, &res));
+    bad[0] = cbor_path_step_key(str, 3);
+    CHECK(!cbor_path_get(docs[d], bad, 1, &res));
+    uint8_t missing = 0x05;
+    bad[0] = cbor_path_step_key(&missing, 1);
+    CHECK(!cbor_path_get(docs[d], bad, 1, &res));
+    bad[0] = cbor_path_step_index(0);
+    CHECK(!cbor_path_get(docs[d], bad, 1, &res));
+  }
+  return 0;
+}
+
+/* COSE_Sign1 = #6.18([ bstr, header_map, bstr / nil, bstr ])
+   header_map = { ? 1 => int, * (uint / tstr) => any }
+   with `1 ^=> int` if `cut` */
+static uint32_t compile_cose_sign1(cddl_program *p, bool cut)
+{
+  uint32_t tint = cddl_tchoice(p, cddl_telem(p, CDDL_ELEM_UINT), cddl_telem(p, CDDL_ELEM_NINT));
+  uint32_t label = cddl_tchoice(p, cddl_telem(p, CDDL_ELEM_UINT), cddl_telem(p, CDDL_ELEM_TEXT_STRING));
+  uint32_t alg = cddl_gmap_elem(p, cut, cddl_tliteral_int(p, CBOR_MAJOR_TYPE_UINT64, 1), tint);
+  uint32_t rest = cddl_gzero_or_more(p, cddl_gmap_elem(p, false, label, cddl_telem(p, CDDL_ELEM_ANY)));
+  uint32_t header_map = cddl_tmap(p, cddl_gconcat(p, cddl_gzero_or_one(p, alg), rest));
+  uint32_t bstr = cddl_telem(p, CDDL_ELEM_BYTE_STRING);
+  uint32_t payload = cddl_tchoice(p, bstr, cddl_tliteral_simple(p, 22));
+  uint32_t g =
+    cddl_gconcat(p, cddl_garray_elem(p, bstr),
+      cddl_gconcat(p, cddl_garray_elem(p, header_map),
+        cddl_gconcat(p, cddl_garray_elem(p, payload), cddl_garray_elem(p, bstr))));
+  return cddl_ttagged(p, 18, cddl_tarray(p, g));
+}
+
+static cddl_validate_status
+validate_bytes(cddl_program *p, uint32_t t, uint8_t *a, size_t len, uint8_t *scratch, size_t scratch_length)
+{
+  cbor_read_t r = cbor_read(a, len);
+  if (!r.cbor_read_is_success || r.cbor_read_remainder_length != 0)
+    return 0xFF;
+  return cddl_validate(p, t, r.cbor_read_payload, scratch, scratch_length);
+}
+
+static int test_cddl(void)
+{
+  printf("Testing: compiled CDDL validation\n");
+  static cddl_insn insns[128];
+  static uint8_t literals[64];
+  static uint32_t defs[2];
+  static uint8_t scratch[4096];
+  static uint8_t out[1024];
+  cddl_program p;
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), defs, 2);
+  uint32_t sign1 = compile_cose_sign1(&p, false);
+  CHECK(sign1 != CDDL_NONE);
+  /* 18([h'a1', {1: -7, "kid": h'', 4: [0]}, h'', h'00']) */
+  uint8_t msg[] = {
+    0xd2, 0x84, 0x41, 0xa1, 0xa3, 0x01, 0x26, 0x63, 'k', 'i', 'd', 0x40, 0x04, 0x81, 0x00,
+    0x40, 0x41, 0x00
+  };
+  CHECK(validate_bytes(&p, sign1, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  /* nil payload */
+  msg[15] = 0xf6;
+  CHECK(validate_bytes(&p, sign1, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  /* false payload */
+  msg[15] = 0xf4;
+  CHECK(validate_bytes(&p, sign1, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  msg[15] = 0x40;
+  /* a key that is neither 1, a uint nor a tstr */
+  msg[12] = 0x20;
+  CHECK(validate_bytes(&p, sign1, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  msg[12] = 0x04;
+  /* another tag */
+  msg[0] = 0xd1;
+  CHECK(validate_bytes(&p, sign1, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  msg[0] = 0xd2;
+  /* 1 => "" : without cut, `? 1 => int` matches nothing and the entry
+     goes to `* uint => any`; with cut, the map is rejected */
+  msg[6] = 0x60;
+  CHECK(validate_bytes(&p, sign1, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  uint32_t sign1_cut = compile_cose_sign1(&p, true);
+  CHECK(sign1_cut != CDDL_NONE);
+  CHECK(validate_bytes(&p, sign1_cut, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  msg[6] = 0x26;
+  CHECK(validate_bytes(&p, sign1_cut, msg, sizeof(msg), scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  /* duplicate keys */
+  uint8_t dup[] = { 0xd2, 0x84, 0x40, 0xa2, 0x04, 0x00, 0x04, 0x01, 0x40, 0x40 };
+  CHECK(validate_bytes(&p, sign1, dup, sizeof(dup), scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  dup[6] = 0x05;
+  CHECK(validate_bytes(&p, sign1, dup, sizeof(dup), scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  /* not enough scratch space for the map */
+  CHECK(validate_bytes(&p, sign1, dup, sizeof(dup), scratch, 8) == CDDL_VALIDATE_OUT_OF_SCRATCH);
+  CHECK(cddl_validate_scratch_length(&p, sizeof(dup)) <= sizeof(scratch));
+  /* data items that are not serialized */
+  cbor_read_t r = cbor_read(dup, sizeof(dup));
+  CHECK(r.cbor_read_is_success);
+  cbor_tagged tg = cbor_destr_tagged(r.cbor_read_payload);
+  cbor elts[4];
+  CHECK(cbor_read_array(tg.cbor_tagged_payload, elts, 4) != NULL);
+  elts[2] = cbor_constr_simple_value(22);
+  cbor arr = cbor_constr_array(elts, 4);
+  cbor c = cbor_constr_tagged(18, &arr);
+  CHECK(cddl_validate(&p, sign1, c, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  CHECK(cddl_validate(&p, sign1, c, scratch, 4) == CDDL_VALIDATE_OUT_OF_SCRATCH);
+  elts[2] = cbor_constr_simple_value(23);
+  CHECK(cddl_validate(&p, sign1, c, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  /* array groups do not backtrack: [* uint, uint] matches nothing */
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), defs, 2);
+  uint32_t uint = cddl_telem(&p, CDDL_ELEM_UINT);
+  uint32_t greedy =
+    cddl_tarray(&p, cddl_gconcat(&p, cddl_gzero_or_more(&p, cddl_garray_elem(&p, uint)), cddl_garray_elem(&p, uint)));
+  uint8_t two[] = { 0x82, 0x01, 0x02 };
+  CHECK(validate_bytes(&p, greedy, two, sizeof(two), scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  uint32_t ones =
+    cddl_tarray(&p, cddl_gconcat(&p, cddl_gone_or_more(&p, cddl_garray_elem(&p, uint)), cddl_gnop(&p)));
+  CHECK(validate_bytes(&p, ones, two, sizeof(two), scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  CHECK(validate_bytes(&p, ones, two, 1, scratch, sizeof(scratch)) == 0xFF);
+  uint8_t empty[] = { 0x80 };
+  CHECK(validate_bytes(&p, ones, empty, 1, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  /* recursive definitions: tree = uint / [* tree] */
+  uint32_t tree = cddl_tchoice(&p, uint, cddl_tarray(&p, cddl_gzero_or_more(&p, cddl_garray_elem(&p, cddl_tdef(&p, 0)))));
+  CHECK(cddl_program_define(&p, 0, tree));
+  uint8_t forest[] = { 0x83, 0x01, 0x82, 0x80, 0x81, 0x02, 0x03 };
+  CHECK(validate_bytes(&p, tree, forest, sizeof(forest), scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  forest[5] = 0x40;
+  CHECK(validate_bytes(&p, tree, forest, sizeof(forest), scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  size_t deep_len = CDDL_MAX_DEPTH + 1;
+  uint8_t *deep = malloc(deep_len);
+  CHECK(deep != NULL);
+  memset(deep, 0x81, deep_len - 1);
+  deep[deep_len - 1] = 0x00;
+  CHECK(validate_bytes(&p, tree, deep, deep_len, scratch, sizeof(scratch)) == CDDL_VALIDATE_MAX_DEPTH);
+  free(deep);
+  /* a definition that loops without consuming anything */
+  uint32_t loop = cddl_tdef(&p, 1);
+  CHECK(cddl_program_define(&p, 1, cddl_tchoice(&p, loop, uint)));
+  CHECK(validate_bytes(&p, loop, two, sizeof(two), scratch, sizeof(scratch)) == CDDL_VALIDATE_MAX_DEPTH);
+  /* tagged choices dispatch on the initial byte, which tags from 24 on
+     share */
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), defs, 2);
+  uint32_t u = cddl_telem(&p, CDDL_ELEM_ALWAYS_FALSE);
+  for (uint64_t k = 30; k > 0; k--)
+    u = cddl_tchoice(&p, cddl_ttagged(&p, k, cddl_tliteral_int(&p, CBOR_MAJOR_TYPE_UINT64, k)), u);
+  CHECK(u != CDDL_NONE);
+  CHECK(insns[u].cddl_insn_first_bytes[3] == 0x1FFFFFEULL);
+  for (uint8_t k = 1; k <= 31; k++)
+  {
+    /* #6.k(k) */
+    uint8_t item[4];
+    size_t item_len = 2;
+    item[0] = 0xc0 | k;
+    item[1] = k;
+    if (k >= 24)
+    {
+      item[0] = 0xd8;
+      item[2] = 0x18;
+      item[3] = k;
+      item_len = 4;
+    }
+    cddl_validate_status expected = k <= 30 ? CDDL_VALIDATE_VALID : CDDL_VALIDATE_INVALID;
+    CHECK(validate_bytes(&p, u, item, item_len, scratch, sizeof(scratch)) == expected);
+    /* #6.k(k + 1) */
+    if (k != 23)
+    {
+      item[item_len - 1]++;
+      CHECK(validate_bytes(&p, u, item, item_len, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+    }
+  }
+  /* the initial bytes of a definition are known once it is defined */
+  uint32_t named = cddl_tchoice(&p, cddl_tdef(&p, 0), cddl_telem(&p, CDDL_ELEM_TEXT_STRING));
+  CHECK(named != CDDL_NONE);
+  CHECK(insns[named].cddl_insn_first_bytes[0] == 0ULL);
+  CHECK(insns[named].cddl_insn_first_bytes[1] == 0x0FFFFFFFULL << 32);
+  CHECK(validate_bytes(&p, named, two + 1, 1, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  CHECK(cddl_program_define(&p, 0, cddl_telem(&p, CDDL_ELEM_UINT)));
+  CHECK(insns[named].cddl_insn_first_bytes[0] == 0x0FFFFFFFULL);
+  CHECK(validate_bytes(&p, named, two + 1, 1, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  /* rejected by the compiler */
+  uint32_t any = cddl_telem(&p, CDDL_ELEM_ANY);
+  uint32_t key_one = cddl_tliteral_int(&p, CBOR_MAJOR_TYPE_UINT64, 1);
+  CHECK(cddl_tmap(&p, cddl_gmap_elem(&p, false, uint, any)) == CDDL_NONE);
+  CHECK(cddl_gzero_or_more(&p, cddl_gmap_elem(&p, true, uint, any)) == CDDL_NONE);
+  CHECK(cddl_gzero_or_more(&p, cddl_gmap_elem(&p, true, key_one, any)) == CDDL_NONE);
+  CHECK(cddl_gconcat(&p, cddl_garray_elem(&p, uint), cddl_gmap_elem(&p, false, key_one, any)) == CDDL_NONE);
+  CHECK(cddl_tarray(&p, cddl_gmap_elem(&p, false, key_one, any)) == CDDL_NONE);
+  CHECK(cddl_tchoice(&p, uint, CDDL_NONE) == CDDL_NONE);
+  CHECK(cddl_tliteral_simple(&p, 24) == CDDL_NONE);
+  CHECK(!cddl_program_define(&p, 2, uint));
+  /* the program is full */
+  while (cddl_gnop(&p) != CDDL_NONE)
+    ;
+  CHECK(cddl_telem(&p, CDDL_ELEM_ANY) == CDDL_NONE);
+  /* { * tstr => any } on a map from the verified API */
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), defs, 2);
+  uint32_t table =
+    cddl_tmap(&p, cddl_gzero_or_more(&p, cddl_gmap_elem(&p, false, cddl_telem(&p, CDDL_ELEM_TEXT_STRING), cddl_telem(&p, CDDL_ELEM_ANY))));
+  CHECK(table != CDDL_NONE);
+  static uint8_t str[] = "abcdefghijklmnopqrstuvwxyz";
+  cbor_map_entry entries[26];
+  for (size_t i = 0; i < 26; i++)
+    entries[i] =
+      cbor_mk_map_entry(cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, str + i, 26 - i), cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, i));
+  size_t len = cbor_write(cbor_constr_map(entries, 26), out, sizeof(out));
+  CHECK(len > 0);
+  CHECK(validate_bytes(&p, table, out, len, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  entries[7].cbor_map_entry_key = cbor_constr_simple_value(20);
+  len = cbor_write(cbor_constr_map(entries, 26), out, sizeof(out));
+  CHECK(len > 0);
+  CHECK(validate_bytes(&p, table, out, len, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  /* { ? 1 => uint, ..., ? 20 => uint, * tstr => any }, matched with a
+     table of 20 keys */
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), defs, 2);
+  uint32_t record = cddl_gzero_or_more(&p, cddl_gmap_elem(&p, false, cddl_telem(&p, CDDL_ELEM_TEXT_STRING), cddl_telem(&p, CDDL_ELEM_ANY)));
+  uint32_t uint_value = cddl_telem(&p, CDDL_ELEM_UINT);
+  for (uint64_t k = 20; k > 0; k--)
+    record = cddl_gconcat(&p, cddl_gzero_or_one(&p, cddl_gmap_elem(&p, false, cddl_tliteral_int(&p, CBOR_MAJOR_TYPE_UINT64, k), uint_value)), record);
+  record = cddl_tmap(&p, record);
+  CHECK(record != CDDL_NONE);
+  CHECK(p.cddl_program_max_keys == 20);
+  cbor_map_entry fields[21];
+  for (size_t k = 0; k < 20; k++)
+    fields[k] = cbor_mk_map_entry(cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 20 - k), cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, k * 1000));
+  fields[20] = cbor_mk_map_entry(cbor_constr_string(CBOR_MAJOR_TYPE_TEXT_STRING, str, 1), cbor_constr_array(NULL, 0));
+  len = cbor_write(cbor_constr_map(fields, 21), out, sizeof(out));
+  CHECK(len > 0);
+  size_t record_scratch_length = cddl_validate_scratch_length(&p, len);
+  uint8_t *record_scratch = malloc(record_scratch_length);
+  CHECK(record_scratch != NULL);
+  CHECK(validate_bytes(&p, record, out, len, record_scratch, record_scratch_length) == CDDL_VALIDATE_VALID);
+  free(record_scratch);
+  /* a uint value for a tstr key, a tstr value for a uint key */
+  fields[20].cbor_map_entry_value = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 0);
+  len = cbor_write(cbor_constr_map(fields, 21), out, sizeof(out));
+  CHECK(validate_bytes(&p, record, out, len, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  fields[3].cbor_map_entry_value = fields[20].cbor_map_entry_key;
+  len = cbor_write(cbor_constr_map(fields, 21), out, sizeof(out));
+  CHECK(validate_bytes(&p, record, out, len, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  fields[3].cbor_map_entry_value = fields[4].cbor_map_entry_value;
+  /* a key in neither the table nor `tstr` */
+  fields[0].cbor_map_entry_key = cbor_constr_int64(CBOR_MAJOR_TYPE_UINT64, 21);
+  len = cbor_write(cbor_constr_map(fields, 21), out, sizeof(out));
+  CHECK(validate_bytes(&p, record, out, len, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  /* duplicate keys, in the table or not */
+  fields[0].cbor_map_entry_key = fields[1].cbor_map_entry_key;
+  len = cbor_write(cbor_constr_map(fields, 21), out, sizeof(out));
+  CHECK(validate_bytes(&p, record, out, len, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  fields[0].cbor_map_entry_key = fields[20].cbor_map_entry_key;
+  len = cbor_write(cbor_constr_map(fields, 21), out, sizeof(out));
+  CHECK(validate_bytes(&p, record, out, len, scratch, sizeof(scratch)) == CDDL_VALIDATE_INVALID);
+  /* with the empty map */
+  uint8_t empty_map[] = { 0xa0 };
+  CHECK(validate_bytes(&p, record, empty_map, 1, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  return 0;
+}
+
+/* COSE_Sign1, as in `compile_cose_sign1`, decoded into a struct */
+typedef struct test_header_s
+{
+  uint32_t label_case;
+  uint64_t label_uint;
+  cbor_string label_tstr;
+  cbor value;
+}
+test_header;
+
+typedef struct test_sign1_s
+{
+  cbor_string protected;
+  uint32_t has_alg;
+  cbor_int alg;
+  cddl_records headers;
+  uint32_t payload_case;
+  cbor_string payload;
+  cbor_string signature;
+}
+test_sign1;
+
+typedef struct test_line_s
+{
+  uint64_t x[2];
+  uint64_t y[2];
+}
+test_line;
+
+/* [* COSE_Sign1], decoded into records of `test_sign1` */
+static uint32_t compile_test_sign1s(cddl_program *p)
+{
+  uint32_t uint = cddl_telem(p, CDDL_ELEM_UINT);
+  uint32_t tint = cddl_tchoice(p, uint, cddl_telem(p, CDDL_ELEM_NINT));
+  uint32_t bstr = cddl_telem(p, CDDL_ELEM_BYTE_STRING);
+  uint32_t label =
+    cddl_tchoice(p,
+      cddl_tcase(p, cddl_tstore(p, uint, CDDL_FIELD_UINT64, offsetof(test_header, label_uint)), offsetof(test_header, label_case), 1),
+      cddl_tcase(p,
+        cddl_tstore(p, cddl_telem(p, CDDL_ELEM_TEXT_STRING), CDDL_FIELD_STRING, offsetof(test_header, label_tstr)),
+        offsetof(test_header, label_case), 2));
+  uint32_t alg =
+    cddl_gmap_elem(p, false, cddl_tliteral_int(p, CBOR_MAJOR_TYPE_UINT64, 1),
+      cddl_tcase(p, cddl_tstore(p, tint, CDDL_FIELD_INT, offsetof(test_sign1, alg)), offsetof(test_sign1, has_alg), 1));
+  uint32_t rest =
+    cddl_gstore_each(p,
+      cddl_gzero_or_more(p,
+        cddl_gmap_elem(p, false, label, cddl_tstore(p, cddl_telem(p, CDDL_ELEM_ANY), CDDL_FIELD_ITEM, offsetof(test_header, value)))),
+      offsetof(test_sign1, headers), sizeof(test_header));
+  uint32_t payload =
+    cddl_tchoice(p,
+      cddl_tcase(p, cddl_tstore(p, bstr, CDDL_FIELD_STRING, offsetof(test_sign1, payload)), offsetof(test_sign1, payload_case), 1),
+      cddl_tcase(p, cddl_tliteral_simple(p, 22), offsetof(test_sign1, payload_case), 2));
+  uint32_t g =
+    cddl_gconcat(p, cddl_garray_elem(p, cddl_tstore(p, bstr, CDDL_FIELD_STRING, offsetof(test_sign1, protected))),
+      cddl_gconcat(p, cddl_garray_elem(p, cddl_tmap(p, cddl_gconcat(p, cddl_gzero_or_one(p, alg), rest))),
+        cddl_gconcat(p, cddl_garray_elem(p, payload),
+          cddl_garray_elem(p, cddl_tstore(p, bstr, CDDL_FIELD_STRING, offsetof(test_sign1, signature))))));
+  uint32_t sign1 = cddl_ttagged(p, 18, cddl_tarray(p, g));
+  return
+    cddl_tarray(p, cddl_gstore_each(p, cddl_gzero_or_more(p, cddl_garray_elem(p, sign1)), 0, sizeof(test_sign1)));
+}
+
+static int test_cddl_decode(void)
+{
+  printf("Testing: typed CDDL decoding\n");
+  static cddl_insn insns[128];
+  static uint8_t literals[16];
+  static uint32_t defs[1];
+  static uint8_t scratch[4096];
+  static uint8_t storage[4096];
+  cddl_program p;
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), defs, 1);
+  uint32_t messages = compile_test_sign1s(&p);
+  CHECK(messages != CDDL_NONE);
+  /* [18([h'a1', {1: -7, "kid": h'', 4: [0]}, h'', h'00']),
+      18([h'', {5: 1}, nil, h'0102'])] */
+  uint8_t msgs[] = {
+    0x82,
+    0xd2, 0x84, 0x41, 0xa1, 0xa3, 0x01, 0x26, 0x63, 'k', 'i', 'd', 0x40, 0x04, 0x81, 0x00,
+    0x40, 0x41, 0x00,
+    0xd2, 0x84, 0x40, 0xa1, 0x05, 0x01, 0xf6, 0x42, 0x01, 0x02
+  };
+  cbor_read_t r = cbor_read(msgs, sizeof(msgs));
+  CHECK(r.cbor_read_is_success);
+  cddl_records res;
+  CHECK(
+    cddl_decode(&p, messages, r.cbor_read_payload, (uint8_t *)&res, sizeof(res), storage, sizeof(storage), scratch, sizeof(scratch))
+    == CDDL_VALIDATE_VALID
+  );
+  CHECK(res.cddl_records_length == 2);
+  test_sign1 *m = (test_sign1 *)res.cddl_records_payload;
+  CHECK(m[0].protected.cbor_string_length == 1 && m[0].protected.cbor_string_payload == msgs + 4);
+  CHECK(m[0].has_alg == 1);
+  CHECK(m[0].alg.cbor_int_type == CBOR_MAJOR_TYPE_NEG_INT64 && m[0].alg.cbor_int_value == 6);
+  CHECK(m[0].headers.cddl_records_length == 2);
+  test_header *h = (test_header *)m[0].headers.cddl_records_payload;
+  CHECK(h[0].label_case == 2 && h[0].label_tstr.cbor_string_length == 3);
+  CHECK(memcmp(h[0].label_tstr.cbor_string_payload, "kid", 3) == 0);
+  CHECK(cbor_get_major_type(h[0].value) == CBOR_MAJOR_TYPE_BYTE_STRING);
+  CHECK(h[1].label_case == 1 && h[1].label_uint == 4);
+  CHECK(cbor_get_major_type(h[1].value) == CBOR_MAJOR_TYPE_ARRAY && cbor_array_length(h[1].value) == 1);
+  CHECK(m[0].payload_case == 1 && m[0].payload.cbor_string_length == 0);
+  CHECK(m[0].signature.cbor_string_length == 1 && m[0].signature.cbor_string_payload[0] == 0x00);
+  CHECK(m[1].has_alg == 0);
+  CHECK(m[1].headers.cddl_records_length == 1);
+  h = (test_header *)m[1].headers.cddl_records_payload;
+  CHECK(h[0].label_case == 1 && h[0].label_uint == 5);
+  CHECK(m[1].payload_case == 2);
+  CHECK(m[1].signature.cbor_string_length == 2 && m[1].signature.cbor_string_payload[1] == 0x02);
+  /* stores do not change the data items that the program accepts */
+  CHECK(cddl_validate(&p, messages, r.cbor_read_payload, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  /* 1 => "" is not an algorithm, but one of the other headers */
+  msgs[7] = 0x60;
+  r = cbor_read(msgs, sizeof(msgs));
+  CHECK(r.cbor_read_is_success);
+  CHECK(
+    cddl_decode(&p, messages, r.cbor_read_payload, (uint8_t *)&res, sizeof(res), storage, sizeof(storage), scratch, sizeof(scratch))
+    == CDDL_VALIDATE_VALID
+  );
+  m = (test_sign1 *)res.cddl_records_payload;
+  CHECK(m[0].has_alg == 0 && m[0].headers.cddl_records_length == 3);
+  h = (test_header *)m[0].headers.cddl_records_payload;
+  CHECK(h[0].label_case == 1 && h[0].label_uint == 1);
+  CHECK(cbor_get_major_type(h[0].value) == CBOR_MAJOR_TYPE_TEXT_STRING);
+  /* not enough storage for the records */
+  CHECK(
+    cddl_decode(&p, messages, r.cbor_read_payload, (uint8_t *)&res, sizeof(res), storage, sizeof(test_sign1), scratch, sizeof(scratch))
+    == CDDL_VALIDATE_OUT_OF_STORAGE
+  );
+  /* an invalid message */
+  msgs[26] = 0xf4;
+  r = cbor_read(msgs, sizeof(msgs));
+  CHECK(r.cbor_read_is_success);
+  CHECK(
+    cddl_decode(&p, messages, r.cbor_read_payload, (uint8_t *)&res, sizeof(res), storage, sizeof(storage), scratch, sizeof(scratch))
+    == CDDL_VALIDATE_INVALID
+  );
+  /* line = [point, point], point = [uint, uint]: the same definition
+     decoded into two structs */
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), defs, 1);
+  uint32_t uint = cddl_telem(&p, CDDL_ELEM_UINT);
+  uint32_t point =
+    cddl_tarray(&p,
+      cddl_gconcat(&p, cddl_garray_elem(&p, cddl_tstore(&p, uint, CDDL_FIELD_UINT64, 0)),
+        cddl_garray_elem(&p, cddl_tstore(&p, uint, CDDL_FIELD_UINT64, sizeof(uint64_t)))));
+  CHECK(cddl_program_define(&p, 0, point));
+  uint32_t line =
+    cddl_tarray(&p,
+      cddl_gconcat(&p, cddl_garray_elem(&p, cddl_tstruct(&p, cddl_tdef(&p, 0), offsetof(test_line, x))),
+        cddl_garray_elem(&p, cddl_tstruct(&p, cddl_tdef(&p, 0), offsetof(test_line, y)))));
+  CHECK(line != CDDL_NONE);
+  uint8_t pts[] = { 0x82, 0x82, 0x01, 0x02, 0x82, 0x18, 0x64, 0x19, 0x01, 0x00 };
+  r = cbor_read(pts, sizeof(pts));
+  CHECK(r.cbor_read_is_success);
+  test_line l;
+  CHECK(
+    cddl_decode(&p, line, r.cbor_read_payload, (uint8_t *)&l, sizeof(l), NULL, 0, scratch, sizeof(scratch))
+    == CDDL_VALIDATE_VALID
+  );
+  CHECK(l.x[0] == 1 && l.x[1] == 2 && l.y[0] == 100 && l.y[1] == 256);
+  /* [(uint .store a, tstr) // (uint .store b, uint)]: the first
+     alternative writes a before it fails on [5, 6] */
+  uint32_t tstr = cddl_telem(&p, CDDL_ELEM_TEXT_STRING);
+  uint32_t ab =
+    cddl_tarray(&p,
+      cddl_gchoice(&p,
+        cddl_gconcat(&p, cddl_garray_elem(&p, cddl_tstore(&p, uint, CDDL_FIELD_UINT64, 0)), cddl_garray_elem(&p, tstr)),
+        cddl_gconcat(&p,
+          cddl_garray_elem(&p, cddl_tstore(&p, uint, CDDL_FIELD_UINT64, sizeof(uint64_t))),
+          cddl_garray_elem(&p, uint))));
+  CHECK(ab != CDDL_NONE);
+  uint8_t five_six[] = { 0x82, 0x05, 0x06 };
+  r = cbor_read(five_six, sizeof(five_six));
+  CHECK(r.cbor_read_is_success);
+  CHECK(
+    cddl_decode(&p, ab, r.cbor_read_payload, (uint8_t *)&l, sizeof(l), storage, sizeof(storage), scratch, sizeof(scratch))
+    == CDDL_VALIDATE_VALID
+  );
+  CHECK(l.x[0] == 0 && l.x[1] == 5);
+  /* the fields written are saved in the storage */
+  CHECK(
+    cddl_decode(&p, ab, r.cbor_read_payload, (uint8_t *)&l, sizeof(l), NULL, 0, scratch, sizeof(scratch))
+    == CDDL_VALIDATE_OUT_OF_STORAGE
+  );
+  /* [* (uint .store a, tstr), uint]: the last iteration writes a = 2
+     before it fails, which gives back the a = 1 of the one before */
+  uint32_t last =
+    cddl_tarray(&p,
+      cddl_gconcat(&p,
+        cddl_gzero_or_more(&p,
+          cddl_gconcat(&p, cddl_garray_elem(&p, cddl_tstore(&p, uint, CDDL_FIELD_UINT64, 0)), cddl_garray_elem(&p, tstr))),
+        cddl_garray_elem(&p, uint)));
+  CHECK(last != CDDL_NONE);
+  uint8_t one_x_two[] = { 0x83, 0x01, 0x61, 'x', 0x02 };
+  r = cbor_read(one_x_two, sizeof(one_x_two));
+  CHECK(r.cbor_read_is_success);
+  CHECK(
+    cddl_decode(&p, last, r.cbor_read_payload, (uint8_t *)&l, sizeof(l), storage, sizeof(storage), scratch, sizeof(scratch))
+    == CDDL_VALIDATE_VALID
+  );
+  CHECK(l.x[0] == 1);
+  /* rejected by the compiler */
+  CHECK(cddl_gstore_each(&p, cddl_garray_elem(&p, uint), 0, 8) == CDDL_NONE);
+  CHECK(cddl_gstore_each(&p, cddl_gzero_or_more(&p, cddl_garray_elem(&p, uint)), 0, 0) == CDDL_NONE);
+  CHECK(cddl_tstore(&p, uint, CDDL_FIELD_ITEM + 1, 0) == CDDL_NONE);
+  return 0;
+}
+
+static int test_cddl_encode(void)
+{
+  printf("Testing: typed CDDL encoding\n");
+  static cddl_insn insns[128];
+  static uint8_t literals[16];
+  static uint8_t scratch[4096];
+  static uint8_t storage[4096];
+  static uint8_t out[256];
+  cddl_program p;
+  cddl_program_init(&p, insns, 128, literals, sizeof(literals), NULL, 0);
+  uint32_t messages = compile_test_sign1s(&p);
+  CHECK(messages != CDDL_NONE);
+  /* as in `test_cddl_decode`: encoding gives the same bytes back, except
+     that the entries of the first header map are sorted by their keys */
+  uint8_t msgs[] = {
+    0x82,
+    0xd2, 0x84, 0x41, 0xa1, 0xa3, 0x01, 0x26, 0x63, 'k', 'i', 'd', 0x40, 0x04, 0x81, 0x00,
+    0x40, 0x41, 0x00,
+    0xd2, 0x84, 0x40, 0xa1, 0x05, 0x01, 0xf6, 0x42, 0x01, 0x02
+  };
+  cbor_read_t r = cbor_read(msgs, sizeof(msgs));
+  CHECK(r.cbor_read_is_success);
+  cddl_records res;
+  CHECK(
+    cddl_decode(&p, messages, r.cbor_read_payload, (uint8_t *)&res, sizeof(res), storage, sizeof(storage), scratch, sizeof(scratch))
+    == CDDL_VALIDATE_VALID
+  );
+  size_t sz;
+  CHECK(cddl_encoded_size(&p, messages, (uint8_t *)&res, &sz) == CDDL_VALIDATE_VALID);
+  CHECK(sz == sizeof(msgs));
+  size_t len;
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, out, sz, &len) == CDDL_VALIDATE_VALID);
+  uint8_t sorted[] = { 0xa3, 0x01, 0x26, 0x04, 0x81, 0x00, 0x63, 'k', 'i', 'd', 0x40 };
+  CHECK(len == sizeof(msgs) && memcmp(out, msgs, 5) == 0 && memcmp(out + 5, sorted, sizeof(sorted)) == 0);
+  CHECK(memcmp(out + 16, msgs + 16, sizeof(msgs) - 16) == 0);
+  r = cbor_read_deterministically_encoded(out, len);
+  CHECK(r.cbor_read_is_success && r.cbor_read_remainder_length == 0);
+  CHECK(cddl_validate(&p, messages, r.cbor_read_payload, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, out, sz - 1, &len) == CDDL_VALIDATE_OUTPUT_TOO_SMALL);
+  /* a header whose label is that of the algorithm, and a header value
+     that is not deterministically encoded */
+  test_header *h = (test_header *)((test_sign1 *)res.cddl_records_payload)->headers.cddl_records_payload;
+  CHECK(h[1].label_case == 1 && h[1].label_uint == 4);
+  h[1].label_uint = 1;
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, out, sizeof(out), &len) == CDDL_VALIDATE_INVALID);
+  h[1].label_uint = 4;
+  cbor value = h[1].value;
+  uint8_t five[] = { 0x18, 0x05 };
+  h[1].value = (cbor){ .tag = CBOR_Case_Serialized, { .case_CBOR_Case_Serialized = { .cbor_serialized_payload = five, .cbor_serialized_size = 2 } } };
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, out, sizeof(out), &len) == CDDL_VALIDATE_INVALID);
+  h[1].value = value;
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, out, sizeof(out), &len) == CDDL_VALIDATE_VALID);
+  CHECK(len == sizeof(msgs));
+  /* a message built from scratch, with an algorithm, no other header,
+     and a 300-byte payload */
+  static uint8_t payload[300];
+  memset(payload, 0x5a, sizeof(payload));
+  test_sign1 m;
+  memset(&m, 0, sizeof(m));
+  m.protected = (cbor_string){ .cbor_string_type = CBOR_MAJOR_TYPE_BYTE_STRING, .cbor_string_length = 0, .cbor_string_payload = NULL };
+  m.has_alg = 1;
+  m.alg = (cbor_int){ .cbor_int_type = CBOR_MAJOR_TYPE_NEG_INT64, .cbor_int_value = 34 };
+  m.payload_case = 1;
+  m.payload = (cbor_string){ .cbor_string_type = CBOR_MAJOR_TYPE_BYTE_STRING, .cbor_string_length = 300, .cbor_string_payload = payload };
+  m.signature = m.protected;
+  res = (cddl_records){ .cddl_records_payload = (uint8_t *)&m, .cddl_records_length = 1 };
+  CHECK(cddl_encoded_size(&p, messages, (uint8_t *)&res, &sz) == CDDL_VALIDATE_VALID);
+  CHECK(sz == 1 + 2 + 1 + 4 + 3 + 300 + 1);
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, out, sizeof(out), &len) == CDDL_VALIDATE_OUTPUT_TOO_SMALL);
+  static uint8_t big[512];
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, big, sizeof(big), &len) == CDDL_VALIDATE_VALID);
+  CHECK(len == sz);
+  r = cbor_read(big, len);
+  CHECK(r.cbor_read_is_success && r.cbor_read_remainder_length == 0);
+  CHECK(cddl_validate(&p, messages, r.cbor_read_payload, scratch, sizeof(scratch)) == CDDL_VALIDATE_VALID);
+  uint8_t prefix[] = { 0x81, 0xd2, 0x84, 0x40, 0xa1, 0x01, 0x38, 0x22, 0x59, 0x01, 0x2c, 0x5a };
+  CHECK(memcmp(big, prefix, sizeof(prefix)) == 0);
+  /* nil payload */
+  m.payload_case = 2;
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, big, sizeof(big), &len) == CDDL_VALIDATE_VALID);
+  CHECK(len == sz - 302 && big[8] == 0xf6);
+  /* structs that describe no COSE_Sign1 */
+  m.payload_case = 0;
+  CHECK(cddl_encoded_size(&p, messages, (uint8_t *)&res, &sz) == CDDL_VALIDATE_INVALID);
+  m.payload_case = 1;
+  m.signature.cbor_string_type = CBOR_MAJOR_TYPE_TEXT_STRING;
+  CHECK(cddl_encoded_size(&p, messages, (uint8_t *)&res, &sz) == CDDL_VALIDATE_INVALID);
+  m.signature.cbor_string_type = CBOR_MAJOR_TYPE_BYTE_STRING;
+  /* an algorithm that is not an integer: as when decoding, `? 1 => int`
+     then matches nothing */
+  m.alg.cbor_int_type = CBOR_MAJOR_TYPE_TEXT_STRING;
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, big, sizeof(big), &len) == CDDL_VALIDATE_VALID);
+  CHECK(len == 309 && big[4] == 0xa0);
+  /* without records, `* COSE_Sign1` writes nothing */
+  res.cddl_records_length = 0;
+  CHECK(cddl_encode(&p, messages, (uint8_t *)&res, big, sizeof(big), &len) == CDDL_VALIDATE_VALID);
+  CHECK(len == 1 && big[0] == 0x80);
+  return 0;
+}
+
+int main(void)
+{
+  if (test_indexed_array())
+    return 1;
+  if (test_map_index())
+    return 1;
+  if (test_canonical_map())
+    return 1;
+  if (test_bytes_compare())
+    return 1;
+  if (test_map_sort())
+    return 1;
+  if (test_read_indexed())
+    return 1;
+  if (test_stream_validator())
+    return 1;
+  if (test_read_sequence())
+    return 1;
+  if (test_header_decoding())
+    return 1;
+  if (test_traversal())
+    return 1;
+  if (test_compact())
+    return 1;
+  if (test_iovec())
+    return 1;
+  if (test_encoded_size())
+    return 1;
+  if (test_output())
+    return 1;
+  if (test_r2l_write())
+    return 1;
+  if (test_write_canonical_map())
+    return 1;
+  if (test_file())
+    return 1;
+  if (test_path())
+    return 1;
+  if (test_cddl())
+    return 1;
+  if (test_cddl_decode())
+    return 1;
+  if (test_cddl_encode())
+    return 1;
+  printf("All tests succeeded!\n");
+  return 0;
+}